@@ -53,6 +53,8 @@ std::string Node::GetAsString()
     return "Break";
   case ContinueStatementNode:
     return "Continue";
+  case YieldStatementNode:
+    return "Yield";
   default:
     return "???";
   }
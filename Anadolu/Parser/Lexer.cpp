@@ -111,6 +111,8 @@ void Lexer::LexTokenStartingWithALetter(const std::string &input, size_t &loc)
       tokens.emplace_back(TOKEN_BREAK, loc, end_pos - loc);
     else if(word == "continue")
       tokens.emplace_back(TOKEN_CONTINUE, loc, end_pos - loc);
+    else if(word == "yield")
+      tokens.emplace_back(TOKEN_YIELD, loc, end_pos - loc);
     else if(word == "var")
       tokens.emplace_back(TOKEN_VAR, loc, end_pos - loc);
     else if(word == "def")
@@ -46,7 +46,8 @@ enum NodeType
   DecrementStatementNode,
   AssignmentNode,
   BreakStatementNode,
-  ContinueStatementNode
+  ContinueStatementNode,
+  YieldStatementNode
 };
 
 class Node
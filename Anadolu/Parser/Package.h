@@ -42,7 +42,8 @@ enum StatementType
   ST_BlockEndStatement, // a hidden statement, at the end of each block
   ST_IfStatement,
   ST_WhileStatement,
-  ST_ReturnStatement
+  ST_ReturnStatement,
+  ST_YieldStatement
 };
 
 enum DesignatorType
@@ -399,6 +400,19 @@ public:
 
 };
 
+// suspends the script if it runs as a coroutine, it continues here when it is resumed
+class YieldStatement : public Statement
+{
+public:
+
+  YieldStatement(Block *_block) : Statement(_block)
+  {
+    statementType = ST_YieldStatement;
+    isComplete = true;
+  }
+
+};
+
 class IfStatement : public Statement
 {
 public:
@@ -600,6 +600,20 @@ bool PackageParser::ParseStatement(Node *parent)
       }
     }
     break;
+  case TOKEN_YIELD:
+    {
+      Node *statement = new Node(YieldStatementNode);
+      statement->startToken = GetCurrentTokenPos();
+      statement->endToken = GetCurrentTokenPos();
+      Consume();
+      if(LookAhead(0) != TOKEN_NEWLINE)
+      {
+        ErrorMinor("Missing ;");
+        Rewind();
+      }
+      parent->AddChild(statement);
+    }
+    break;
   case TOKEN_IDENTIFIER: // starts with an identifier, then it can be an expression or an assignment statement
     {
       Node *desig = ParseDesignator();
@@ -529,6 +529,7 @@ Block *PackageParserSemantic::CreateBlockAndVariables(Node *blockNode, Block *pa
       }
       break;
     case ReturnStatementNode:
+    case YieldStatementNode:
       {
         Statement *stmt = ParseStatement(child, newBlock, function);
         newBlock->AddStatement(stmt);
@@ -758,6 +759,9 @@ Statement *PackageParserSemantic::ParseStatement(Node *statementNode, Block *blo
       }
     }
     break;
+  case YieldStatementNode:
+    statement = new YieldStatement(block);
+    break;
   default:
     assert(0);
     break;
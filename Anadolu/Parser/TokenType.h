@@ -31,6 +31,7 @@ enum TokenType
 
   TOKEN_BREAK, // break
   TOKEN_CONTINUE, // continue
+  TOKEN_YIELD, // yield
 
   TOKEN_COMMA, // ,
   TOKEN_COLON, // : 
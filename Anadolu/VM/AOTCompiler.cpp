@@ -0,0 +1,304 @@
+#include "AOTCompiler.h"
+#include "JITCompiler.h"
+
+#include <vector>
+#include <algorithm>
+
+// the smallest INT32 can't be written as a literal
+static void WriteConstant(std::stringstream &ss, INT32 value)
+{
+  if(value == INT32_MIN)
+    ss << "INT32_MIN";
+  else
+    ss << value;
+}
+
+static const char *GetWidthTypeName(OperandWidth width)
+{
+  return width == OW_Byte ? "char" : (width == OW_Int32 ? "INT32" : "INT");
+}
+
+void AOTCompiler::WriteOperand(std::stringstream &ss, const OperandInfo &operand, INT32 param)
+{
+  if(operand.type == OT_Const)
+  {
+    WriteConstant(ss, param);
+    return;
+  }
+
+  ss << "*(" << GetWidthTypeName(operand.width) << "*)";
+  if(operand.type == OT_Register)
+    ss << "(registers + " << param << ")";
+  else
+    ss << "(" << (operand.type == OT_Local ? "locals" : "params") << " + " << param << ")";
+}
+
+void AOTCompiler::WriteStore(std::stringstream &ss, const OperandInfo &operand, INT32 param, const std::string &value)
+{
+  ss << "  ";
+  WriteOperand(ss, operand, param);
+  ss << " = (" << GetWidthTypeName(operand.width) << ")(" << value << ");\n";
+}
+
+void AOTCompiler::WriteInstruction(std::stringstream &ss, Instruction &instruction, INT32 index, const std::vector<INT32> &callMemory,
+  const std::unordered_map<INT32, std::string> &functionNames)
+{
+  const InstructionInfo &info = GetInstructionInfo(instruction.opCode);
+
+  auto Operand = [&](INT32 p) -> std::string
+  {
+    std::stringstream operand;
+    WriteOperand(operand, info.operands[p], GetInstructionParam(instruction, p));
+    return operand.str();
+  };
+
+  switch(instruction.opCode)
+  {
+  case OP_NoOp: case OP_BStart: case OP_BEnd: case OP_CallUnprep:
+  case OP_DAllocL: // frame is given back when returning
+  case OP_Yield: // coroutines are interpreted, native code never suspends
+    break;
+
+  case OP_ResetR:
+    ss << "  *(INT32*)(registers + " << instruction.param1 << ") = 0;\n";
+    break;
+
+  case OP_CallPrep:
+    ss << "  registers[" << instruction.param1 << "] = (INT)(calls + " << callMemory[index] << ");\n";
+    break;
+
+  case OP_CopyData4ROR:
+  case OP_CopyData1ROR:
+    ss << "  memcpy((char*)registers[" << instruction.param1 << "] + " << instruction.param2 << ", registers + " << instruction.param3;
+    ss << ", " << (instruction.opCode == OP_CopyData4ROR ? 4 : 1) << ");\n";
+    break;
+
+  case OP_Call:
+  case OP_CallNative:
+  case OP_CallInterpreted:
+    {
+      auto callee = functionNames.find(instruction.param1);
+      ss << "  status = AOTCompiler::Call(context, " << (callee != functionNames.end() ? callee->second : "nullptr") << ", " << instruction.param1;
+      ss << ", (char*)registers[" << instruction.param3 << "], (char*)(registers + " << instruction.param2 << "));\n";
+      ss << "  if(status != ExecutionContext::Returned)\n";
+      ss << "    return status;\n";
+    }
+    break;
+
+  case OP_Jump:
+    ss << "  goto L" << index + instruction.param1 + 1 << ";\n";
+    break;
+
+  case OP_JumpbR:
+    ss << "  {\n";
+    ss << "    INT32 condition = " << Operand(0) << ";\n";
+    ss << "    *(INT32*)(registers + " << instruction.param1 << ") = 0;\n";
+    ss << "    if(condition == 1)\n";
+    ss << "      goto L" << index + instruction.param2 + 1 << ";\n";
+    ss << "    goto L" << index + instruction.param3 + 1 << ";\n";
+    ss << "  }\n";
+    break;
+
+  case OP_IncJumpNeiLC:
+  case OP_IncJumpNeiRC:
+    ss << "  if(++" << Operand(0) << " != " << instruction.param2 << ")\n";
+    ss << "    goto L" << index + instruction.param3 + 1 << ";\n";
+    break;
+
+  case OP_NotbRR:
+    WriteStore(ss, info.operands[0], instruction.param1, Operand(1) + " == 0");
+    break;
+
+  case OP_CopyiXR:
+    ss << "  *(INT32*)returnValue = " << Operand(0) << ";\n";
+    break;
+
+  case OP_Return:
+    ss << "  return ExecutionContext::Returned;\n";
+    break;
+
+  default:
+    {
+      JITCompiler::Operation operation = JITCompiler::GetOperation(instruction.opCode);
+
+      if(operation == JITCompiler::JO_Copy)
+      {
+        WriteStore(ss, info.operands[0], instruction.param1, Operand(1));
+        break;
+      }
+
+      if(operation == JITCompiler::JO_JumpEqual || operation == JITCompiler::JO_JumpNotEqual)
+      {
+        ss << "  if(" << Operand(0) << (operation == JITCompiler::JO_JumpEqual ? " == " : " != ") << Operand(1) << ")\n";
+        ss << "    goto L" << index + instruction.param3 + 1 << ";\n";
+        break;
+      }
+
+      // two operand forms change their first operand, the others write the result to it.
+      // adding, subtracting and multiplying wrap around like machine instructions do
+      INT32 first = info.operands[2].type == OT_None ? 0 : 1;
+      std::string a = Operand(first), b = Operand(first + 1);
+      std::string value;
+      switch(operation)
+      {
+      case JITCompiler::JO_Add:
+        value = "(uint32_t)" + a + " + (uint32_t)" + b;
+        break;
+      case JITCompiler::JO_Subtract:
+        value = "(uint32_t)" + a + " - (uint32_t)" + b;
+        break;
+      case JITCompiler::JO_Multiply:
+        value = "(uint32_t)" + a + " * (uint32_t)" + b;
+        break;
+      case JITCompiler::JO_Divide:
+        // dividing by zero gives zero, like the interpreter
+        value = b + " == 0 ? 0 : " + a + " / " + b;
+        break;
+      case JITCompiler::JO_Compare:
+        value = a + " == " + b;
+        break;
+      default:
+        break;
+      }
+
+      WriteStore(ss, info.operands[0], instruction.param1, value);
+    }
+  }
+}
+
+void AOTCompiler::WriteFunction(std::stringstream &ss, FunctionBytecode *function, const std::string &functionName,
+  const std::unordered_map<INT32, std::string> &functionNames)
+{
+  std::vector<Instruction> &instructions = function->optimizedInstructions;
+  Instruction &allocation = instructions[0];
+
+  // frame is laid out like the JIT does, locals, registers, then parameter memory of each call
+  std::vector<INT32> callMemory(instructions.size(), 0);
+  INT32 callMemorySize = 0;
+  bool hasCalls = false;
+
+  // instructions jumped to get a label
+  std::vector<bool> labels(instructions.size(), false);
+
+  for(INT32 i = 0; i < (INT32)instructions.size(); ++i)
+  {
+    Instruction &instruction = instructions[i];
+    if(instruction.opCode == OP_CallPrep)
+    {
+      callMemory[i] = callMemorySize;
+      callMemorySize += (instruction.param2 + 7) & ~7;
+    }
+    else if(GetInstructionInfo(instruction.opCode).genericOpCode == OP_Call)
+      hasCalls = true;
+
+    const InstructionInfo &info = GetInstructionInfo(instruction.opCode);
+    for(INT32 p = 0; p < 3; ++p)
+      if(info.operands[p].type == OT_Offset)
+        labels[i + GetInstructionParam(instruction, p) + 1] = true;
+  }
+
+  INT32 localsSize = (allocation.param1 + 7) & ~7;
+  INT32 registerCount = allocation.param2 + 1;
+
+  ss << "static INT32 " << functionName << "(ExecutionContext *context, char *params, char *returnValue)\n";
+  ss << "{\n";
+  ss << "  INT frame[(" << localsSize << " + " << callMemorySize << ") / sizeof(INT) + " << registerCount << "];\n";
+  ss << "  char *locals = (char*)frame;\n";
+  ss << "  INT *registers = (INT*)(locals + " << localsSize << ");\n";
+  if(callMemorySize)
+    ss << "  char *calls = (char*)(registers + " << registerCount << ");\n";
+  if(hasCalls)
+    ss << "  INT32 status;\n";
+  ss << "  memset(frame, 0, " << localsSize << " + " << registerCount << " * sizeof(INT));\n";
+  ss << "\n";
+
+  for(INT32 i = 1; i < (INT32)instructions.size(); ++i)
+  {
+    if(labels[i])
+      ss << "L" << i << ":\n";
+
+    std::streampos start = ss.tellp();
+    WriteInstruction(ss, instructions[i], i, callMemory, functionNames);
+
+    // a label needs a statement after it
+    if(labels[i] && ss.tellp() == start)
+      ss << "  ;\n";
+  }
+
+  ss << "}\n\n";
+}
+
+void AOTCompiler::Compile(Bytecode *bytecode, const std::string &name, std::string &source)
+{
+  // functions in id order, the same bytecode always gives the same source
+  std::vector<std::pair<INT32, std::string>> functions;
+  for(auto &function : bytecode->globalFunctionNames)
+    functions.emplace_back(function.second, function.first);
+  std::sort(functions.begin(), functions.end());
+
+  // names of compiled functions in the source, the rest are interpreted. C++ isn't sure to reuse the frame
+  // of a tail call, functions making them are interpreted so their recursion isn't limited
+  std::unordered_map<INT32, std::string> functionNames;
+  for(auto &function : functions)
+    if(JITCompiler::CanCompile(bytecode->functionBytecodes[function.first], false))
+      functionNames[function.first] = name + "_" + function.second;
+
+  std::stringstream ss;
+  ss << "// " << name << " compiled by AOTCompiler. compile the package again instead of changing this file\n";
+  ss << "#include \"VM/AOTCompiler.h\"\n";
+  ss << "\n";
+  ss << "#include <string.h>\n";
+  ss << "\n";
+  ss << "static_assert(OP_NumOfOpCodes == " << OP_NumOfOpCodes << ", \"instructions changed, compile the package again\");\n";
+  ss << "\n";
+
+  for(auto &function : functions)
+  {
+    auto compiled = functionNames.find(function.first);
+    if(compiled != functionNames.end())
+      ss << "static INT32 " << compiled->second << "(ExecutionContext *context, char *params, char *returnValue);\n";
+  }
+  ss << "\n";
+
+  for(auto &function : functions)
+  {
+    FunctionBytecode *functionBytecode = bytecode->functionBytecodes[function.first];
+
+    ss << "static const Instruction " << name << "_" << function.second << "_instructions[] =\n";
+    ss << "{\n";
+    for(auto &instruction : functionBytecode->optimizedInstructions)
+    {
+      // bytecode that has run has its calls quickened, instructions are written as they were generated
+      ss << "  Instruction((OpCode)" << GetInstructionInfo(instruction.opCode).genericOpCode << ", ";
+      WriteConstant(ss, instruction.param1);
+      ss << ", ";
+      WriteConstant(ss, instruction.param2);
+      ss << ", ";
+      WriteConstant(ss, instruction.param3);
+      ss << "),\n";
+    }
+    ss << "};\n";
+    ss << "\n";
+
+    auto compiled = functionNames.find(function.first);
+    if(compiled != functionNames.end())
+      WriteFunction(ss, functionBytecode, compiled->second, functionNames);
+  }
+
+  ss << "extern const CompiledFunction " << name << "_functions[] =\n";
+  ss << "{\n";
+  for(auto &function : functions)
+  {
+    FunctionBytecode *functionBytecode = bytecode->functionBytecodes[function.first];
+    auto compiled = functionNames.find(function.first);
+
+    ss << "  { \"" << function.second << "\", " << function.first << ", " << functionBytecode->parameterSize << ", ";
+    ss << name << "_" << function.second << "_instructions, " << functionBytecode->optimizedInstructions.size() << ", ";
+    ss << (compiled != functionNames.end() ? compiled->second : "nullptr") << " },\n";
+  }
+  ss << "};\n";
+  ss << "\n";
+  ss << "extern const INT " << name << "_functionCount = " << functions.size() << ";\n";
+
+  source = ss.str();
+}
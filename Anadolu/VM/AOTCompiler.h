@@ -0,0 +1,76 @@
+#pragma once
+
+#include "InstructionInfo.h"
+#include "Bytecode.h"
+#include "ExecutionContext.h"
+
+#include <string>
+#include <sstream>
+#include <unordered_map>
+
+// function of a package compiled ahead of time. tables of these are in the source AOTCompiler writes
+class CompiledFunction
+{
+public:
+
+  const char *name;
+  INT32 id;
+  INT32 parameterSize;
+
+  // bytecode the function is compiled from. interpreted when native calls go too deep,
+  // compared with the bytecode of the package to see if the compiled function is still the same
+  const Instruction *instructions;
+  INT32 instructionCount;
+
+  // null if the function has instructions that are not compiled, it is interpreted then
+  NativeFunction nativeCode;
+
+};
+
+// Writes C++ source for the bytecode of a package, to be built into a program that runs the package without
+// parsing it. Every function becomes a native function with the calling convention of JIT compiled code,
+// translated one instruction at a time like the JIT does. The source defines <name>_functions and
+// <name>_functionCount, a table of CompiledFunction for VM::AddCompiledFunctions
+class AOTCompiler
+{
+private:
+
+  // memory an operand refers to, or its value if it is a constant
+  static void WriteOperand(std::stringstream &ss, const OperandInfo &operand, INT32 param);
+
+  static void WriteStore(std::stringstream &ss, const OperandInfo &operand, INT32 param, const std::string &value);
+
+  static void WriteInstruction(std::stringstream &ss, Instruction &instruction, INT32 index, const std::vector<INT32> &callMemory,
+    const std::unordered_map<INT32, std::string> &functionNames);
+
+  static void WriteFunction(std::stringstream &ss, FunctionBytecode *function, const std::string &functionName,
+    const std::unordered_map<INT32, std::string> &functionNames);
+
+public:
+
+  static void Compile(Bytecode *bytecode, const std::string &name, std::string &source);
+
+  // calls made by compiled functions, function is null if the called function is interpreted
+  static inline INT32 Call(ExecutionContext *context, NativeFunction function, INT32 functionId, char *params, char *returnValue)
+  {
+    if(context->callDepth == context->maxCallDepth)
+      return ExecutionContext::CallDepthExceeded;
+
+    INT32 status;
+    ++context->callDepth;
+
+    // machine stack is limited, deep recursion continues in the interpreter
+    if(function && context->nativeDepth < ExecutionContext::maxNativeDepth)
+    {
+      ++context->nativeDepth;
+      status = function(context, params, returnValue);
+      --context->nativeDepth;
+    }
+    else
+      status = ExecutionContext::CallInterpreted(context, functionId, params, returnValue);
+
+    --context->callDepth;
+    return status;
+  }
+
+};
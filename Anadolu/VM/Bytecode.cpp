@@ -1,12 +1,215 @@
 #include "Bytecode.h"
+#include "InstructionInfo.h"
+#include "TieredCompiler.h"
 
 #include <sstream>
+#include <unordered_map>
+#include <assert.h>
+
+// operand of the instruction before index that writes the register, if it only writes that register with the width
+// and nothing reads it from index on. -1 otherwise, the register is searched until a jump
+static INT32 FindArgumentWrite(std::vector<Instruction> &code, const std::vector<bool> &labels, INT32 index, INT32 reg, OperandWidth width)
+{
+  if(index == 0 || labels[index])
+    return -1;
+
+  Instruction &previous = code[index - 1];
+  const InstructionInfo &previousInfo = GetInstructionInfo(previous.opCode);
+  if(previousInfo.hasSideEffects)
+    return -1;
+
+  INT32 write = -1;
+  for(INT32 p = 0; p < 3; ++p)
+  {
+    const OperandInfo &operand = previousInfo.operands[p];
+    if(operand.type != OT_Register || !(operand.access & OA_Write))
+      continue;
+    if(write != -1 || operand.access != OA_Write || operand.width != width || GetInstructionParam(previous, p) != reg)
+      return -1;
+    write = p;
+  }
+  if(write == -1)
+    return -1;
+
+  for(INT32 i = index + 1; i < (INT32)code.size(); ++i)
+  {
+    const InstructionInfo &info = GetInstructionInfo(code[i].opCode);
+    bool writes = false;
+    for(INT32 p = 0; p < 3; ++p)
+    {
+      if(info.operands[p].type != OT_Register || GetInstructionParam(code[i], p) != reg)
+        continue;
+      if(info.operands[p].access & OA_Read)
+        return -1;
+      writes = true;
+    }
+
+    // registers go away with the frame
+    if(writes || code[i].opCode == OP_Return || info.genericOpCode == OP_TailCall)
+      return write;
+    if(info.IsJump())
+      return -1;
+  }
+
+  return -1;
+}
+
+void FunctionBytecode::Predecode(const DispatchTarget *dispatchTable)
+{
+  decodedInstructions.clear();
+  decodedInstructions.reserve(optimizedInstructions.size());
+  instructionIndices.clear();
+
+  // frame is the locals, the registers and then parameter memory of each call, like the JIT lays it out.
+  // callee's parameters are the memory its caller prepared in its own frame, arguments aren't copied again
+  bool allocates = !optimizedInstructions.empty() && optimizedInstructions[0].opCode == OP_AllocL;
+  INT32 registersOffset = 0, callMemoryOffset = 0, callMemorySize = 0;
+  if(allocates)
+  {
+    registersOffset = (optimizedInstructions[0].param1 + 7) & ~7;
+    callMemoryOffset = registersOffset + (optimizedInstructions[0].param2 + 1) * (INT32)sizeof(INT);
+  }
+
+  // instructions jumped to, registers known to point to call memory are forgotten there
+  std::vector<bool> labels(optimizedInstructions.size(), false);
+  for(INT32 i = 0; i < (INT32)optimizedInstructions.size(); ++i)
+  {
+    const InstructionInfo &info = GetInstructionInfo(optimizedInstructions[i].opCode);
+    for(INT32 p = 0; p < 3; ++p)
+    {
+      if(info.operands[p].type != OT_Offset)
+        continue;
+
+      INT32 target = i + GetInstructionParam(optimizedInstructions[i], p) + 1;
+      assert(target >= 0 && target < (INT32)optimizedInstructions.size());
+      labels[target] = true;
+    }
+  }
+
+  // instructions that do nothing once decoded are left out, jumps go to the next one that is decoded
+  std::vector<bool> removed(optimizedInstructions.size(), false);
+
+  // register offset to the frame offset of the call memory it points to
+  std::unordered_map<INT32, INT32> callMemory;
+
+  for(INT32 i = 0; i < (INT32)optimizedInstructions.size(); ++i)
+  {
+    Instruction &instruction = optimizedInstructions[i];
+    const InstructionInfo &info = GetInstructionInfo(instruction.opCode);
+
+    if(labels[i])
+      callMemory.clear();
+
+    DecodedInstruction decoded;
+    decoded.handler = dispatchTable[instruction.opCode];
+    decoded.param1 = instruction.param1;
+    decoded.param2 = instruction.param2;
+    decoded.param3 = instruction.param3;
+
+    for(INT32 p = 0; p < 3; ++p)
+    {
+      INT32 &param = p == 0 ? decoded.param1 : (p == 1 ? decoded.param2 : decoded.param3);
+      if(info.operands[p].type == OT_Register)
+        param = registersOffset + param * (INT32)sizeof(INT);
+    }
+
+    switch(instruction.opCode)
+    {
+    case OP_CallPrep:
+      decoded.param2 = callMemoryOffset + callMemorySize;
+      callMemorySize += (instruction.param2 + 7) & ~7;
+      callMemory[decoded.param1] = decoded.param2;
+      break;
+
+    // call memory goes away with the frame
+    case OP_CallUnprep:
+      removed[i] = true;
+      break;
+
+    // arguments go straight to the frame if the register points to call memory. the instruction computing
+    // an argument writes it to its parameter there if its register isn't read again, the copy is left out
+    case OP_CopyData4ROR:
+    case OP_CopyData1ROR:
+      {
+        auto it = callMemory.find(decoded.param1);
+        if(it != callMemory.end())
+        {
+          OperandWidth width = instruction.opCode == OP_CopyData4ROR ? OW_Int32 : OW_Byte;
+          INT32 write = FindArgumentWrite(optimizedInstructions, labels, i, instruction.param3, width);
+          if(write != -1)
+          {
+            DecodedInstruction &previous = decodedInstructions.back();
+            (write == 0 ? previous.param1 : (write == 1 ? previous.param2 : previous.param3)) = it->second + instruction.param2;
+            removed[i] = true;
+          }
+          else
+          {
+            decoded.handler = dispatchTable[instruction.opCode == OP_CopyData4ROR ? OP_CopyiRR : OP_CopybRR];
+            decoded.param1 = it->second + instruction.param2;
+            decoded.param2 = decoded.param3;
+            decoded.param3 = 0;
+          }
+        }
+      }
+      break;
+
+    default:
+      for(INT32 p = 0; p < 3; ++p)
+        if(info.operands[p].type == OT_Register && info.operands[p].access != OA_Read)
+          callMemory.erase(p == 0 ? decoded.param1 : (p == 1 ? decoded.param2 : decoded.param3));
+      break;
+    }
+
+    decodedInstructions.push_back(decoded);
+  }
+
+  // AllocL takes the whole frame and clears the locals and registers
+  if(allocates)
+  {
+    decodedInstructions[0].param1 = callMemoryOffset + callMemorySize;
+    decodedInstructions[0].param2 = callMemoryOffset;
+  }
+
+  // decoded index of each instruction, of the next decoded one for those left out
+  std::vector<INT32> decodedIndices(optimizedInstructions.size() + 1, 0);
+  for(INT32 i = 0; i < (INT32)optimizedInstructions.size(); ++i)
+    decodedIndices[i + 1] = decodedIndices[i] + (removed[i] ? 0 : 1);
+
+  for(INT32 i = 0; i < (INT32)optimizedInstructions.size(); ++i)
+  {
+    if(removed[i])
+      continue;
+
+    DecodedInstruction decoded = decodedInstructions[i];
+    const InstructionInfo &info = GetInstructionInfo(optimizedInstructions[i].opCode);
+    for(INT32 p = 0; p < 3; ++p)
+    {
+      if(info.operands[p].type != OT_Offset)
+        continue;
+
+      INT32 &param = p == 0 ? decoded.param1 : (p == 1 ? decoded.param2 : decoded.param3);
+      param = decodedIndices[i + param + 1] - decodedIndices[i] - 1;
+    }
+
+    decodedInstructions[decodedIndices[i]] = decoded;
+    instructionIndices.push_back(i);
+  }
+  decodedInstructions.resize(instructionIndices.size());
+}
 
 FunctionBytecode *Bytecode::GetFunctionBytecodeIndex(size_t id)
 {
   return functionBytecodes[id];
 }
 
+FunctionBytecode *Bytecode::GetCalledFunctionBytecode(INT id)
+{
+  FunctionBytecode *functionBytecode = functionBytecodes[id];
+  if(tieredCompiler && ++functionBytecode->callCount == tieredCompiler->callThreshold)
+    functionBytecode = tieredCompiler->TierUp(functionBytecode);
+  return functionBytecode;
+}
+
 FunctionBytecode *Bytecode::GetFunctionBytecode(const std::string &name)
 {
   auto &it = globalFunctionNames.find(name);
@@ -52,6 +255,126 @@ void Bytecode::GetByteCode(std::string &str, bool lineNumbers)
       ss << "Jump";
       ss << " " << instruction.param1;
       break;
+    case OP_JumpEqiLC:
+      ss << "JumpEqiLC";
+      ss << " l" << instruction.param1;
+      ss << " " << instruction.param2;
+      ss << " " << instruction.param3;
+      break;
+    case OP_JumpEqiPC:
+      ss << "JumpEqiPC";
+      ss << " p" << instruction.param1;
+      ss << " " << instruction.param2;
+      ss << " " << instruction.param3;
+      break;
+    case OP_JumpEqiRC:
+      ss << "JumpEqiRC";
+      ss << " r" << instruction.param1;
+      ss << " " << instruction.param2;
+      ss << " " << instruction.param3;
+      break;
+    case OP_JumpEqiLL:
+      ss << "JumpEqiLL";
+      ss << " l" << instruction.param1;
+      ss << " l" << instruction.param2;
+      ss << " " << instruction.param3;
+      break;
+    case OP_JumpEqiPL:
+      ss << "JumpEqiPL";
+      ss << " p" << instruction.param1;
+      ss << " l" << instruction.param2;
+      ss << " " << instruction.param3;
+      break;
+    case OP_JumpEqiPP:
+      ss << "JumpEqiPP";
+      ss << " p" << instruction.param1;
+      ss << " p" << instruction.param2;
+      ss << " " << instruction.param3;
+      break;
+    case OP_JumpEqiRR:
+      ss << "JumpEqiRR";
+      ss << " r" << instruction.param1;
+      ss << " r" << instruction.param2;
+      ss << " " << instruction.param3;
+      break;
+    case OP_JumpEqiRL:
+      ss << "JumpEqiRL";
+      ss << " r" << instruction.param1;
+      ss << " l" << instruction.param2;
+      ss << " " << instruction.param3;
+      break;
+    case OP_JumpEqiRP:
+      ss << "JumpEqiRP";
+      ss << " r" << instruction.param1;
+      ss << " p" << instruction.param2;
+      ss << " " << instruction.param3;
+      break;
+    case OP_JumpNeiLC:
+      ss << "JumpNeiLC";
+      ss << " l" << instruction.param1;
+      ss << " " << instruction.param2;
+      ss << " " << instruction.param3;
+      break;
+    case OP_JumpNeiPC:
+      ss << "JumpNeiPC";
+      ss << " p" << instruction.param1;
+      ss << " " << instruction.param2;
+      ss << " " << instruction.param3;
+      break;
+    case OP_JumpNeiRC:
+      ss << "JumpNeiRC";
+      ss << " r" << instruction.param1;
+      ss << " " << instruction.param2;
+      ss << " " << instruction.param3;
+      break;
+    case OP_JumpNeiLL:
+      ss << "JumpNeiLL";
+      ss << " l" << instruction.param1;
+      ss << " l" << instruction.param2;
+      ss << " " << instruction.param3;
+      break;
+    case OP_JumpNeiPL:
+      ss << "JumpNeiPL";
+      ss << " p" << instruction.param1;
+      ss << " l" << instruction.param2;
+      ss << " " << instruction.param3;
+      break;
+    case OP_JumpNeiPP:
+      ss << "JumpNeiPP";
+      ss << " p" << instruction.param1;
+      ss << " p" << instruction.param2;
+      ss << " " << instruction.param3;
+      break;
+    case OP_JumpNeiRR:
+      ss << "JumpNeiRR";
+      ss << " r" << instruction.param1;
+      ss << " r" << instruction.param2;
+      ss << " " << instruction.param3;
+      break;
+    case OP_JumpNeiRL:
+      ss << "JumpNeiRL";
+      ss << " r" << instruction.param1;
+      ss << " l" << instruction.param2;
+      ss << " " << instruction.param3;
+      break;
+    case OP_JumpNeiRP:
+      ss << "JumpNeiRP";
+      ss << " r" << instruction.param1;
+      ss << " p" << instruction.param2;
+      ss << " " << instruction.param3;
+      break;
+    case OP_IncJumpNeiLC:
+      ss << "IncJumpNeiLC";
+      ss << " l" << instruction.param1;
+      ss << " " << instruction.param2;
+      ss << " " << instruction.param3;
+      break;
+    case OP_IncJumpNeiRC:
+      ss << "IncJumpNeiRC";
+      ss << " r" << instruction.param1;
+      ss << " " << instruction.param2;
+      ss << " " << instruction.param3;
+      break;
 
     case OP_CallPrep:
       ss << "CallPrep";
@@ -59,12 +382,34 @@ void Bytecode::GetByteCode(std::string &str, bool lineNumbers)
       ss << " " << instruction.param2;
       break;
 
+    case OP_CallUnprep:
+      ss << "CallUnprep";
+      ss << " r" << instruction.param1;
+      break;
+
     case OP_Call:
       ss << "Call";
       ss << " f" << instruction.param1;
       ss << " " << instruction.param2;
       ss << " r" << instruction.param3;
       break;
+    case OP_CallNative:
+      ss << "CallNative";
+      ss << " f" << instruction.param1;
+      ss << " " << instruction.param2;
+      ss << " r" << instruction.param3;
+      break;
+    case OP_CallInterpreted:
+      ss << "CallInterpreted";
+      ss << " f" << instruction.param1;
+      ss << " " << instruction.param2;
+      ss << " r" << instruction.param3;
+      break;
+    case OP_TailCall:
+      ss << "TailCall";
+      ss << " f" << instruction.param1;
+      ss << " r" << instruction.param2;
+      break;
 
     case OP_NotbRR:
       ss << "NotbRR";
@@ -568,6 +913,16 @@ void Bytecode::GetByteCode(std::string &str, bool lineNumbers)
       ss << " r" << instruction.param1;
       ss << " l" << instruction.param2;
       break;
+    case OP_SpillLR:
+      ss << "SpillLR";
+      ss << " l" << instruction.param1;
+      ss << " r" << instruction.param2;
+      break;
+    case OP_ReloadRL:
+      ss << "ReloadRL";
+      ss << " r" << instruction.param1;
+      ss << " l" << instruction.param2;
+      break;
 
 
     case  OP_CmpbRPP:
@@ -642,6 +997,12 @@ void Bytecode::GetByteCode(std::string &str, bool lineNumbers)
       ss << " l" << instruction.param2;
       ss << " r" << instruction.param3;
       break;
+    case OP_CmpbRLL:
+      ss << "CmpbRLL";
+      ss << " r" << instruction.param1;
+      ss << " l" << instruction.param2;
+      ss << " l" << instruction.param3;
+      break;
     case OP_CmpiRLL:
       ss << "CmpiRLL";
       ss << " r" << instruction.param1;
@@ -683,6 +1044,10 @@ void Bytecode::GetByteCode(std::string &str, bool lineNumbers)
       ss << "Return";
       break;
 
+    case OP_Yield:
+      ss << "Yield";
+      break;
+
     case OP_CopyiLP:
       ss << "CopyiLP";
       ss << " r" << instruction.param1;
@@ -764,3 +1129,22 @@ void Bytecode::GetByteCode(std::string &str, bool lineNumbers)
   str = ss.str();
 
 }
+
+void Bytecode::GetOptimizationReport(std::string &str)
+{
+  std::stringstream ss;
+
+  for(auto &funcName : globalFunctionNames)
+  {
+    FunctionBytecode *funcBcode = functionBytecodes[funcName.second];
+    size_t count = funcBcode->optimizedInstructions.size();
+
+    size_t generated = funcBcode->generatedInstructionCount;
+
+    // lowering from SSA form may add copies, so count can be higher than generated
+    ss << funcName.first << ": " << generated << " -> " << count;
+    ss << " instructions, " << (generated > count ? generated - count : 0) << " removed\n";
+  }
+
+  str = ss.str();
+}
@@ -1,25 +1,57 @@
 #pragma once
 
 #include "Instruction.h"
+#include "ExecutableMemory.h"
 
 #include <vector>
+#include <list>
 #include <unordered_map>
 #include <string>
 
 class Bytecode;
 class FunctionBytecode;
+class ExecutionContext;
+class TieredCompiler;
+
+// compiled function. returns the execution status, ExecutionContext::Returned unless execution has to stop
+typedef INT32 (*NativeFunction)(ExecutionContext *context, char *params, char *returnValue);
 
 class FunctionBytecode
 {
 public:
 
+  INT32 id;
+
   std::list<Instruction> instructions;
   std::vector<Instruction> optimizedInstructions;
 
+  // number of instructions the generator gave, before any optimization
+  size_t generatedInstructionCount;
+
+  // bytes of parameter memory the function reads
+  INT32 parameterSize;
+
+  // native code of the function, null if it is not compiled
+  NativeFunction nativeCode;
+
+  // TieredCompiler::Tier of the instructions, only used when functions are tiered
+  INT32 tier;
+
+  // counted by the interpreter while functions are tiered, to find the ones worth optimizing
+  INT32 callCount;
+  INT32 backEdgeCount;
+
+  // optimizedInstructions as the interpreter runs them, made on first execution.
+  // instructions that do nothing once decoded are left out, instructionIndices has the index of each one decoded
+  std::vector<DecodedInstruction> decodedInstructions;
+  std::vector<INT32> instructionIndices;
+
   // positions jump instructions jump to
   std::list<std::list<Instruction>::iterator> jumpLocations;
   std::list<std::list<Instruction>::iterator> jumpInstructionPositions;
 
+  FunctionBytecode() : id(-1), generatedInstructionCount(0), parameterSize(0), nativeCode(nullptr), tier(0), callCount(0), backEdgeCount(0) { }
+
   void CompactInstructions()
   {
     optimizedInstructions.reserve(instructions.size() + 1);
@@ -32,6 +64,21 @@ public:
 
   }
 
+  // decodes optimizedInstructions with the interpreter's handler for each opcode.
+  // parameters of calls are given memory at the end of the frame, arguments are computed or stored there directly
+  void Predecode(const DispatchTarget *dispatchTable);
+
+  // rewrites the opcode of a running instruction at the decoded index, parameters stay the same.
+  // an instruction that already has the opcode isn't written, shared bytecode is only read
+  void Quicken(INT decodedIndex, OpCode opCode, const DispatchTarget *dispatchTable)
+  {
+    Instruction &instruction = optimizedInstructions[instructionIndices[decodedIndex]];
+    if(instruction.opCode == opCode)
+      return;
+    instruction.opCode = opCode;
+    decodedInstructions[decodedIndex].handler = dispatchTable[opCode];
+  }
+
 };
 
 class BytecodeTemp
@@ -40,6 +87,9 @@ public:
 
 };
 
+// Code of the functions of a VM. once VM::GenerateByteCode returns, bytecode that isn't tiered is only read
+// while it runs and can be shared by ExecutionContexts on any number of threads without locks. frames are on the
+// frame stack of each thread. tiered bytecode counts calls and replaces functions, it runs on one thread at a time
 class Bytecode
 {
 public:
@@ -47,17 +97,43 @@ public:
   BytecodeTemp *temp;
 
   std::unordered_map<std::string, INT> globalFunctionNames;
-  std::unordered_map<INT, FunctionBytecode*> functionBytecodes;
 
-  Bytecode() : temp(new BytecodeTemp()) { }
+  // indexed by function id, calls find their function without hashing. null for ids without bytecode
+  std::vector<FunctionBytecode*> functionBytecodes;
+
+  // native code of compiled functions, a block for each time functions are compiled
+  std::list<ExecutableMemory> nativeMemory;
+
+  // optimizes functions that are used a lot, null if functions are not tiered
+  TieredCompiler *tieredCompiler;
+
+  // function bytecodes replaced by a higher tier. calls that started in them may still be running
+  std::vector<FunctionBytecode*> replacedFunctionBytecodes;
+
+  Bytecode() : temp(new BytecodeTemp()), tieredCompiler(nullptr) { }
 
   ~Bytecode()
   {
-    for(auto it = functionBytecodes.begin(); it != functionBytecodes.end(); )
-    {
-      delete it->second;
-      it = functionBytecodes.erase(it);
-    }
+    for(auto functionBytecode : functionBytecodes)
+      delete functionBytecode;
+    functionBytecodes.clear();
+
+    for(auto functionBytecode : replacedFunctionBytecodes)
+      delete functionBytecode;
+  }
+
+  void AddFunctionBytecode(FunctionBytecode *functionBytecode)
+  {
+    if(functionBytecode->id >= (INT)functionBytecodes.size())
+      functionBytecodes.resize(functionBytecode->id + 1, nullptr);
+    functionBytecodes[functionBytecode->id] = functionBytecode;
+  }
+
+  // calls made after this use the new bytecode
+  void ReplaceFunctionBytecode(INT id, FunctionBytecode *functionBytecode)
+  {
+    replacedFunctionBytecodes.push_back(functionBytecodes[id]);
+    functionBytecodes[id] = functionBytecode;
   }
 
   void Finalise()
@@ -67,7 +143,13 @@ public:
 
   void Bytecode::GetByteCode(std::string &str, bool lineNumbers = true);
 
+  // instruction counts of each function and how many of them the peephole optimizer removed
+  void GetOptimizationReport(std::string &str);
+
   FunctionBytecode *GetFunctionBytecode(const std::string &name);
   FunctionBytecode *GetFunctionBytecodeIndex(size_t id);
 
+  // bytecode a call from the host runs. the call is counted like calls made by scripts while functions are tiered
+  FunctionBytecode *GetCalledFunctionBytecode(INT id);
+
 };
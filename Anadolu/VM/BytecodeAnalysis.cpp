@@ -0,0 +1,132 @@
+#include "BytecodeAnalysis.h"
+
+void ToAbsoluteTargets(std::vector<Instruction> &code)
+{
+  for(size_t i = 0; i < code.size(); ++i)
+  {
+    const InstructionInfo &info = GetInstructionInfo(code[i].opCode);
+    for(INT32 p = 0; p < 3; ++p)
+      if(info.operands[p].type == OT_Offset)
+        GetInstructionParam(code[i], p) += (INT32)i + 1;
+  }
+}
+
+void ToRelativeTargets(std::vector<Instruction> &code)
+{
+  // new position of every instruction, removed ones get position of the next remaining instruction
+  std::vector<INT32> newIndex(code.size() + 1);
+  INT32 count = 0;
+  for(size_t i = 0; i < code.size(); ++i)
+  {
+    newIndex[i] = count;
+    if(code[i].opCode != OP_NoOp)
+      ++count;
+  }
+  newIndex[code.size()] = count;
+
+  for(size_t i = 0; i < code.size(); ++i)
+  {
+    const InstructionInfo &info = GetInstructionInfo(code[i].opCode);
+    for(INT32 p = 0; p < 3; ++p)
+    {
+      if(info.operands[p].type != OT_Offset)
+        continue;
+
+      INT32 &target = GetInstructionParam(code[i], p);
+      target = newIndex[target] - newIndex[i] - 1;
+    }
+  }
+}
+
+void GetSuccessors(std::vector<Instruction> &code, size_t index, std::vector<size_t> &successors)
+{
+  successors.clear();
+
+  Instruction &instruction = code[index];
+  if(instruction.opCode == OP_Return || instruction.opCode == OP_TailCall)
+    return;
+
+  if(instruction.opCode != OP_Jump && index + 1 < code.size())
+    successors.push_back(index + 1);
+
+  const InstructionInfo &info = GetInstructionInfo(instruction.opCode);
+  for(INT32 p = 0; p < 3; ++p)
+  {
+    INT32 target = GetInstructionParam(instruction, p);
+    if(info.operands[p].type == OT_Offset && target < (INT32)code.size())
+      successors.push_back(target);
+  }
+}
+
+void GetRegisterUses(Instruction &instruction, RegisterSet &uses, RegisterSet &defs)
+{
+  uses.Clear();
+  defs.Clear();
+
+  const InstructionInfo &info = GetInstructionInfo(instruction.opCode);
+  for(INT32 p = 0; p < 3; ++p)
+  {
+    const OperandInfo &operand = info.operands[p];
+    if(operand.type != OT_Register)
+      continue;
+
+    INT32 reg = GetInstructionParam(instruction, p);
+    if(operand.access & OA_Read)
+      uses.AddRegister(reg, operand.width);
+    if(operand.access & OA_Write)
+      defs.AddRegister(reg, operand.width);
+  }
+
+  // instruction reads before it writes, so a register both read and written stays live
+  defs.Remove(uses);
+}
+
+INT32 GetRegisterCount(std::vector<Instruction> &code)
+{
+  INT32 count = 0;
+  for(auto &instruction : code)
+  {
+    const InstructionInfo &info = GetInstructionInfo(instruction.opCode);
+    for(INT32 p = 0; p < 3; ++p)
+      if(info.operands[p].type == OT_Register && GetInstructionParam(instruction, p) >= count)
+        count = GetInstructionParam(instruction, p) + 1;
+  }
+  return count;
+}
+
+void RegisterLiveness::Compute(std::vector<Instruction> &code)
+{
+  INT32 registerCount = GetRegisterCount(code);
+
+  liveIn.assign(code.size(), RegisterSet(registerCount));
+  liveOut.assign(code.size(), RegisterSet(registerCount));
+
+  std::vector<size_t> successors;
+  RegisterSet uses(registerCount), defs(registerCount), in(registerCount), out(registerCount);
+
+  // backwards until nothing changes, loops need more than one pass
+  bool changed = true;
+  while(changed)
+  {
+    changed = false;
+    for(size_t i = code.size(); i-- > 0;)
+    {
+      out.Clear();
+      GetSuccessors(code, i, successors);
+      for(auto successor : successors)
+        out.Add(liveIn[successor]);
+
+      GetRegisterUses(code[i], uses, defs);
+      in = out;
+      in.Remove(defs);
+      in.Add(uses);
+
+      if(in != liveIn[i] || out != liveOut[i])
+      {
+        liveIn[i] = in;
+        liveOut[i] = out;
+        changed = true;
+      }
+    }
+  }
+}
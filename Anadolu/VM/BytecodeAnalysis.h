@@ -0,0 +1,134 @@
+#pragma once
+
+#include "InstructionInfo.h"
+
+#include <vector>
+
+// Helpers shared by bytecode optimization passes.
+// Passes work on a vector of instructions where jump offsets are absolute instruction indices
+// and removed instructions are OP_NoOp, so nothing has to be moved until the pass is done.
+
+// set of register lanes. every register has two lanes, low byte (bools) and the rest of it.
+// a bool write leaves the rest untouched, so each lane is tracked on its own
+class RegisterSet
+{
+private:
+
+  std::vector<uint64_t> words;
+
+public:
+
+  RegisterSet() { }
+
+  explicit RegisterSet(INT32 registerCount) : words((registerCount * 2 + 63) / 64, 0) { }
+
+  void AddLane(INT32 lane)
+  {
+    if((size_t)lane / 64 >= words.size())
+      words.resize(lane / 64 + 1, 0);
+    words[lane / 64] |= (uint64_t)1 << (lane % 64);
+  }
+
+  bool HasLane(INT32 lane) const
+  {
+    return (size_t)lane / 64 < words.size() && (words[lane / 64] & ((uint64_t)1 << (lane % 64))) != 0;
+  }
+
+  // adds one lane for bools, both lanes otherwise
+  void AddRegister(INT32 reg, OperandWidth width)
+  {
+    AddLane(reg * 2);
+    if(width != OW_Byte)
+      AddLane(reg * 2 + 1);
+  }
+
+  // true if any lane of the register is in the set
+  bool HasRegister(INT32 reg) const
+  {
+    return HasLane(reg * 2) || HasLane(reg * 2 + 1);
+  }
+
+  bool Intersects(const RegisterSet &other) const
+  {
+    size_t size = words.size() < other.words.size() ? words.size() : other.words.size();
+    for(size_t i = 0; i < size; ++i)
+      if(words[i] & other.words[i])
+        return true;
+    return false;
+  }
+
+  bool IsEmpty() const
+  {
+    for(auto word : words)
+      if(word)
+        return false;
+    return true;
+  }
+
+  void Clear()
+  {
+    for(auto &word : words)
+      word = 0;
+  }
+
+  void Add(const RegisterSet &other)
+  {
+    if(words.size() < other.words.size())
+      words.resize(other.words.size(), 0);
+    for(size_t i = 0; i < other.words.size(); ++i)
+      words[i] |= other.words[i];
+  }
+
+  void Remove(const RegisterSet &other)
+  {
+    size_t size = words.size() < other.words.size() ? words.size() : other.words.size();
+    for(size_t i = 0; i < size; ++i)
+      words[i] &= ~other.words[i];
+  }
+
+  bool operator==(const RegisterSet &other) const
+  {
+    size_t size = words.size() > other.words.size() ? words.size() : other.words.size();
+    for(size_t i = 0; i < size; ++i)
+    {
+      uint64_t a = i < words.size() ? words[i] : 0;
+      uint64_t b = i < other.words.size() ? other.words[i] : 0;
+      if(a != b)
+        return false;
+    }
+    return true;
+  }
+
+  bool operator!=(const RegisterSet &other) const
+  {
+    return !(*this == other);
+  }
+
+};
+
+// registers live before and after each instruction
+class RegisterLiveness
+{
+public:
+
+  std::vector<RegisterSet> liveIn;
+  std::vector<RegisterSet> liveOut;
+
+  void Compute(std::vector<Instruction> &code);
+
+};
+
+// relative jump offsets to absolute instruction indices
+void ToAbsoluteTargets(std::vector<Instruction> &code);
+
+// absolute indices back to relative offsets, as if OP_NoOp instructions were already removed
+void ToRelativeTargets(std::vector<Instruction> &code);
+
+// instructions that can run after the one at index
+void GetSuccessors(std::vector<Instruction> &code, size_t index, std::vector<size_t> &successors);
+
+// registers the instruction reads and registers it writes without reading them first
+void GetRegisterUses(Instruction &instruction, RegisterSet &uses, RegisterSet &defs);
+
+// highest register number used in code + 1
+INT32 GetRegisterCount(std::vector<Instruction> &code);
@@ -2,41 +2,59 @@
 #include "Parser/PackageParser.h"
 #include "Parser/Package.h"
 #include "Bytecode.h"
+#include "PeepholeOptimizer.h"
+#include "RegisterAllocator.h"
+#include "SSAFunction.h"
+#include "SSAOptimizer.h"
+#include "InstructionSelector.h"
+#include "Inliner.h"
 #include "Parser/Node.h"
 #include "Parser/PrimitiveTypes.h"
 
 #include <assert.h>
 
-void BytecodeGenerator::GenerateFunctionCall(std::list<Instruction> &instructions, INT32 returnRegister, Designator *designator, Function *function)
+void BytecodeGenerator::GenerateFunctionCall(std::list<Instruction> &instructions, INT32 returnRegister, Designator *designator, Function *function, bool tail)
 {
 
-  if(designator->expressions)
+  // a tail call always prepares parameter memory, even an empty one, so it always has a register to read
+  if(designator->expressions || tail)
   {
     INT32 sizeOfParams = designator->function->parameterSize;
     INT32 parameterRegister = GetAvailableRegister();
     instructions.emplace_back(OP_CallPrep, parameterRegister, sizeOfParams);
 
     INT32 currentOffset = 0;
-    for(Expression *expr : *designator->expressions)
+    if(designator->expressions)
     {
-      INT32 exprResult = GenerateExpression(instructions, expr, function);
-
-      switch(expr->returnTypeId)
+      for(Expression *expr : *designator->expressions)
       {
-      case TypeIdInteger:
-        instructions.emplace_back(OP_CopyData4ROR, parameterRegister, currentOffset, exprResult);
-        break;
-      case TypeIdBool:
-        instructions.emplace_back(OP_CopyData1ROR, parameterRegister, currentOffset, exprResult);
-        break;
-      default:
-        assert(0); // TODO: other types!
+        INT32 exprResult = GenerateExpression(instructions, expr, function);
+
+        switch(expr->returnTypeId)
+        {
+        case TypeIdInteger:
+          instructions.emplace_back(OP_CopyData4ROR, parameterRegister, currentOffset, exprResult);
+          break;
+        case TypeIdBool:
+          instructions.emplace_back(OP_CopyData1ROR, parameterRegister, currentOffset, exprResult);
+          break;
+        default:
+          assert(0); // TODO: other types!
+        }
+
+        currentOffset += function->package->GetSizeOf(expr->returnTypeId);
       }
+    }
 
-      currentOffset += function->package->GetSizeOf(expr->returnTypeId);
+    if(tail)
+    {
+      // nothing runs after a tail call, its parameter register is not cleared
+      instructions.emplace_back(OP_TailCall, designator->function->id, parameterRegister);
+      return;
     }
 
     instructions.emplace_back(OP_Call, designator->function->id, returnRegister, parameterRegister);
+    instructions.emplace_back(OP_CallUnprep, parameterRegister);
     DoneWithTheRegister(instructions, parameterRegister);
   }
   else
@@ -48,7 +66,8 @@ void BytecodeGenerator::GenerateFunctionCall(std::list<Instruction> &instruction
 BytecodeGenerator::BytecodeGenerator()
 {
   hasErrors = false;
-  maxRegisterNumber = 0;
+  registerLimit = RegisterAllocator::defaultRegisterLimit;
+  optimizationLevel = OL_Full;
 
   ReleaseAllRegisters();
 }
@@ -61,26 +80,14 @@ void BytecodeGenerator::Error(const std::string &msg)
 
 void BytecodeGenerator::DoneWithTheRegister(INT32 registerNumber)
 {
-  // register should not be available if we return it
-  if(availableRegisters.count(registerNumber))
-    assert(0);
-
-  // clear register
-  availableRegisters.insert(registerNumber);
+  // virtual registers are not reused, allocator reuses frame registers once their values are dead
 }
 
 void BytecodeGenerator::DoneWithTheRegister(std::list<Instruction> &instruction, INT32 registerNumber)
 {
-  // register should not be available if we return it
-  if(availableRegisters.count(registerNumber))
-    assert(0);
-
-  // clear register
-
-  // TODO: this clear can be optimized away. 
-  // If next writing operator uses a move on this register remove this 
+  // clear register. some instructions read a register before writing it and expect 0 (e.g. in loops)
+  // peephole optimizer removes the clear if nothing reads the register after it
   instruction.emplace_back(OP_ResetR, registerNumber);
-  availableRegisters.insert(registerNumber);
 }
 
 void BytecodeGenerator::DivideOperator(std::list<Instruction> &instructions, std::list<ExpressionValue> &values)
@@ -1031,6 +1038,15 @@ void BytecodeGenerator::GenerateBytecode(std::list<Instruction> &instructions, F
     {
       ReturnStatement *returnStatement = (ReturnStatement*)statement;
 
+      // returning the value of a call replaces this call with it, at every optimization level
+      Expression *expression = returnStatement->expression;
+      if(expression && expression->expressionValues.size() == 1 && expression->expressionValues[0].type == EVT_Designator &&
+        expression->expressionValues[0].stringValue->type == DT_FunctionCall)
+      {
+        GenerateFunctionCall(instructions, -1, expression->expressionValues[0].stringValue, function, true);
+        break;
+      }
+
       INT32 reg = -1;
       if(returnStatement->expression) // might not have an expression
       {
@@ -1047,16 +1063,16 @@ void BytecodeGenerator::GenerateBytecode(std::list<Instruction> &instructions, F
       instructions.emplace_back(OP_Return);
     }
     break;
+  case ST_YieldStatement:
+    instructions.emplace_back(OP_Yield);
+    break;
   case ST_IfStatement:
     {
       IfStatement *ifStatement = (IfStatement*)statement;
-      INT32 reg = GenerateExpression(instructions, ifStatement->expression, function);
 
-      instructions.emplace_back(OP_JumpbR, reg); // will complete parameters later
-      DoneWithTheRegister(reg);
-      auto &jumpIns = instructions.back();
+      // will complete jump offset later
+      Instruction &jumpIns = GenerateConditionJump(instructions, ifStatement->expression, function);
       size_t endOfExpressionPos = instructions.size() - 1;
-      jumpIns.param2 = 0; // don't jump over, just execute as usual
       GenerateBytecode(instructions, function, ifStatement->statement);
       // TODO: this should jump to next elif or else expression
       jumpIns.param3 = (INT32)(instructions.size() - endOfExpressionPos - 1); // end of statements 
@@ -1066,13 +1082,10 @@ void BytecodeGenerator::GenerateBytecode(std::list<Instruction> &instructions, F
     {
       WhileStatement *whileStatement = (WhileStatement*)statement;
       size_t whileExpressionPosition = instructions.size();
-      INT32 reg = GenerateExpression(instructions, whileStatement->expression, function);
 
-      instructions.emplace_back(OP_JumpbR, reg); // will complete parameters later
-      DoneWithTheRegister(reg);
-      auto &jumpIns = instructions.back();
+      // will complete jump offset later
+      Instruction &jumpIns = GenerateConditionJump(instructions, whileStatement->expression, function);
       size_t endOfExpressionPos = instructions.size() - 1;
-      jumpIns.param2 = 0;
       GenerateBytecode(instructions, function, whileStatement->statement);
 
       // jump to expression position
@@ -1093,8 +1106,10 @@ void BytecodeGenerator::GenerateFunction(Bytecode *bytecode, const std::string &
   // TODO: handle overloaded functions too!
   ReleaseAllRegisters();
   FunctionBytecode *functionBytecode = new FunctionBytecode();
-  bytecode->functionBytecodes[function->id] = functionBytecode;
+  functionBytecode->id = function->id;
+  bytecode->AddFunctionBytecode(functionBytecode);
   bytecode->globalFunctionNames[name] = function->id;
+  functionBytecode->parameterSize = function->parameterSize;
 
   functionBytecode->instructions.emplace_back(OP_AllocL, function->stackSize);
   auto allocPos = --functionBytecode->instructions.end();
@@ -1102,25 +1117,206 @@ void BytecodeGenerator::GenerateFunction(Bytecode *bytecode, const std::string &
   for(auto statement : function->block->statements)
     GenerateBytecode(functionBytecode->instructions, function, statement);
 
+  // frame must be popped even if function does not end with a return
+  functionBytecode->instructions.emplace_back(OP_DAllocL);
+  functionBytecode->instructions.emplace_back(OP_Return);
 
-  allocPos->param2 = maxRegisterNumber;
 
   // TODO: determine actual size of return value
   allocPos->param3 = 4;
 
-  maxRegisterNumber = 0;
+  functionBytecode->generatedInstructionCount = functionBytecode->instructions.size();
+
+  // optimized after every function is generated, so any of them can be inlined
+  generatedFunctions.emplace_back(function, functionBytecode);
+  if(optimizationLevel == OL_Full)
+    generatedInstructions[function->id] = functionBytecode->instructions;
+}
+
+void BytecodeGenerator::OptimizeFunctions()
+{
+  Inliner inliner(generatedInstructions);
+  for(auto &generated : generatedFunctions)
+    OptimizeFunction(generated.first, generated.second, inliner);
+
+  generatedFunctions.clear();
+  generatedInstructions.clear();
+}
+
+void BytecodeGenerator::OptimizeFunction(Function *function, FunctionBytecode *functionBytecode, Inliner &inliner, bool loopEntry)
+{
+  if(optimizationLevel == OL_Full)
+  {
+    // function is left as it is if it can't be written in SSA form
+    SSAFunction ssaFunction;
+    if(ssaFunction.Build(functionBytecode->instructions))
+    {
+      if(!loopEntry)
+        Inliner::RemoveSelfTailCalls(ssaFunction, function->id);
+      inliner.Inline(ssaFunction, function->id);
+
+      SSAOptimizer ssaOptimizer;
+      ssaOptimizer.Optimize(ssaFunction);
+
+      std::list<Instruction> selected;
+      InstructionSelector selector;
+      if(selector.Select(ssaFunction, selected))
+        functionBytecode->instructions.swap(selected);
+    }
+  }
+
+  PeepholeOptimizer optimizer;
+  if(optimizationLevel != OL_None)
+    optimizer.Optimize(functionBytecode->instructions);
+
+  RegisterAllocator allocator(registerLimit);
+  INT32 localsSize = function->stackSize;
+  INT32 registerCount = allocator.Allocate(functionBytecode->instructions, localsSize);
+
+  // AllocL is always the first instruction. it allocates p2 + 1 registers
+  Instruction &allocInstruction = functionBytecode->instructions.front();
+  allocInstruction.param1 = localsSize;
+  allocInstruction.param2 = registerCount > 0 ? registerCount - 1 : 0;
+
+  // values that ended up in the same register leave copies to itself behind
+  if(optimizationLevel != OL_None)
+    optimizer.Optimize(functionBytecode->instructions);
 
   functionBytecode->CompactInstructions();
 }
 
-INT32 BytecodeGenerator::GenerateExpression(std::list<Instruction> &instructions, Expression *expression, Function *function)
+bool BytecodeGenerator::GenerateCompareJump(std::list<Instruction> &instructions, bool jumpIfEqual, ExpressionValue &lefthand, ExpressionValue &righthand, Function *function)
+{
+  // operand kinds, ordered so the first operand of a fused jump has the higher kind
+  enum OperandKind { OK_Const, OK_Local, OK_Param, OK_Register, OK_Unsupported };
+
+  auto GetKind = [](ExpressionValue &value) -> OperandKind
+  {
+    if(value.type == EVT_ConstInt)
+      return OK_Const;
+    if(value.type == EVT_RegisterInt)
+      return OK_Register;
+    if(value.type == EVT_Designator && value.stringValue->typeId == TypeIdInteger)
+    {
+      if(value.stringValue->type == DT_LocalValue)
+        return OK_Local;
+      if(value.stringValue->type == DT_ParameterValue)
+        return OK_Param;
+      if(value.stringValue->type == DT_FunctionCall)
+        return OK_Register; // result of the call is put in a register first
+    }
+    return OK_Unsupported; // bools, objects
+  };
+
+  OperandKind leftKind = GetKind(lefthand);
+  OperandKind rightKind = GetKind(righthand);
+
+  // two constants are folded by EqualsOperator
+  if(leftKind == OK_Unsupported || rightKind == OK_Unsupported || (leftKind == OK_Const && rightKind == OK_Const))
+    return false;
+
+  auto GetOperand = [&](ExpressionValue &value) -> INT32
+  {
+    if(value.type == EVT_ConstInt || value.type == EVT_RegisterInt)
+      return value.intValue;
+    if(value.stringValue->type == DT_FunctionCall)
+    {
+      INT32 reg = GetAvailableRegister();
+      GenerateFunctionCall(instructions, reg, value.stringValue, function);
+      return reg;
+    }
+    return value.stringValue->address;
+  };
+
+  // keeps left to right evaluation order of function calls
+  INT32 leftOperand = GetOperand(lefthand);
+  INT32 rightOperand = GetOperand(righthand);
+
+  // comparison is symmetric, swap so the fused opcode exists
+  if(rightKind > leftKind)
+  {
+    std::swap(leftKind, rightKind);
+    std::swap(leftOperand, rightOperand);
+  }
+
+  static const OpCode jumpEqual[OK_Unsupported][OK_Unsupported] =
+  {
+    // right: const, local, param, register
+    { OP_NoOp, OP_NoOp, OP_NoOp, OP_NoOp }, // left const
+    { OP_JumpEqiLC, OP_JumpEqiLL, OP_NoOp, OP_NoOp }, // left local
+    { OP_JumpEqiPC, OP_JumpEqiPL, OP_JumpEqiPP, OP_NoOp }, // left param
+    { OP_JumpEqiRC, OP_JumpEqiRL, OP_JumpEqiRP, OP_JumpEqiRR } // left register
+  };
+
+  static const OpCode jumpNotEqual[OK_Unsupported][OK_Unsupported] =
+  {
+    { OP_NoOp, OP_NoOp, OP_NoOp, OP_NoOp },
+    { OP_JumpNeiLC, OP_JumpNeiLL, OP_NoOp, OP_NoOp },
+    { OP_JumpNeiPC, OP_JumpNeiPL, OP_JumpNeiPP, OP_NoOp },
+    { OP_JumpNeiRC, OP_JumpNeiRL, OP_JumpNeiRP, OP_JumpNeiRR }
+  };
+
+  OpCode opCode = jumpIfEqual ? jumpEqual[leftKind][rightKind] : jumpNotEqual[leftKind][rightKind];
+  assert(opCode != OP_NoOp);
+
+  instructions.emplace_back(opCode, leftOperand, rightOperand); // offset is set by the caller
+
+  // jump does not clear registers it reads, just give them back
+  if(leftKind == OK_Register)
+    DoneWithTheRegister(leftOperand);
+  if(rightKind == OK_Register)
+    DoneWithTheRegister(rightOperand);
+
+  return true;
+}
+
+Instruction &BytecodeGenerator::GenerateConditionJump(std::list<Instruction> &instructions, Expression *expression, Function *function)
 {
   std::list<ExpressionValue> executionStack;
 
   auto &expressionValues = expression->expressionValues;
-
   size_t size = expressionValues.size();
-  for( size_t i = 0; i < size; ++i )
+
+  ExpressionValueType lastType = size ? expressionValues[size - 1].type : EVT_Unknown;
+
+  if(lastType == EVT_EqualsOperator || lastType == EVT_NotEqualOperator)
+  {
+    // evaluate both sides of the comparison, then try to compare and jump in one instruction
+    EvaluateExpressionValues(instructions, expressionValues, 0, size - 1, executionStack);
+
+    ExpressionValue righthand = executionStack.back(); executionStack.pop_back();
+    ExpressionValue lefthand = executionStack.back(); executionStack.pop_back();
+
+    // jump over when the condition is false
+    if(GenerateCompareJump(instructions, lastType == EVT_NotEqualOperator, lefthand, righthand, function))
+      return instructions.back();
+
+    executionStack.push_back(lefthand);
+    executionStack.push_back(righthand);
+    EvaluateExpressionValues(instructions, expressionValues, size - 1, size, executionStack);
+  }
+  else
+    EvaluateExpressionValues(instructions, expressionValues, 0, size, executionStack);
+
+  INT32 reg = MoveExpressionResultToRegister(instructions, executionStack, function);
+
+  instructions.emplace_back(OP_JumpbR, reg, 0); // don't jump over if true, just execute as usual
+  DoneWithTheRegister(reg);
+  return instructions.back();
+}
+
+INT32 BytecodeGenerator::GenerateExpression(std::list<Instruction> &instructions, Expression *expression, Function *function)
+{
+  std::list<ExpressionValue> executionStack;
+
+  EvaluateExpressionValues(instructions, expression->expressionValues, 0, expression->expressionValues.size(), executionStack);
+
+  return MoveExpressionResultToRegister(instructions, executionStack, function);
+}
+
+void BytecodeGenerator::EvaluateExpressionValues(std::list<Instruction> &instructions, std::vector<ExpressionValue> &expressionValues, size_t begin, size_t end, std::list<ExpressionValue> &executionStack)
+{
+  for( size_t i = begin; i < end; ++i )
   {
 
     bool isOperator = false;
@@ -1173,7 +1369,10 @@ INT32 BytecodeGenerator::GenerateExpression(std::list<Instruction> &instructions
     }
 
   }
+}
 
+INT32 BytecodeGenerator::MoveExpressionResultToRegister(std::list<Instruction> &instructions, std::list<ExpressionValue> &executionStack, Function *function)
+{
   INT32 returnRegister = GetAvailableRegister();
   // if only one single value then move it temp
   if(executionStack.size() == 1)
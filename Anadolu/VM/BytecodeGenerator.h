@@ -2,10 +2,10 @@
 
 
 #include "Parser/PrimitiveTypes.h"
+#include "Instruction.h"
 
 #include <vector>
 #include <list>
-#include <set>
 #include <unordered_map>
 #include <string>
 
@@ -18,52 +18,60 @@ class Package;
 class Bytecode;
 class Function;
 class PackageParser;
-class Instruction;
+class FunctionBytecode;
+class Inliner;
 class Statement;
 class Expression;
 class ExpressionValue;
 class Designator;
 
+// how much work is done on instructions of a function after they are generated
+enum OptimizationLevel
+{
+  OL_None, // registers are allocated, nothing else
+  OL_Peephole, // peephole optimizer before and after register allocation
+  OL_Full // SSA form optimizations, then the same as OL_Peephole
+};
+
 class BytecodeGenerator
 {
 public:
 
-  // currently unused registers
-  // used set to always get lowest register number from the front
-  std::set<INT32> availableRegisters;
   std::function<void(const std::string &msg, INT row, INT column, INT messageLevel)> outputFunction;
   std::unordered_map<std::string, Package*> packages;
   
 
   Bytecode *bytecode;
 
-  // used to find how many registers are need for a function
-  INT32 maxRegisterNumber;
+  // registers are virtual while generating, every new value gets a new one.
+  // RegisterAllocator maps them to frame registers when the function is done
+  INT32 virtualRegisterCount;
+
+  // most registers a function frame can have, values beyond this are spilled to locals
+  INT32 registerLimit;
+
+  OptimizationLevel optimizationLevel;
 
   bool hasErrors;
 
+  // functions generated but not optimized yet
+  std::vector<std::pair<Function*, FunctionBytecode*>> generatedFunctions;
+
+  // instructions of each function as they were generated, by function id. inliner copies callees from these
+  std::unordered_map<INT32, std::list<Instruction>> generatedInstructions;
+
   BytecodeGenerator();
 
   void Error(const std::string &msg);
 
   void ReleaseAllRegisters()
   {
-    availableRegisters.clear();
-
-    // TODO: remove magic number, make available registers extendable
-    for(INT32 i = 0; i < 256; ++i)
-      availableRegisters.insert(i);
+    virtualRegisterCount = 0;
   }
 
   INT32 GetAvailableRegister()
   {
-    INT32 r =  *availableRegisters.begin();
-
-    if(r > maxRegisterNumber)
-      maxRegisterNumber = r;
-
-    availableRegisters.erase(availableRegisters.begin());
-    return r;
+    return virtualRegisterCount++;
   }
 
   // this version does not place ResetR instruction
@@ -88,9 +96,30 @@ public:
 
   INT32 GenerateExpression(std::list<Instruction> &instructions, Expression *expression, Function *function);
 
-  void GenerateFunctionCall(std::list<Instruction> &instructions, INT32 returnRegister, Designator *expression, Function *function);
+  // runs expression values [begin, end) on the execution stack, generating instructions for operators
+  void EvaluateExpressionValues(std::list<Instruction> &instructions, std::vector<ExpressionValue> &expressionValues, size_t begin, size_t end, std::list<ExpressionValue> &executionStack);
+
+  // moves the single value left on the execution stack to a new register
+  INT32 MoveExpressionResultToRegister(std::list<Instruction> &instructions, std::list<ExpressionValue> &executionStack, Function *function);
+
+  // generates a jump that is taken when the expression is false, returns it.
+  // caller sets param3 to number of instructions to be jumped over
+  Instruction &GenerateConditionJump(std::list<Instruction> &instructions, Expression *expression, Function *function);
+
+  // emits a fused compare-and-jump for two INT operands. returns false if there is no fused form
+  bool GenerateCompareJump(std::list<Instruction> &instructions, bool jumpIfEqual, ExpressionValue &lefthand, ExpressionValue &righthand, Function *function);
 
+  // tail: the call is the value returned, it is generated as OP_TailCall and returnRegister is not used
+  void GenerateFunctionCall(std::list<Instruction> &instructions, INT32 returnRegister, Designator *expression, Function *function, bool tail = false);
+
+  // instructions are optimized later by OptimizeFunctions
   void GenerateFunction(Bytecode *bytecode, const std::string &name,  Function *function);
 
+  // optimizes and allocates registers of every function generated so far
+  void OptimizeFunctions();
+
+  // loopEntry: bytecode starts in a loop of the function for a call already running, calls to itself stay calls
+  void OptimizeFunction(Function *function, FunctionBytecode *functionBytecode, Inliner &inliner, bool loopEntry = false);
+
 
 };
\ No newline at end of file
@@ -0,0 +1,53 @@
+#include "ExecutableMemory.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+void ExecutableMemory::Free()
+{
+  if(!memory)
+    return;
+
+#ifdef _WIN32
+  VirtualFree(memory, 0, MEM_RELEASE);
+#else
+  munmap(memory, size);
+#endif
+
+  memory = nullptr;
+  size = 0;
+}
+
+char *ExecutableMemory::Allocate(size_t _size)
+{
+  Free();
+
+#ifdef _WIN32
+  memory = (char*)VirtualAlloc(nullptr, _size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+  void *pages = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  memory = pages == MAP_FAILED ? nullptr : (char*)pages;
+#endif
+
+  size = memory ? _size : 0;
+  return memory;
+}
+
+bool ExecutableMemory::MakeExecutable()
+{
+  if(!memory)
+    return false;
+
+#ifdef _WIN32
+  DWORD oldProtection;
+  if(!VirtualProtect(memory, size, PAGE_EXECUTE_READ, &oldProtection))
+    return false;
+  FlushInstructionCache(GetCurrentProcess(), memory, size);
+  return true;
+#else
+  return mprotect(memory, size, PROT_READ | PROT_EXEC) == 0;
+#endif
+}
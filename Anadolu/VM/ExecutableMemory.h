@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stddef.h>
+
+// Memory native code is written to and run from.
+// It is writable until MakeExecutable is called, then it can only be read and executed
+class ExecutableMemory
+{
+private:
+
+  char *memory;
+  size_t size;
+
+  void Free();
+
+public:
+
+  ExecutableMemory() : memory(nullptr), size(0) { }
+
+  ~ExecutableMemory() { Free(); }
+
+  // only one object owns the memory, a moved one is left empty
+  ExecutableMemory(const ExecutableMemory&) = delete;
+  ExecutableMemory &operator=(const ExecutableMemory&) = delete;
+
+  ExecutableMemory(ExecutableMemory &&other) : memory(other.memory), size(other.size)
+  {
+    other.memory = nullptr;
+    other.size = 0;
+  }
+
+  ExecutableMemory &operator=(ExecutableMemory &&other)
+  {
+    if(this != &other)
+    {
+      Free();
+      memory = other.memory;
+      size = other.size;
+      other.memory = nullptr;
+      other.size = 0;
+    }
+    return *this;
+  }
+
+  // frees the previous memory. returns null if memory can't be allocated
+  char *Allocate(size_t _size);
+
+  bool MakeExecutable();
+
+  inline char *GetMemory() { return memory; }
+
+};
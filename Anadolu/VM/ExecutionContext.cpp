@@ -1,30 +1,164 @@
 #include "ExecutionContext.h"
 #include "Parser/Package.h"
 #include "Bytecode.h"
+#include "FrameStack.h"
+#include "TieredCompiler.h"
+#include "InstructionInfo.h"
 
 #include <assert.h>
 #include <iostream>
+#include <cstring>
+#include <atomic>
+#include <mutex>
 
-#define RegisterAsINT32(i) *((INT32*)(registers + i) )
-#define RegisterAsINT32(i) *((INT32*)(registers + i) )
-#define RegisterAsINT32(i) *((INT32*)(registers + i) )
-#define RegisterAsChar(i) *((char*)(registers + i) )
-
-#define LocalAsInt32(i) *( (INT32*) (locals + i) )
-#define LocalAsChar(i) *( (char*)(locals + i) ) 
+// locals and registers are slots of the frame, instructions are decoded with their byte offsets
+#define FrameAsInt32(i) *((INT32*)(frame + i))
+#define FrameAsChar(i) *((char*)(frame + i))
+#define FrameAsINT(i) *((INT*)(frame + i))
 
 #define ParamAsInt32(i) *((INT32*)(params + i))
 #define ParamAsChar(i) *((char*)(params + i))
 
-ExecutionContext::ExecutionContext(Bytecode *_bytecode, FunctionBytecode *_functionBytecode) 
+// every handler ends with VM_NEXT. VM_DISPATCH executes current instruction, used after changing functions
+// threaded dispatch jumps straight to the next handler, switch dispatch goes back to the loop
+#ifdef ANADOLU_THREADED_DISPATCH
+#define VM_CASE(op) L_##op
+#define VM_LABEL(op) dispatchTable[op] = &&L_##op
+#define VM_UNHANDLED &&L_Unhandled
+#define VM_NEXT goto *(++instruction)->handler
+#define VM_DISPATCH goto *instruction->handler
+#else
+#define VM_CASE(op) case op
+#define VM_LABEL(op) dispatchTable[op] = op
+#define VM_UNHANDLED OP_NumOfOpCodes
+#define VM_NEXT break
+#define VM_DISPATCH continue
+#endif
+#define VM_CODE(function) (function)->decodedInstructions.data()
+#define VM_QUICKEN(op) functionBytecode->Quicken(instruction - VM_CODE(functionBytecode), op, dispatchTable)
+
+// budget is counted only where execution can go on without end, at jumps going back and at entering functions
+#define VM_JUMP(offset) { INT32 jumpOffset = (offset); instruction += jumpOffset; \
+  if(jumpOffset < 0 && --budgetLeft == 0) { ++instruction; executionStatus = Preempted; goto suspend; } }
+#define VM_ENTER { if(--budgetLeft == 0) { executionStatus = Preempted; goto suspend; } VM_DISPATCH; }
+
+// tiering up in a slice of a coroutine with a budget would make the slice as long as the compilation. the coroutine
+// is preempted before the instruction crossing the threshold instead, it runs again once the function is compiled
+#define VM_DEFER(function, jumpIndex, counter) if(budgetLeft > 0 && !tieredCompiler->IsCompiled(function, jumpIndex)) \
+  { --(function)->counter; deferredFunction = (function); deferredJump = (jumpIndex); executionStatus = Preempted; goto suspend; }
+
+// state of a caller while the function it called is running
+// pushed on the frame stack, below the frame of the called function
+class CallFrame
+{
+public:
+
+  CallFrame *previous;
+  FunctionBytecode *functionBytecode;
+  const DecodedInstruction *returnInstruction;
+
+  char *params;
+  char *frame;
+  char *frameBase;
+  char *returnValue;
+
+};
+
+// handler of each opcode, its label address with threaded dispatch or the opcode of its case.
+// filled by the first execution on any thread, never changed after that
+static DispatchTarget dispatchTable[OP_NumOfOpCodes];
+static std::atomic<bool> dispatchTableReady(false);
+static std::mutex dispatchTableMutex;
+
+// locals and registers are both frame slots, opcodes that only differ in that can share a handler
+static bool HaveSameFrameOperands(OpCode a, OpCode b)
+{
+  auto Kind = [](OperandType type) { return type == OT_Local ? OT_Register : type; };
+
+  for(INT32 p = 0; p < 3; ++p)
+  {
+    const OperandInfo &x = GetInstructionInfo(a).operands[p];
+    const OperandInfo &y = GetInstructionInfo(b).operands[p];
+    if(Kind(x.type) != Kind(y.type) || x.access != y.access || x.width != y.width)
+      return false;
+  }
+  return true;
+}
+
+// opcodes run by the handler of another opcode
+static const OpCode sharedHandlers[][2] =
+{
+  { OP_JumpEqiLC, OP_JumpEqiRC },
+  { OP_JumpEqiLL, OP_JumpEqiRR },
+  { OP_JumpEqiRL, OP_JumpEqiRR },
+  { OP_JumpNeiLC, OP_JumpNeiRC },
+  { OP_JumpNeiLL, OP_JumpNeiRR },
+  { OP_JumpNeiRL, OP_JumpNeiRR },
+  { OP_IncJumpNeiLC, OP_IncJumpNeiRC },
+  { OP_CopyiLP, OP_CopyiRP },
+  { OP_CopybLP, OP_CopybRP },
+  { OP_CopyiPL, OP_CopyiPR },
+  { OP_CopybPL, OP_CopybPR },
+  { OP_CopyiRL, OP_CopyiRR },
+  { OP_CopyiLR, OP_CopyiRR },
+  { OP_CopybLR, OP_CopybRR },
+  { OP_CopybRL, OP_CopybRR },
+  { OP_ReloadRL, OP_SpillLR },
+  { OP_DiviRLR, OP_DiviRRR },
+  { OP_DiviRRL, OP_DiviRRR },
+  { OP_DiviRLL, OP_DiviRRR },
+  { OP_DiviRLC, OP_DiviRRC },
+  { OP_DiviRCL, OP_DiviRCR },
+  { OP_DiviLP, OP_DiviRP },
+  { OP_DiviPL, OP_DiviPR },
+  { OP_DiviRPL, OP_DiviRPR },
+  { OP_DiviRLP, OP_DiviRRP },
+  { OP_MuliLP, OP_MuliRP },
+  { OP_MuliRPL, OP_MuliRPR },
+  { OP_MuliRL, OP_MuliRR },
+  { OP_MuliLC, OP_MuliRC },
+  { OP_AddiRPL, OP_AddiRPR },
+  { OP_AddiRL, OP_AddiRR },
+  { OP_AddiRLR, OP_AddiRRR },
+  { OP_AddiRLL, OP_AddiRRR },
+  { OP_AddiRLC, OP_AddiRRC },
+  { OP_AddiLR, OP_AddiRR },
+  { OP_AddiLC, OP_AddiRC },
+  { OP_SubiRLP, OP_SubiRRP },
+  { OP_SubiRPL, OP_SubiRPR },
+  { OP_SubiRLL, OP_SubiRRR },
+  { OP_SubiRCL, OP_SubiRCR },
+  { OP_SubiRLC, OP_SubiRRC },
+  { OP_SubiRLR, OP_SubiRRR },
+  { OP_SubiRRL, OP_SubiRRR },
+  { OP_SubiRL, OP_SubiRR },
+  { OP_SubiLR, OP_SubiRR },
+  { OP_CmpbRPL, OP_CmpbRPR },
+  { OP_CmpbRLL, OP_CmpbRRR },
+  { OP_CmpbRLR, OP_CmpbRRR },
+  { OP_CmpiRPL, OP_CmpiRPR },
+  { OP_CmpiRLL, OP_CmpiRRR },
+  { OP_CmpiRLR, OP_CmpiRRR },
+};
+
+ExecutionContext::ExecutionContext(Bytecode *_bytecode, FunctionBytecode *_functionBytecode, FrameStack *_frameStack, bool _coroutine) 
   : functionBytecode(_functionBytecode),
-  instructions(&_functionBytecode->optimizedInstructions), 
   thisValue(nullptr), 
   params(nullptr),
   returnValue(nullptr), 
-  locals(nullptr),
+  frameBase(nullptr),
   bytecode(_bytecode),
-  registers(nullptr),
+  frameStack(_frameStack ? _frameStack : FrameStack::GetThreadFrameStack()),
+  callFrame(nullptr),
+  callDepth(0),
+  maxCallDepth(defaultMaxCallDepth),
+  // native code is never entered by coroutines, as if the machine stack was full
+  nativeDepth(_coroutine ? maxNativeDepth : 0),
+  coroutine(_coroutine),
+  budget(0),
+  resumeInstruction(nullptr),
+  deferredFunction(nullptr),
+  deferredJump(-1),
   executionStatus(NotPrepared)
 {
 
@@ -32,7 +166,19 @@ ExecutionContext::ExecutionContext(Bytecode *_bytecode, FunctionBytecode *_funct
 
 ExecutionContext::~ExecutionContext()
 {
+  DropSuspended();
+}
 
+void ExecutionContext::Reset(FunctionBytecode *_functionBytecode)
+{
+  DropSuspended();
+  functionBytecode = _functionBytecode;
+  params = nullptr;
+  frameBase = nullptr;
+  callFrame = nullptr;
+  callDepth = 0;
+  nativeDepth = coroutine ? maxNativeDepth : 0;
+  executionStatus = NotPrepared;
 }
 
 void ExecutionContext::CreateReturnMemory() { returnValue = new char[functionBytecode->optimizedInstructions[0].param3]; }
@@ -42,580 +188,896 @@ void ExecutionContext::SetParameter(char *data)
   params = data;
 }
 
+void ExecutionContext::Unwind(char *stackBase)
+{
+  // outermost call frame holds the state of the entry function
+  if(callFrame)
+  {
+    while(callFrame->previous)
+      callFrame = callFrame->previous;
+
+    functionBytecode = callFrame->functionBytecode;
+    frameBase = callFrame->frameBase;
+    returnValue = callFrame->returnValue;
+    callFrame = nullptr;
+  }
+
+  callDepth = 0;
+  frameStack->Pop(stackBase);
+}
+
+void ExecutionContext::DropSuspended()
+{
+  if(!resumeInstruction)
+    return;
+
+  Unwind(resumeStackBase);
+  functionBytecode = resumeEntryFunction;
+  resumeInstruction = nullptr;
+  deferredFunction = nullptr;
+}
+
+ExecutionContext::ExecutionStatus ExecutionContext::RunNative(FunctionBytecode *function, char *callParams, char *callReturnValue)
+{
+  ++nativeDepth;
+  INT32 status = function->nativeCode(this, callParams, callReturnValue);
+  --nativeDepth;
+  return (ExecutionStatus)status;
+}
+
+INT32 ExecutionContext::CallInterpreted(ExecutionContext *caller, INT32 functionId, char *callParams, char *callReturnValue)
+{
+  FunctionBytecode *callee = caller->bytecode->functionBytecodes[functionId];
+  TieredCompiler *tieredCompiler = caller->bytecode->tieredCompiler;
+  if(tieredCompiler && ++callee->callCount == tieredCompiler->callThreshold)
+    callee = tieredCompiler->TierUp(callee);
+
+  ExecutionContext context(caller->bytecode, callee, caller->frameStack);
+  context.params = callParams;
+  context.returnValue = callReturnValue;
+  context.callDepth = caller->callDepth;
+  context.maxCallDepth = caller->maxCallDepth;
+  context.nativeDepth = caller->nativeDepth + 1;
+  context.Execute();
+  return context.executionStatus;
+}
+
+void ExecutionContext::PrepareBytecode(Bytecode *bytecode)
+{
+  // running without a function only fills the dispatch table
+  ExecutionContext context(bytecode, nullptr);
+  context.ExecuteInstructions();
+
+  for(auto function : bytecode->functionBytecodes)
+  {
+    if(!function)
+      continue;
+
+    if(function->decodedInstructions.empty())
+      function->Predecode(dispatchTable);
+
+    // callees of untiered bytecode are never replaced, calls are quickened before anything runs
+    if(bytecode->tieredCompiler)
+      continue;
+
+    for(INT i = 0; i < (INT)function->decodedInstructions.size(); ++i)
+    {
+      Instruction &instruction = function->optimizedInstructions[function->instructionIndices[i]];
+      if(instruction.opCode != OP_Call)
+        continue;
+
+      FunctionBytecode *callee = bytecode->functionBytecodes[instruction.param1];
+      function->Quicken(i, callee->nativeCode ? OP_CallNative : OP_CallInterpreted, dispatchTable);
+    }
+  }
+}
+
 void ExecutionContext::ExecuteInstructions()
 {
-  INT size = instructions->size();
-  for(INT i = 0; i < size; ++i)
+  if(!dispatchTableReady.load(std::memory_order_acquire))
   {
-    Instruction &instruction = (*instructions)[i];
-    switch (instruction.opCode)
+    std::lock_guard<std::mutex> lock(dispatchTableMutex);
+    // another thread may have filled it while this one waited
+    if(!dispatchTableReady.load(std::memory_order_relaxed))
     {
-    case OP_DAllocL:
-      delete[] locals;
-      delete[] registers;
-      delete[] params;
-
-      break;
-    case OP_AllocL:
-      // alloc locals memory
-      if(instruction.param1)
+      for(INT j = 0; j < OP_NumOfOpCodes; ++j)
+        dispatchTable[j] = VM_UNHANDLED;
+
+      VM_LABEL(OP_DAllocL);
+      VM_LABEL(OP_AllocL);
+      VM_LABEL(OP_ResetR);
+      VM_LABEL(OP_CopyData4ROR);
+      VM_LABEL(OP_CopyData1ROR);
+      VM_LABEL(OP_CallPrep);
+      VM_LABEL(OP_Call);
+      VM_LABEL(OP_TailCall);
+      VM_LABEL(OP_CallNative);
+      VM_LABEL(OP_CallInterpreted);
+      VM_LABEL(OP_JumpbR);
+      VM_LABEL(OP_Jump);
+      VM_LABEL(OP_JumpEqiPC);
+      VM_LABEL(OP_JumpEqiRC);
+      VM_LABEL(OP_JumpEqiPL);
+      VM_LABEL(OP_JumpEqiPP);
+      VM_LABEL(OP_JumpEqiRR);
+      VM_LABEL(OP_JumpEqiRP);
+      VM_LABEL(OP_JumpNeiPC);
+      VM_LABEL(OP_JumpNeiRC);
+      VM_LABEL(OP_JumpNeiPL);
+      VM_LABEL(OP_JumpNeiPP);
+      VM_LABEL(OP_JumpNeiRR);
+      VM_LABEL(OP_JumpNeiRP);
+      VM_LABEL(OP_IncJumpNeiRC);
+      VM_LABEL(OP_NotbRR);
+      VM_LABEL(OP_DiviRP);
+      VM_LABEL(OP_DiviPP);
+      VM_LABEL(OP_DiviPC);
+      VM_LABEL(OP_DiviPR);
+      VM_LABEL(OP_DiviRPC);
+      VM_LABEL(OP_DiviRPP);
+      VM_LABEL(OP_DiviRPR);
+      VM_LABEL(OP_DiviRCP);
+      VM_LABEL(OP_DiviRRP);
+      VM_LABEL(OP_DiviRRC);
+      VM_LABEL(OP_DiviRCR);
+      VM_LABEL(OP_DiviRRR);
+      VM_LABEL(OP_MuliPC);
+      VM_LABEL(OP_MuliRP);
+      VM_LABEL(OP_MuliRPR);
+      VM_LABEL(OP_MuliRPC);
+      VM_LABEL(OP_MuliRPP);
+      VM_LABEL(OP_MuliRR);
+      VM_LABEL(OP_MuliRLL);
+      VM_LABEL(OP_MuliRLC);
+      VM_LABEL(OP_MuliRC);
+      VM_LABEL(OP_AddiPR);
+      VM_LABEL(OP_AddiPC);
+      VM_LABEL(OP_AddiRP);
+      VM_LABEL(OP_AddiRPR);
+      VM_LABEL(OP_AddiRPC);
+      VM_LABEL(OP_AddiRPP);
+      VM_LABEL(OP_AddiRRR);
+      VM_LABEL(OP_AddiRRC);
+      VM_LABEL(OP_AddiRR);
+      VM_LABEL(OP_AddiRC);
+      VM_LABEL(OP_SubiRP);
+      VM_LABEL(OP_SubiPP);
+      VM_LABEL(OP_SubiPC);
+      VM_LABEL(OP_SubiPL);
+      VM_LABEL(OP_SubiRRP);
+      VM_LABEL(OP_SubiRPR);
+      VM_LABEL(OP_SubiRPC);
+      VM_LABEL(OP_SubiRCP);
+      VM_LABEL(OP_SubiRPP);
+      VM_LABEL(OP_SubiRRR);
+      VM_LABEL(OP_SubiRCR);
+      VM_LABEL(OP_SubiRRC);
+      VM_LABEL(OP_SubiRC);
+      VM_LABEL(OP_SubiRR);
+      VM_LABEL(OP_CopybRP);
+      VM_LABEL(OP_CopybPR);
+      VM_LABEL(OP_CopyiRP);
+      VM_LABEL(OP_CopyiPR);
+      VM_LABEL(OP_CopyiRC);
+      VM_LABEL(OP_CopyiRR);
+      VM_LABEL(OP_CopyiXR);
+      VM_LABEL(OP_CopybRR);
+      VM_LABEL(OP_CopybRC);
+      VM_LABEL(OP_SpillLR);
+      VM_LABEL(OP_CmpbRPP);
+      VM_LABEL(OP_CmpbRPR);
+      VM_LABEL(OP_CmpbRPC);
+      VM_LABEL(OP_CmpiRPP);
+      VM_LABEL(OP_CmpiRPR);
+      VM_LABEL(OP_CmpiRPC);
+      VM_LABEL(OP_CmpbRC);
+      VM_LABEL(OP_CmpbRRR);
+      VM_LABEL(OP_CmpbRLC);
+      VM_LABEL(OP_CmpbRCR);
+      VM_LABEL(OP_CmpiRLC);
+      VM_LABEL(OP_CmpiRRR);
+      VM_LABEL(OP_CmpiRCR);
+      VM_LABEL(OP_Return);
+      VM_LABEL(OP_Yield);
+      VM_LABEL(OP_BStart);
+      VM_LABEL(OP_BEnd);
+
+
+      for(auto &shared : sharedHandlers)
       {
-        locals = new char[instruction.param1];
-        for(INT j = 0; j< instruction.param1; ++j )
-          locals[j] = 0;
+        assert(dispatchTable[shared[0]] == VM_UNHANDLED && HaveSameFrameOperands(shared[0], shared[1]));
+        dispatchTable[shared[0]] = dispatchTable[shared[1]];
       }
 
-      // alloc registers memory
-      // allocates at least 1 register (r0)
-      registers = new INT[instruction.param2 + 1];
-      for(INT j = 0; j < instruction.param2 + 1; ++j)
-        registers[j] = 0;
-
-      break;
-    case OP_ResetR:
-      RegisterAsINT32(instruction.param1) = 0;
-      break;
-
-    case OP_CopyData4ROR:
-      memcpy((char*)(registers[instruction.param1]) + instruction.param2, registers + instruction.param3, 4);
-      break;
-    case OP_CopyData1ROR:
-      memcpy((char*)(registers[instruction.param1]) + instruction.param2, registers + instruction.param3, 1);
-      break;
-    case OP_CallPrep:
-      registers[instruction.param1] = (INT)malloc(8);
-      break;
-
-    case OP_Call:
+      dispatchTableReady.store(true, std::memory_order_release);
+    }
+  }
+
+  if(!functionBytecode)
+    return;
+
+  // a suspended coroutine continues after its yield, with the state it saved there
+  bool resuming = resumeInstruction != nullptr;
+
+  if(functionBytecode->decodedInstructions.empty())
+    functionBytecode->Predecode(dispatchTable);
+
+  // marks the frame stack position before this execution, to unwind on errors
+  char *stackBase = resuming ? resumeStackBase : frameStack->Push(0);
+  if(!resuming)
+    frameBase = stackBase;
+
+  // compiled functions run on the machine stack, calls they make don't come back to this loop
+  if(functionBytecode->nativeCode && nativeDepth < maxNativeDepth)
+  {
+    executionStatus = RunNative(functionBytecode, params, returnValue);
+    if(executionStatus != Returned)
+      Unwind(stackBase);
+    return;
+  }
+
+  // counts calls and loops of functions while they are tiered, null otherwise
+  TieredCompiler *tieredCompiler = bytecode->tieredCompiler;
+
+  // a tail call can replace the entry function, it is restored when returning
+  FunctionBytecode *entryFunction = resuming ? resumeEntryFunction : functionBytecode;
+
+  const DecodedInstruction *instruction = resuming ? resumeInstruction : VM_CODE(functionBytecode);
+
+  // state of the running function is kept here, not in the context, so it can stay in machine registers.
+  // frame is the locals and then the registers, from one base
+  char *params = resuming ? resumeParams : this->params;
+  char *frame = resuming ? resumeFrame : nullptr;
+  resumeInstruction = nullptr;
+
+  // function of the call instruction being executed
+  FunctionBytecode *callee = nullptr;
+
+  // back-edges and calls left before a coroutine is preempted. other contexts start below zero and never reach it
+  INT64 budgetLeft = coroutine && budget > 0 ? budget : -1;
+
+  for(;;)
+  {
+#ifdef ANADOLU_THREADED_DISPATCH
+    VM_DISPATCH;
+    {
+#else
+    switch (instruction->handler)
+    {
+#endif
+    VM_CASE(OP_DAllocL):
+      frameStack->Pop(frame);
+      VM_NEXT;
+    VM_CASE(OP_AllocL):
+      // decoded with the size of the frame and the size of its locals and registers, call memory isn't cleared
+      frame = frameStack->Push(instruction->param1);
+      memset(frame, 0, instruction->param2);
+      VM_NEXT;
+    VM_CASE(OP_ResetR):
+      FrameAsInt32(instruction->param1) = 0;
+      VM_NEXT;
+
+    VM_CASE(OP_CopyData4ROR):
+      memcpy((char*)(FrameAsINT(instruction->param1)) + instruction->param2, frame + instruction->param3, 4);
+      VM_NEXT;
+    VM_CASE(OP_CopyData1ROR):
+      memcpy((char*)(FrameAsINT(instruction->param1)) + instruction->param2, frame + instruction->param3, 1);
+      VM_NEXT;
+    // call memory is in the frame, decoded with its offset
+    VM_CASE(OP_CallPrep):
+      FrameAsINT(instruction->param1) = (INT)(frame + instruction->param2);
+      VM_NEXT;
+
+    VM_CASE(OP_Call):
+    genericCall:
+      if(callDepth == maxCallDepth)
       {
-        ExecutionContext exc(bytecode, bytecode->functionBytecodes[instruction.param1]);
-        exc.returnValue = (char*)(registers + instruction.param2);
-        exc.params = (char*)(*((INT**)(registers + instruction.param3)));
-        exc.Execute();
+        Unwind(stackBase);
+        executionStatus = CallDepthExceeded;
+        return;
       }
-      break;
 
-    case OP_JumpbR:
-      if( RegisterAsChar(instruction.param1) == 1)
-        i += (INT32)instruction.param2; // its true jump ahead by the given amount
-      else
-        i += (INT32)instruction.param3; // its true jump ahead by the given amount
-      RegisterAsINT32(instruction.param1) = 0;
-      break;
-    case OP_Jump:
-      i += (INT32)instruction.param1;
-      break;
-
-    case OP_NotbRR:
-      RegisterAsChar(instruction.param1) = !RegisterAsChar(instruction.param2);
-      break;
-
-    case OP_DiviRP:
-      if(ParamAsInt32(instruction.param2) != 0)
-        RegisterAsINT32(instruction.param1) /= ParamAsInt32(instruction.param2);
-      else
-        RegisterAsINT32(instruction.param1) = 0;
-      break;
-    case OP_DiviLP:
-      if(ParamAsInt32(instruction.param2) != 0)
-        LocalAsInt32(instruction.param1) /= ParamAsInt32(instruction.param2);
-      else
-        LocalAsInt32(instruction.param1) = 0;
-      break;
-    case OP_DiviPP:
-      if(ParamAsInt32(instruction.param2) != 0)
-        ParamAsInt32(instruction.param1) /= ParamAsInt32(instruction.param2);
-      else
-        ParamAsInt32(instruction.param1) = 0;
-      break;
-    case OP_DiviPC:
-      if(instruction.param2 != 0)
-        ParamAsInt32(instruction.param1) /= instruction.param2;
-      else
-        ParamAsInt32(instruction.param1) = 0;
-      break;
-    case OP_DiviPR:
-      if( RegisterAsINT32(instruction.param2) != 0)
-        ParamAsInt32(instruction.param1) /= RegisterAsINT32(instruction.param2);
+      callee = bytecode->functionBytecodes[instruction->param1];
+      if(tieredCompiler && ++callee->callCount == tieredCompiler->callThreshold)
+      {
+        VM_DEFER(callee, -1, callCount);
+        callee = tieredCompiler->TierUp(callee);
+      }
+
+      // a function that won't be replaced any more is called the same way every time, the call doesn't check again
+      if(!tieredCompiler || callee->tier != TieredCompiler::FT_Baseline)
+        VM_QUICKEN(callee->nativeCode ? OP_CallNative : OP_CallInterpreted);
+
+      if(callee->nativeCode && nativeDepth < maxNativeDepth)
+        goto callNative;
+      goto callInterpreted;
+
+    VM_CASE(OP_CallNative):
+      callee = bytecode->functionBytecodes[instruction->param1];
+      // machine stack is limited, deep calls go to the interpreter
+      if(callDepth == maxCallDepth || nativeDepth >= maxNativeDepth)
+        goto genericCall;
+    callNative:
+      {
+        ++callDepth;
+        ExecutionStatus status = RunNative(callee, (char*)FrameAsINT(instruction->param3), (char*)(frame + instruction->param2));
+        --callDepth;
+
+        if(status != Returned)
+        {
+          Unwind(stackBase);
+          executionStatus = status;
+          return;
+        }
+      }
+      VM_NEXT;
+
+    VM_CASE(OP_CallInterpreted):
+      callee = bytecode->functionBytecodes[instruction->param1];
+      // native code only comes with a higher tier
+      if(callDepth == maxCallDepth || callee->nativeCode)
+        goto genericCall;
+    callInterpreted:
+      {
+        // save the caller, called function continues in this loop
+        CallFrame *caller = (CallFrame*)frameStack->Push(sizeof(CallFrame));
+        caller->previous = callFrame;
+        caller->functionBytecode = functionBytecode;
+        caller->returnInstruction = instruction;
+        caller->params = params;
+        caller->frame = frame;
+        caller->frameBase = frameBase;
+        caller->returnValue = returnValue;
+        callFrame = caller;
+        ++callDepth;
+        frameBase = frameStack->Push(0);
+
+        returnValue = (char*)(frame + instruction->param2);
+        params = (char*)FrameAsINT(instruction->param3);
+        functionBytecode = callee;
+
+        if(functionBytecode->decodedInstructions.empty())
+          functionBytecode->Predecode(dispatchTable);
+        instruction = VM_CODE(functionBytecode);
+      }
+      VM_ENTER;
+
+    VM_CASE(OP_TailCall):
+      {
+        // parameters are moved to the start of this function's frame, the rest of the frame is dropped.
+        // call depth stays the same, returning goes to this function's caller
+        callee = bytecode->functionBytecodes[instruction->param1];
+        if(tieredCompiler && ++callee->callCount == tieredCompiler->callThreshold)
+        {
+          VM_DEFER(callee, -1, callCount);
+          callee = tieredCompiler->TierUp(callee);
+        }
+        functionBytecode = callee;
+        INT32 size = functionBytecode->parameterSize;
+        char *newParams = size ? (char*)FrameAsINT(instruction->param2) : nullptr;
+
+        frameStack->Pop(frameBase);
+        params = frameStack->Push(size);
+        if(size)
+          memmove(params, newParams, size);
+
+        if(functionBytecode->decodedInstructions.empty())
+          functionBytecode->Predecode(dispatchTable);
+        instruction = VM_CODE(functionBytecode);
+      }
+      VM_ENTER;
+
+    VM_CASE(OP_JumpbR):
+      {
+        INT32 offset = FrameAsChar(instruction->param1) == 1 ? instruction->param2 : instruction->param3;
+        FrameAsInt32(instruction->param1) = 0;
+        VM_JUMP(offset); // jump ahead by the given amount
+      }
+      VM_NEXT;
+    VM_CASE(OP_Jump):
+      // loops of baseline functions go back with a jump
+      if(tieredCompiler && instruction->param1 < 0 && ++functionBytecode->backEdgeCount == tieredCompiler->backEdgeThreshold)
+      {
+        INT32 jumpIndex = functionBytecode->instructionIndices[instruction - VM_CODE(functionBytecode)];
+        VM_DEFER(functionBytecode, jumpIndex, backEdgeCount);
+        FunctionBytecode *loopEntry = tieredCompiler->EnterLoop(functionBytecode, jumpIndex);
+        if(loopEntry)
+        {
+          // running call continues in the loop entry. parameters and locals become its parameters,
+          // gathered above the frame and moved to the start of this function's frame like a tail call does.
+          // popped chunks keep their memory, a push at the frame base never starts after the gathered state
+          {
+            INT32 paramsSize = (functionBytecode->parameterSize + 7) & ~7;
+            char *state = frameStack->Push(loopEntry->parameterSize);
+            if(functionBytecode->parameterSize)
+              memcpy(state, params, functionBytecode->parameterSize);
+            memcpy(state + paramsSize, frame, loopEntry->parameterSize - paramsSize);
+
+            frameStack->Pop(frameBase);
+            params = frameStack->Push(loopEntry->parameterSize);
+            memmove(params, state, loopEntry->parameterSize);
+          }
+          functionBytecode = loopEntry;
+
+          if(functionBytecode->decodedInstructions.empty())
+            functionBytecode->Predecode(dispatchTable);
+          instruction = VM_CODE(functionBytecode);
+
+          if(functionBytecode->nativeCode && nativeDepth < maxNativeDepth)
+          {
+            ExecutionStatus status = RunNative(functionBytecode, params, returnValue);
+            if(status != Returned)
+            {
+              Unwind(stackBase);
+              executionStatus = status;
+              return;
+            }
+
+            // native code has already popped its frame, the call returns from here
+            goto returned;
+          }
+          VM_ENTER;
+        }
+      }
+      VM_JUMP(instruction->param1);
+      VM_NEXT;
+    VM_CASE(OP_JumpEqiPC):
+      if(ParamAsInt32(instruction->param1) == instruction->param2)
+        VM_JUMP(instruction->param3);
+      VM_NEXT;
+    VM_CASE(OP_JumpEqiRC):
+      if(FrameAsInt32(instruction->param1) == instruction->param2)
+        VM_JUMP(instruction->param3);
+      VM_NEXT;
+    VM_CASE(OP_JumpEqiPL):
+      if(ParamAsInt32(instruction->param1) == FrameAsInt32(instruction->param2))
+        VM_JUMP(instruction->param3);
+      VM_NEXT;
+    VM_CASE(OP_JumpEqiPP):
+      if(ParamAsInt32(instruction->param1) == ParamAsInt32(instruction->param2))
+        VM_JUMP(instruction->param3);
+      VM_NEXT;
+    VM_CASE(OP_JumpEqiRR):
+      if(FrameAsInt32(instruction->param1) == FrameAsInt32(instruction->param2))
+        VM_JUMP(instruction->param3);
+      VM_NEXT;
+    VM_CASE(OP_JumpEqiRP):
+      if(FrameAsInt32(instruction->param1) == ParamAsInt32(instruction->param2))
+        VM_JUMP(instruction->param3);
+      VM_NEXT;
+    VM_CASE(OP_JumpNeiPC):
+      if(ParamAsInt32(instruction->param1) != instruction->param2)
+        VM_JUMP(instruction->param3);
+      VM_NEXT;
+    VM_CASE(OP_JumpNeiRC):
+      if(FrameAsInt32(instruction->param1) != instruction->param2)
+        VM_JUMP(instruction->param3);
+      VM_NEXT;
+    VM_CASE(OP_JumpNeiPL):
+      if(ParamAsInt32(instruction->param1) != FrameAsInt32(instruction->param2))
+        VM_JUMP(instruction->param3);
+      VM_NEXT;
+    VM_CASE(OP_JumpNeiPP):
+      if(ParamAsInt32(instruction->param1) != ParamAsInt32(instruction->param2))
+        VM_JUMP(instruction->param3);
+      VM_NEXT;
+    VM_CASE(OP_JumpNeiRR):
+      if(FrameAsInt32(instruction->param1) != FrameAsInt32(instruction->param2))
+        VM_JUMP(instruction->param3);
+      VM_NEXT;
+    VM_CASE(OP_JumpNeiRP):
+      if(FrameAsInt32(instruction->param1) != ParamAsInt32(instruction->param2))
+        VM_JUMP(instruction->param3);
+      VM_NEXT;
+    VM_CASE(OP_IncJumpNeiRC):
+      if(++FrameAsInt32(instruction->param1) != instruction->param2)
+        VM_JUMP(instruction->param3);
+      VM_NEXT;
+
+    VM_CASE(OP_NotbRR):
+      FrameAsChar(instruction->param1) = !FrameAsChar(instruction->param2);
+      VM_NEXT;
+
+    VM_CASE(OP_DiviRP):
+      if(ParamAsInt32(instruction->param2) != 0)
+        FrameAsInt32(instruction->param1) /= ParamAsInt32(instruction->param2);
       else
-        ParamAsInt32(instruction.param1) = 0;
-      break;
-    case OP_DiviPL:
-      if( LocalAsInt32(instruction.param2) != 0)
-        ParamAsInt32(instruction.param1) /= LocalAsInt32(instruction.param2);
+        FrameAsInt32(instruction->param1) = 0;
+      VM_NEXT;
+    VM_CASE(OP_DiviPP):
+      if(ParamAsInt32(instruction->param2) != 0)
+        ParamAsInt32(instruction->param1) /= ParamAsInt32(instruction->param2);
       else
-        ParamAsInt32(instruction.param1) = 0;
-      break;
-    case OP_DiviRPC:
-      if( instruction.param3 != 0)
-        ParamAsInt32(instruction.param1) =  ParamAsInt32(instruction.param2) / instruction.param3;
+        ParamAsInt32(instruction->param1) = 0;
+      VM_NEXT;
+    VM_CASE(OP_DiviPC):
+      if(instruction->param2 != 0)
+        ParamAsInt32(instruction->param1) /= instruction->param2;
       else
-        ParamAsInt32(instruction.param1) = 0;
-      break;
-    case OP_DiviRPL:
-      if( LocalAsInt32(instruction.param3) != 0)
-        RegisterAsINT32(instruction.param1) =  ParamAsInt32(instruction.param2) / LocalAsInt32(instruction.param3);
+        ParamAsInt32(instruction->param1) = 0;
+      VM_NEXT;
+    VM_CASE(OP_DiviPR):
+      if( FrameAsInt32(instruction->param2) != 0)
+        ParamAsInt32(instruction->param1) /= FrameAsInt32(instruction->param2);
       else
-        RegisterAsINT32(instruction.param1) = 0;
-      break;
-    case OP_DiviRPP:
-      if( ParamAsInt32(instruction.param3) != 0)
-        RegisterAsINT32(instruction.param1) =  ParamAsInt32(instruction.param2) / ParamAsInt32(instruction.param3);
+        ParamAsInt32(instruction->param1) = 0;
+      VM_NEXT;
+    VM_CASE(OP_DiviRPC):
+      if( instruction->param3 != 0)
+        FrameAsInt32(instruction->param1) =  ParamAsInt32(instruction->param2) / instruction->param3;
       else
-        RegisterAsINT32(instruction.param1) = 0;
-      break;
-    case OP_DiviRPR:
-      if( RegisterAsINT32(instruction.param3) != 0)
-        RegisterAsINT32(instruction.param1) =  ParamAsInt32(instruction.param2) / RegisterAsINT32(instruction.param3);
+        FrameAsInt32(instruction->param1) = 0;
+      VM_NEXT;
+    VM_CASE(OP_DiviRPP):
+      if( ParamAsInt32(instruction->param3) != 0)
+        FrameAsInt32(instruction->param1) =  ParamAsInt32(instruction->param2) / ParamAsInt32(instruction->param3);
       else
-        RegisterAsINT32(instruction.param1) = 0;
-      break;
-    case OP_DiviRCP:
-      if( ParamAsInt32(instruction.param3) != 0)
-        RegisterAsINT32(instruction.param1) =  instruction.param2 / ParamAsInt32(instruction.param3);
+        FrameAsInt32(instruction->param1) = 0;
+      VM_NEXT;
+    VM_CASE(OP_DiviRPR):
+      if( FrameAsInt32(instruction->param3) != 0)
+        FrameAsInt32(instruction->param1) =  ParamAsInt32(instruction->param2) / FrameAsInt32(instruction->param3);
       else
-        RegisterAsINT32(instruction.param1) = 0;
-      break;
-    case OP_DiviRLP:
-      if( ParamAsInt32(instruction.param3) != 0)
-        RegisterAsINT32(instruction.param1) =  LocalAsInt32(instruction.param2) / ParamAsInt32(instruction.param3);
+        FrameAsInt32(instruction->param1) = 0;
+      VM_NEXT;
+    VM_CASE(OP_DiviRCP):
+      if( ParamAsInt32(instruction->param3) != 0)
+        FrameAsInt32(instruction->param1) =  instruction->param2 / ParamAsInt32(instruction->param3);
       else
-        RegisterAsINT32(instruction.param1) = 0;
-      break;
-    case OP_DiviRRP:
-      if( ParamAsInt32(instruction.param3) != 0)
-        RegisterAsINT32(instruction.param1) =  RegisterAsINT32(instruction.param2) / ParamAsInt32(instruction.param3);
+        FrameAsInt32(instruction->param1) = 0;
+      VM_NEXT;
+    VM_CASE(OP_DiviRRP):
+      if( ParamAsInt32(instruction->param3) != 0)
+        FrameAsInt32(instruction->param1) =  FrameAsInt32(instruction->param2) / ParamAsInt32(instruction->param3);
       else
-        RegisterAsINT32(instruction.param1) = 0;
-      break;
+        FrameAsInt32(instruction->param1) = 0;
+      VM_NEXT;
 
-    case OP_DiviRLR:
-      if( RegisterAsINT32(instruction.param3) == 0)
-      {
-        //TODO: show error message
-        RegisterAsINT32(instruction.param1) = 0;
-        break;
-      }
-      RegisterAsINT32(instruction.param1) = LocalAsInt32(instruction.param2) / RegisterAsINT32(instruction.param3);
-      break;
-    case OP_DiviRRL:
-      if( LocalAsInt32(instruction.param3) == 0)
-      {
-        //TODO: show error message
-        RegisterAsINT32(instruction.param1) = 0;
-        break;
-      }
-      RegisterAsINT32(instruction.param1) = RegisterAsINT32(instruction.param2) / LocalAsInt32(instruction.param3);
-      break;
-    case OP_DiviRRC:
+    VM_CASE(OP_DiviRRC):
       // this constant cannot be zero, we already check it in codegen
-      RegisterAsINT32(instruction.param1) = RegisterAsINT32(instruction.param2) / instruction.param3;
-      break;
-    case OP_DiviRCR:
-      if( RegisterAsINT32(instruction.param3) == 0)
+      FrameAsInt32(instruction->param1) = FrameAsInt32(instruction->param2) / instruction->param3;
+      VM_NEXT;
+    VM_CASE(OP_DiviRCR):
+      if( FrameAsInt32(instruction->param3) == 0)
       {
         //TODO: show error message
-        RegisterAsINT32(instruction.param1) = 0;
-        break;
+        FrameAsInt32(instruction->param1) = 0;
+        VM_NEXT;
       }
-      RegisterAsINT32(instruction.param1) = instruction.param2 / RegisterAsINT32(instruction.param3);
-      break;
-    case OP_DiviRLL:
-      if(RegisterAsINT32(instruction.param3) == 0)
+      FrameAsInt32(instruction->param1) = instruction->param2 / FrameAsInt32(instruction->param3);
+      VM_NEXT;
+    VM_CASE(OP_DiviRRR):
+      if( FrameAsInt32(instruction->param3) == 0)
       {
         //TODO: show error message
-        RegisterAsINT32(instruction.param1) = 0;
-        break;
+        FrameAsInt32(instruction->param1) = 0;
+        VM_NEXT;
       }
-      RegisterAsINT32(instruction.param1) = LocalAsInt32(instruction.param2) / LocalAsInt32(instruction.param3);
-      break;
-    case OP_DiviRLC:
-      RegisterAsINT32(instruction.param1) = LocalAsInt32(instruction.param2) / instruction.param3;
-      break;
-    case OP_DiviRCL:
-      if(LocalAsInt32(instruction.param3) == 0)
-      {
-        //TODO: show error message
-        RegisterAsINT32(instruction.param1) = 0;
-        break;
-      }
-      RegisterAsINT32(instruction.param1) = instruction.param2 / LocalAsInt32(instruction.param3);
-      break;
-    case OP_DiviRRR:
-      if( RegisterAsINT32(instruction.param3) == 0)
-      {
-        //TODO: show error message
-        RegisterAsINT32(instruction.param1) = 0;
-        break;
-      }
-      RegisterAsINT32(instruction.param1) = RegisterAsINT32(instruction.param2) / RegisterAsINT32(instruction.param3);
-      break;
+      FrameAsInt32(instruction->param1) = FrameAsInt32(instruction->param2) / FrameAsInt32(instruction->param3);
+      VM_NEXT;
 
 
       // multiply operators
 
-    case OP_MuliPC:
-      ParamAsInt32(instruction.param1) *= instruction.param2;
-      break;
-    case OP_MuliRP:
-      RegisterAsINT32(instruction.param1) *= ParamAsInt32(instruction.param2);
-      break;
-    case OP_MuliLP:
-      LocalAsInt32(instruction.param1) *= ParamAsInt32(instruction.param2);
-      break;
-    case OP_MuliRPR:
-      RegisterAsINT32(instruction.param1) = ParamAsInt32(instruction.param2) * RegisterAsINT32(instruction.param3);
-      break;
-    case OP_MuliRPC:
-      RegisterAsINT32(instruction.param1) = ParamAsInt32(instruction.param2) * instruction.param3;
-      break;
-    case OP_MuliRPL:
-      RegisterAsINT32(instruction.param1) = ParamAsInt32(instruction.param2) * LocalAsInt32(instruction.param3);
-      break;
-    case OP_MuliRPP:
-      RegisterAsINT32(instruction.param1) = ParamAsInt32(instruction.param2) * ParamAsInt32(instruction.param3);
-      break;
-
-    case OP_MuliRR:
-      RegisterAsINT32(instruction.param1) *= RegisterAsINT32(instruction.param2);
-      break;
-    case OP_MuliRL:
-      RegisterAsINT32(instruction.param1) *= LocalAsInt32(instruction.param2);   
-      break;
-    case OP_MuliRLL:
-      RegisterAsINT32(instruction.param1) = LocalAsInt32(instruction.param2) * LocalAsInt32(instruction.param3);
-      break;
-    case OP_MuliRLC:
-      RegisterAsINT32(instruction.param1) = LocalAsInt32(instruction.param2 ) * instruction.param3;
-      break;
-    case OP_MuliRC:
-      RegisterAsINT32(instruction.param1) *= instruction.param2;
-      break;
+    VM_CASE(OP_MuliPC):
+      ParamAsInt32(instruction->param1) *= instruction->param2;
+      VM_NEXT;
+    VM_CASE(OP_MuliRP):
+      FrameAsInt32(instruction->param1) *= ParamAsInt32(instruction->param2);
+      VM_NEXT;
+    VM_CASE(OP_MuliRPR):
+      FrameAsInt32(instruction->param1) = ParamAsInt32(instruction->param2) * FrameAsInt32(instruction->param3);
+      VM_NEXT;
+    VM_CASE(OP_MuliRPC):
+      FrameAsInt32(instruction->param1) = ParamAsInt32(instruction->param2) * instruction->param3;
+      VM_NEXT;
+    VM_CASE(OP_MuliRPP):
+      FrameAsInt32(instruction->param1) = ParamAsInt32(instruction->param2) * ParamAsInt32(instruction->param3);
+      VM_NEXT;
+
+    VM_CASE(OP_MuliRR):
+      FrameAsInt32(instruction->param1) *= FrameAsInt32(instruction->param2);
+      VM_NEXT;
+    VM_CASE(OP_MuliRLL):
+      FrameAsInt32(instruction->param1) = FrameAsInt32(instruction->param2) * FrameAsInt32(instruction->param3);
+      VM_NEXT;
+    VM_CASE(OP_MuliRLC):
+      FrameAsInt32(instruction->param1) = FrameAsInt32(instruction->param2 ) * instruction->param3;
+      VM_NEXT;
+    VM_CASE(OP_MuliRC):
+      FrameAsInt32(instruction->param1) *= instruction->param2;
+      VM_NEXT;
 
       // add operators
 
-    case OP_AddiPR:
-      ParamAsInt32(instruction.param1) += RegisterAsINT32(instruction.param2);
-      break;
-    case OP_AddiPC:
-      ParamAsInt32(instruction.param1) += instruction.param2;
-      break;
-    case OP_AddiRP:
-      RegisterAsINT32(instruction.param1) += ParamAsInt32(instruction.param2);
-      break;
-    case OP_AddiRPL:
-      RegisterAsINT32(instruction.param1) = ParamAsInt32(instruction.param2) + LocalAsInt32(instruction.param3);
-      break;
-    case OP_AddiRPR:
-      RegisterAsINT32(instruction.param1) = ParamAsInt32(instruction.param2) + RegisterAsINT32(instruction.param3);
-      break;
-    case OP_AddiRPC:
-      RegisterAsINT32(instruction.param1) = ParamAsInt32(instruction.param2) + instruction.param3;
-      break;
-    case OP_AddiRPP:
-      RegisterAsINT32(instruction.param1) = ParamAsInt32(instruction.param2) + ParamAsInt32(instruction.param3);
-      break;
-
-    case OP_AddiRL:
-      RegisterAsINT32(instruction.param1) += LocalAsInt32(instruction.param2);
-      break;
-    case OP_AddiRRR:
-      RegisterAsINT32(instruction.param1) = RegisterAsINT32(instruction.param2) + RegisterAsINT32(instruction.param3);
-      break;
-    case OP_AddiRLR:
-      RegisterAsINT32(instruction.param1) = LocalAsInt32(instruction.param2) + RegisterAsINT32(instruction.param3);
-      break;
-    case OP_AddiRLL:
-      RegisterAsINT32(instruction.param1) = LocalAsInt32(instruction.param2) + LocalAsInt32(instruction.param3);
-      break;
-    case OP_AddiRLC:
-      RegisterAsINT32(instruction.param1) = LocalAsInt32(instruction.param2) + instruction.param3;
-      break;
-    case OP_AddiRRC:
-      RegisterAsINT32(instruction.param1) = RegisterAsINT32(instruction.param2) + instruction.param3;
-      break;
-    case OP_AddiLR:
-      LocalAsInt32( instruction.param1) += RegisterAsINT32(instruction.param2);
-      break;
-    case OP_AddiRR:
-      RegisterAsINT32(instruction.param1)  += RegisterAsINT32(instruction.param2);
-      break;
-    case OP_AddiLC:
-      LocalAsInt32(instruction.param1)  += instruction.param2;
-      break;
-    case OP_AddiRC:
-      RegisterAsINT32(instruction.param1)  += instruction.param2;
-      break;
+    VM_CASE(OP_AddiPR):
+      ParamAsInt32(instruction->param1) += FrameAsInt32(instruction->param2);
+      VM_NEXT;
+    VM_CASE(OP_AddiPC):
+      ParamAsInt32(instruction->param1) += instruction->param2;
+      VM_NEXT;
+    VM_CASE(OP_AddiRP):
+      FrameAsInt32(instruction->param1) += ParamAsInt32(instruction->param2);
+      VM_NEXT;
+    VM_CASE(OP_AddiRPR):
+      FrameAsInt32(instruction->param1) = ParamAsInt32(instruction->param2) + FrameAsInt32(instruction->param3);
+      VM_NEXT;
+    VM_CASE(OP_AddiRPC):
+      FrameAsInt32(instruction->param1) = ParamAsInt32(instruction->param2) + instruction->param3;
+      VM_NEXT;
+    VM_CASE(OP_AddiRPP):
+      FrameAsInt32(instruction->param1) = ParamAsInt32(instruction->param2) + ParamAsInt32(instruction->param3);
+      VM_NEXT;
+
+    VM_CASE(OP_AddiRRR):
+      FrameAsInt32(instruction->param1) = FrameAsInt32(instruction->param2) + FrameAsInt32(instruction->param3);
+      VM_NEXT;
+    VM_CASE(OP_AddiRRC):
+      FrameAsInt32(instruction->param1) = FrameAsInt32(instruction->param2) + instruction->param3;
+      VM_NEXT;
+    VM_CASE(OP_AddiRR):
+      FrameAsInt32(instruction->param1)  += FrameAsInt32(instruction->param2);
+      VM_NEXT;
+    VM_CASE(OP_AddiRC):
+      FrameAsInt32(instruction->param1)  += instruction->param2;
+      VM_NEXT;
 
 
       // SUBTRACT operators
-    case  OP_SubiRP:
-      RegisterAsINT32(instruction.param1) -= ParamAsInt32(instruction.param2);
-      break;
-    case OP_SubiPP:
-      ParamAsInt32(instruction.param1) -= ParamAsInt32(instruction.param2);
-      break;
-    case OP_SubiPC:
-      ParamAsInt32(instruction.param1) -= instruction.param2;
-      break;
-    case OP_SubiPL:
-      ParamAsInt32(instruction.param1) -= LocalAsInt32(instruction.param2);
-      break;
-    case OP_SubiRRP:
-      RegisterAsINT32(instruction.param1) = RegisterAsINT32(instruction.param2) - ParamAsInt32(instruction.param3);
-      break;
-    case OP_SubiRPR:
-      RegisterAsINT32(instruction.param1) = ParamAsInt32(instruction.param2) - RegisterAsINT32(instruction.param3);
-      break;
-    case OP_SubiRLP:
-      RegisterAsINT32(instruction.param1) = LocalAsInt32(instruction.param2) - ParamAsInt32(instruction.param3);
-      break;
-    case OP_SubiRPL:
-      RegisterAsINT32(instruction.param1) = ParamAsInt32(instruction.param2) - LocalAsInt32(instruction.param3);
-      break;
-    case OP_SubiRPC:
-      RegisterAsINT32(instruction.param1) = ParamAsInt32(instruction.param2) - instruction.param3;
-      break;
-    case OP_SubiRCP:
-      RegisterAsINT32(instruction.param1) = instruction.param2 - ParamAsInt32(instruction.param3);
-      break;
-    case OP_SubiRPP:
-      RegisterAsINT32(instruction.param1) = ParamAsInt32(instruction.param2) - ParamAsInt32(instruction.param3);
-      break;
-    case OP_SubiRLL:
-      RegisterAsINT32(instruction.param1)  = LocalAsInt32(instruction.param2) - LocalAsInt32( instruction.param3);
-      break;
-    case OP_SubiRCL:
-      RegisterAsINT32(instruction.param1)  = instruction.param2 - LocalAsInt32( instruction.param3);
-      break;
-    case OP_SubiRLC:
-      RegisterAsINT32(instruction.param1)  = LocalAsInt32( instruction.param2) - instruction.param3;
-      break;
-    case OP_SubiRRR:
-      RegisterAsINT32(instruction.param1)  = RegisterAsINT32(instruction.param2) + RegisterAsINT32(instruction.param3);
-      break;
-    case OP_SubiRLR:
-      RegisterAsINT32(instruction.param1)  = RegisterAsINT32( instruction.param2) - RegisterAsINT32(instruction.param3);
-      break;
-    case OP_SubiRRL:
-      RegisterAsINT32(instruction.param1)  = RegisterAsINT32(instruction.param2) - LocalAsInt32( instruction.param3);
-      break;
-    case OP_SubiRCR:
-      RegisterAsINT32(instruction.param1)  = instruction.param2 - RegisterAsINT32(instruction.param3);
-      break;
-    case OP_SubiRRC:
-      RegisterAsINT32(instruction.param1)  = RegisterAsINT32(instruction.param2) - instruction.param3;
-      break;
-    case OP_SubiRC:
-      RegisterAsINT32(instruction.param1)  -= instruction.param2;
-      break;
-    case OP_SubiRR:
-      RegisterAsINT32(instruction.param1)  -= RegisterAsINT32(instruction.param2);
-      break;
-    case OP_SubiRL:
-      RegisterAsINT32(instruction.param1)  -= LocalAsInt32( instruction.param2);
-      break;
-    case OP_SubiLR:
-      LocalAsInt32( instruction.param1) -=  RegisterAsINT32(instruction.param2);
-      break;
+    VM_CASE(OP_SubiRP):
+      FrameAsInt32(instruction->param1) -= ParamAsInt32(instruction->param2);
+      VM_NEXT;
+    VM_CASE(OP_SubiPP):
+      ParamAsInt32(instruction->param1) -= ParamAsInt32(instruction->param2);
+      VM_NEXT;
+    VM_CASE(OP_SubiPC):
+      ParamAsInt32(instruction->param1) -= instruction->param2;
+      VM_NEXT;
+    VM_CASE(OP_SubiPL):
+      ParamAsInt32(instruction->param1) -= FrameAsInt32(instruction->param2);
+      VM_NEXT;
+    VM_CASE(OP_SubiRRP):
+      FrameAsInt32(instruction->param1) = FrameAsInt32(instruction->param2) - ParamAsInt32(instruction->param3);
+      VM_NEXT;
+    VM_CASE(OP_SubiRPR):
+      FrameAsInt32(instruction->param1) = ParamAsInt32(instruction->param2) - FrameAsInt32(instruction->param3);
+      VM_NEXT;
+    VM_CASE(OP_SubiRPC):
+      FrameAsInt32(instruction->param1) = ParamAsInt32(instruction->param2) - instruction->param3;
+      VM_NEXT;
+    VM_CASE(OP_SubiRCP):
+      FrameAsInt32(instruction->param1) = instruction->param2 - ParamAsInt32(instruction->param3);
+      VM_NEXT;
+    VM_CASE(OP_SubiRPP):
+      FrameAsInt32(instruction->param1) = ParamAsInt32(instruction->param2) - ParamAsInt32(instruction->param3);
+      VM_NEXT;
+    VM_CASE(OP_SubiRRR):
+      FrameAsInt32(instruction->param1)  = FrameAsInt32(instruction->param2) - FrameAsInt32(instruction->param3);
+      VM_NEXT;
+    VM_CASE(OP_SubiRCR):
+      FrameAsInt32(instruction->param1)  = instruction->param2 - FrameAsInt32(instruction->param3);
+      VM_NEXT;
+    VM_CASE(OP_SubiRRC):
+      FrameAsInt32(instruction->param1)  = FrameAsInt32(instruction->param2) - instruction->param3;
+      VM_NEXT;
+    VM_CASE(OP_SubiRC):
+      FrameAsInt32(instruction->param1)  -= instruction->param2;
+      VM_NEXT;
+    VM_CASE(OP_SubiRR):
+      FrameAsInt32(instruction->param1)  -= FrameAsInt32(instruction->param2);
+      VM_NEXT;
 
 
       // Copy operators
 
-    case OP_CopybLP:
-      LocalAsChar(instruction.param1)  = ParamAsChar(instruction.param2);
-      break;
-    case OP_CopybRP:
-      RegisterAsChar(instruction.param1)  = ParamAsChar(instruction.param2);
-      break;
-    case OP_CopybPR: 
-      ParamAsChar(instruction.param1)  = RegisterAsChar(instruction.param2);
-      break;    
-    case OP_CopybPL:
-      ParamAsChar(instruction.param1)  = LocalAsChar(instruction.param2);
-      break;
-
-    case OP_CopyiLP:
-      LocalAsInt32(instruction.param1)  = ParamAsInt32(instruction.param2);
-      break;
-    case OP_CopyiRP:
-      RegisterAsINT32(instruction.param1)  = ParamAsInt32(instruction.param2);
-      break;
-    case OP_CopyiPR:
-      ParamAsInt32(instruction.param1)  = RegisterAsINT32(instruction.param2);
-      break;
-    case OP_CopyiPL:
-      ParamAsInt32(instruction.param1)  = LocalAsInt32(instruction.param2);
-      break;
-
-    case OP_CopyiRC:
-      RegisterAsINT32(instruction.param1)  = instruction.param2;
-      break;
-    case OP_CopyiRR:
-      RegisterAsINT32(instruction.param1)  = RegisterAsINT32(instruction.param2);
-      break;
-    case OP_CopyiRL:
-      RegisterAsINT32(instruction.param1) = LocalAsInt32(instruction.param2);
-      break;
-    case OP_CopyiLR:
-      LocalAsInt32(instruction.param1 ) = RegisterAsINT32(instruction.param2);
-      break;
-    case OP_CopyiXR:
-      * ((INT32*) returnValue) = RegisterAsINT32(instruction.param1);
-      break;
+    VM_CASE(OP_CopybRP):
+      FrameAsChar(instruction->param1)  = ParamAsChar(instruction->param2);
+      VM_NEXT;
+    VM_CASE(OP_CopybPR): 
+      ParamAsChar(instruction->param1)  = FrameAsChar(instruction->param2);
+      VM_NEXT;    
+
+    VM_CASE(OP_CopyiRP):
+      FrameAsInt32(instruction->param1)  = ParamAsInt32(instruction->param2);
+      VM_NEXT;
+    VM_CASE(OP_CopyiPR):
+      ParamAsInt32(instruction->param1)  = FrameAsInt32(instruction->param2);
+      VM_NEXT;
+
+    VM_CASE(OP_CopyiRC):
+      FrameAsInt32(instruction->param1)  = instruction->param2;
+      VM_NEXT;
+    VM_CASE(OP_CopyiRR):
+      FrameAsInt32(instruction->param1)  = FrameAsInt32(instruction->param2);
+      VM_NEXT;
+    VM_CASE(OP_CopyiXR):
+      * ((INT32*) returnValue) = FrameAsInt32(instruction->param1);
+      VM_NEXT;
 
 
       //bools
-    case OP_CopybRR:
-      RegisterAsChar(instruction.param1) = RegisterAsChar(instruction.param2);
-      break;
-    case OP_CopybLR:
-      LocalAsChar(instruction.param1) = RegisterAsChar(instruction.param2);
-      break;
-    case OP_CopybRC:
-      RegisterAsChar(instruction.param1) = instruction.param2;
-      break;
-    case OP_CopybRL:
-      RegisterAsChar(instruction.param1) = LocalAsChar(instruction.param2);
-      break;
+    VM_CASE(OP_CopybRR):
+      FrameAsChar(instruction->param1) = FrameAsChar(instruction->param2);
+      VM_NEXT;
+    VM_CASE(OP_CopybRC):
+      FrameAsChar(instruction->param1) = instruction->param2;
+      VM_NEXT;
+    VM_CASE(OP_SpillLR):
+      FrameAsINT(instruction->param1) = FrameAsINT(instruction->param2);
+      VM_NEXT;
 
 
       // COMPARISON OPERATORS
 
-    case OP_CmpbRPP:
-      if(ParamAsChar( instruction.param2) == ParamAsChar(instruction.param3) )
-        RegisterAsChar(instruction.param1) = 1;
+    VM_CASE(OP_CmpbRPP):
+      if(ParamAsChar( instruction->param2) == ParamAsChar(instruction->param3) )
+        FrameAsChar(instruction->param1) = 1;
       else
-        RegisterAsChar(instruction.param1) = 0;
-      break;
-    case OP_CmpbRPL:
-      if(ParamAsChar( instruction.param2) == LocalAsChar(instruction.param3) )
-        RegisterAsChar(instruction.param1) = 1;
+        FrameAsChar(instruction->param1) = 0;
+      VM_NEXT;
+    VM_CASE(OP_CmpbRPR):
+      if(ParamAsChar( instruction->param2) == FrameAsChar(instruction->param3) )
+        FrameAsChar(instruction->param1) = 1;
       else
-        RegisterAsChar(instruction.param1) = 0;
-      break;
-    case OP_CmpbRPR:
-      if(ParamAsChar( instruction.param2) == RegisterAsChar(instruction.param3) )
-        RegisterAsChar(instruction.param1) = 1;
+        FrameAsChar(instruction->param1) = 0;
+      VM_NEXT;
+    VM_CASE(OP_CmpbRPC):
+      if(ParamAsChar( instruction->param2) == instruction->param3 )
+        FrameAsChar(instruction->param1) = 1;
       else
-        RegisterAsChar(instruction.param1) = 0;
-      break;
-    case OP_CmpbRPC:
-      if(ParamAsChar( instruction.param2) == instruction.param3 )
-        RegisterAsChar(instruction.param1) = 1;
+        FrameAsChar(instruction->param1) = 0;
+      VM_NEXT;
+    VM_CASE(OP_CmpiRPP):
+      if(ParamAsInt32(instruction->param2) == ParamAsInt32( instruction->param3) )
+        FrameAsChar(instruction->param1) = 1;
       else
-        RegisterAsChar(instruction.param1) = 0;
-      break;
-    case OP_CmpiRPP:
-      if(ParamAsInt32(instruction.param2) == ParamAsInt32( instruction.param3) )
-        RegisterAsChar(instruction.param1) = 1;
+        FrameAsChar(instruction->param1) = 0;
+      VM_NEXT;
+    VM_CASE(OP_CmpiRPR):
+      if(ParamAsInt32( instruction->param2) == FrameAsInt32( instruction->param3) )
+        FrameAsChar(instruction->param1) = 1;
       else
-        RegisterAsChar(instruction.param1) = 0;
-      break;
-    case OP_CmpiRPL:
-      if(ParamAsInt32( instruction.param2) == LocalAsInt32( instruction.param3) )
-        RegisterAsChar(instruction.param1) = 1;
+        FrameAsChar(instruction->param1) = 0;
+      VM_NEXT;
+    VM_CASE(OP_CmpiRPC):
+      if(ParamAsInt32( instruction->param2) == instruction->param3 )
+        FrameAsChar(instruction->param1) = 1;
       else
-        RegisterAsChar(instruction.param1) = 0;
-      break;
-    case OP_CmpiRPR:
-      if(ParamAsInt32( instruction.param2) == RegisterAsINT32( instruction.param3) )
-        RegisterAsChar(instruction.param1) = 1;
-      else
-        RegisterAsChar(instruction.param1) = 0;
-      break;
-    case OP_CmpiRPC:
-      if(ParamAsInt32( instruction.param2) == instruction.param3 )
-        RegisterAsChar(instruction.param1) = 1;
-      else
-        RegisterAsChar(instruction.param1) = 0;
-      break;
+        FrameAsChar(instruction->param1) = 0;
+      VM_NEXT;
 
-    case OP_CmpbRC:
-      if(RegisterAsChar( instruction.param1) == LocalAsChar(instruction.param2) )
-        RegisterAsChar(instruction.param1) = 1;
+    VM_CASE(OP_CmpbRC):
+      if(FrameAsChar( instruction->param1) == FrameAsChar(instruction->param2) )
+        FrameAsChar(instruction->param1) = 1;
       else
-        RegisterAsChar(instruction.param1) = 0;
-      break;
+        FrameAsChar(instruction->param1) = 0;
+      VM_NEXT;
 
-    case OP_CmpbRLL:
-      if(LocalAsChar( instruction.param2) == LocalAsChar(instruction.param3) )
-        RegisterAsChar(instruction.param1) = 1;
-      else
-        RegisterAsChar(instruction.param1) = 0;
-      break;
-    case OP_CmpbRRR:
-      if(RegisterAsChar(instruction.param2) == RegisterAsChar(instruction.param3) )
-        RegisterAsChar(instruction.param1) = 1;
-      else
-        RegisterAsChar(instruction.param1) = 0;
-      break;
-    case OP_CmpbRLC:
-      if( LocalAsChar( instruction.param2) == instruction.param3)
-        RegisterAsChar(instruction.param1) = 1;
-      else
-        RegisterAsChar(instruction.param1) = 0;
-      break;
-    case OP_CmpbRCR:
-      if( instruction.param2 == RegisterAsChar(instruction.param3) )
-        RegisterAsChar(instruction.param1) = 1;
+    VM_CASE(OP_CmpbRRR):
+      if(FrameAsChar(instruction->param2) == FrameAsChar(instruction->param3) )
+        FrameAsChar(instruction->param1) = 1;
       else
-        RegisterAsChar(instruction.param1) = 0;
-      break;
-    case OP_CmpbRLR:
-      if( LocalAsChar( instruction.param2) == RegisterAsChar(instruction.param3) )
-        RegisterAsChar(instruction.param1) = 1;
+        FrameAsChar(instruction->param1) = 0;
+      VM_NEXT;
+    VM_CASE(OP_CmpbRLC):
+      if( FrameAsChar( instruction->param2) == instruction->param3)
+        FrameAsChar(instruction->param1) = 1;
       else
-        RegisterAsChar(instruction.param1) = 0;
-      break;
-    case OP_CmpiRLL:
-      if( LocalAsInt32(  instruction.param2 ) == LocalAsInt32( instruction.param3)  )
-        RegisterAsChar(instruction.param1) = 1;
+        FrameAsChar(instruction->param1) = 0;
+      VM_NEXT;
+    VM_CASE(OP_CmpbRCR):
+      if( instruction->param2 == FrameAsChar(instruction->param3) )
+        FrameAsChar(instruction->param1) = 1;
       else
-        RegisterAsChar(instruction.param1) = 0;
-      break;
-    case OP_CmpiRLC:
-      if(LocalAsInt32( instruction.param2) == instruction.param3)
-        RegisterAsChar(instruction.param1) = 1;
+        FrameAsChar(instruction->param1) = 0;
+      VM_NEXT;
+    VM_CASE(OP_CmpiRLC):
+      if(FrameAsInt32( instruction->param2) == instruction->param3)
+        FrameAsChar(instruction->param1) = 1;
       else
-        RegisterAsChar(instruction.param1) = 0;
-      break;
-    case OP_CmpiRRR:
-      if( RegisterAsINT32(instruction.param2) ==  RegisterAsINT32(instruction.param3) )
-        RegisterAsChar(instruction.param1) = 1;
+        FrameAsChar(instruction->param1) = 0;
+      VM_NEXT;
+    VM_CASE(OP_CmpiRRR):
+      if( FrameAsInt32(instruction->param2) ==  FrameAsInt32(instruction->param3) )
+        FrameAsChar(instruction->param1) = 1;
       else
-        RegisterAsChar(instruction.param1) = 0;
-      break;
-    case OP_CmpiRCR:
-      if( instruction.param2 == RegisterAsINT32(instruction.param3) )
-        RegisterAsChar(instruction.param1) = 1;
+        FrameAsChar(instruction->param1) = 0;
+      VM_NEXT;
+    VM_CASE(OP_CmpiRCR):
+      if( instruction->param2 == FrameAsInt32(instruction->param3) )
+        FrameAsChar(instruction->param1) = 1;
       else
-        RegisterAsChar(instruction.param1) = 0;
-      break;
-    case OP_CmpiRLR:
-      if( LocalAsInt32(instruction.param2) == RegisterAsINT32(instruction.param3) )
-        RegisterAsChar(instruction.param1) = 1;
-      else
-        RegisterAsChar(instruction.param1) = 0;
-      break;
+        FrameAsChar(instruction->param1) = 0;
+      VM_NEXT;
+
+    VM_CASE(OP_Return):
+    returned:
+      if(!callFrame)
+      {
+        frameStack->Pop(stackBase);
+        functionBytecode = entryFunction;
+        executionStatus = Returned;
+        return;
+      }
+
+      // back to the caller. called function already popped its own frame
+      {
+        CallFrame *caller = callFrame;
+        functionBytecode = caller->functionBytecode;
+        instruction = caller->returnInstruction;
+        params = caller->params;
+        frame = caller->frame;
+        frameBase = caller->frameBase;
+        returnValue = caller->returnValue;
+        callFrame = caller->previous;
+        --callDepth;
+        frameStack->Pop((char*)caller);
+      }
+      VM_NEXT;
+
+    VM_CASE(OP_Yield):
+      if(coroutine)
+      {
+        ++instruction;
+        executionStatus = Suspended;
+        goto suspend;
+      }
+      VM_NEXT;
 
-    case OP_Return:
-      executionStatus = Returned;
-      return;
       // BLOCK OPERATORS
-    case OP_BStart:
-      break; // TODO: call constructors of this block stack variables
-    case OP_BEnd:
-      break; // TODO: call destructors of this block stack variables
+    VM_CASE(OP_BStart):
+      VM_NEXT; // TODO: call constructors of this block stack variables
+    VM_CASE(OP_BEnd):
+      VM_NEXT; // TODO: call destructors of this block stack variables
+
+    // a coroutine stops with its status set, instruction is where it continues.
+    // the running call and its callers stay on the frame stack, the rest of their state is saved here
+    suspend:
+      resumeInstruction = instruction;
+      resumeParams = params;
+      resumeFrame = frame;
+      resumeStackBase = stackBase;
+      resumeEntryFunction = entryFunction;
+      return;
+#ifdef ANADOLU_THREADED_DISPATCH
+    L_Unhandled:
+#else
     default:
+#endif
       assert(0);// we forgot executing an instruction
-      break;
+      VM_NEXT;
     }
+#ifndef ANADOLU_THREADED_DISPATCH
+    ++instruction;
+#endif
   }
 }
 
 void ExecutionContext::Execute()
 {
+  DropSuspended();
   executionStatus = Executing;
   ExecuteInstructions();
+}
+
+void ExecutionContext::Resume()
+{
+  if(executionStatus != Suspended && executionStatus != Preempted)
+    return;
+
+  CompileDeferred();
+  executionStatus = Executing;
+  ExecuteInstructions();
+}
+
+void ExecutionContext::CompileDeferred()
+{
+  if(!deferredFunction)
+    return;
+
+  if(deferredJump == -1)
+    bytecode->tieredCompiler->TierUp(deferredFunction);
+  else
+    bytecode->tieredCompiler->EnterLoop(deferredFunction, deferredJump);
+  deferredFunction = nullptr;
 }
\ No newline at end of file
@@ -11,52 +11,144 @@ class Expression;
 class Statement;
 class VM;
 class Instruction;
+class DecodedInstruction;
 class Bytecode;
+class FrameStack;
+class CallFrame;
 
 // A single function execution
+// functions called by the script run in the same context, with their frames on the frame stack
 class ExecutionContext
 {
-private:
+public:
 
-  // TODO: do coroutines
   enum ExecutionStatus
   {
     NotPrepared,
     Prepared,
     Executing,
-    Returned
-  }executionStatus;
+    Returned,
+    CallDepthExceeded, // too deep recursion, execution is stopped and frames are unwound
+    Suspended, // a coroutine reached a yield, Resume continues it
+    Preempted // a coroutine ran out of its budget, Resume continues it with a new budget
+  };
+
+  static const INT defaultMaxCallDepth = 100000;
+
+  // nested native calls allowed on the machine stack, deeper calls are interpreted
+  static const INT maxNativeDepth = 256;
+
+private:
+
+  // native code reads and updates call depths at fixed offsets
+  friend class JITCompiler;
+  // compiled code makes calls through AOTCompiler::Call
+  friend class AOTCompiler;
+
+  ExecutionStatus executionStatus;
 
   Bytecode *bytecode;
+
+  // function currently running, changes with calls and returns
   FunctionBytecode *functionBytecode;
-  std::vector<Instruction> *instructions;
 
-  // parameters, this is only a pointer.
-  // Parameter data is created by the caller, but deleted by this function
+  // parameters of the entry function, this is only a pointer.
+  // Parameter data is created and deleted by the caller
   char *params;
-  char *locals;
 
-  // registers array.
-  // each register holds enough to hold 
-  INT *registers; 
+  // where the frame of the running function starts. parameters a tail call moved come first,
+  // then locals, registers and parameter memory of its calls
+  char *frameBase;
+
   char *returnValue;
   char *thisValue;
 
+  // frames of called functions are pushed here
+  FrameStack *frameStack;
+
+  // innermost caller, null when the entry function is running
+  CallFrame *callFrame;
+  INT callDepth;
+  INT maxCallDepth;
+
+  // native functions and interpreters entered from native code that are running on this thread
+  INT nativeDepth;
+
+  // yield suspends only coroutines, other contexts run past it
+  bool coroutine;
+
+  // loop back-edges and function entries a coroutine runs in each Execute or Resume, 0 for no limit
+  INT budget;
+
+  // where a suspended coroutine continues, its frames stay on the frame stack. null unless it is suspended
+  const DecodedInstruction *resumeInstruction;
+  char *resumeParams;
+  char *resumeFrame;
+  char *resumeStackBase;
+  FunctionBytecode *resumeEntryFunction;
+
+  // a coroutine with a budget is preempted instead of compiling a function in its slice, null if nothing waits.
+  // the index of the jump going back for a loop entry, -1 for a call
+  FunctionBytecode *deferredFunction;
+  INT32 deferredJump;
+
   void ExecuteInstructions();
 
+  // runs the compiled function on the machine stack
+  ExecutionStatus RunNative(FunctionBytecode *function, char *callParams, char *callReturnValue);
+
+  // called by native code for functions that are not compiled, runs the function in a context of its own
+  static INT32 CallInterpreted(ExecutionContext *caller, INT32 functionId, char *callParams, char *callReturnValue);
+
+  // pops every frame pushed after stackBase and restores the entry function
+  void Unwind(char *stackBase);
+
+  // pops the frames of a suspended coroutine, it starts from the beginning when it is executed again
+  void DropSuspended();
+
 public:
 
-  ExecutionContext(Bytecode *_bytecode, FunctionBytecode *_functionBytecode) ;
+  // decodes every function of the bytecode and quickens the calls of untiered bytecode. nothing in untiered
+  // bytecode changes after this, contexts on many threads can run it at once. VM::GenerateByteCode calls this
+  static void PrepareBytecode(Bytecode *bytecode);
+
+  // uses the calling thread's frame stack if frameStack is null.
+  // a coroutine is suspended at each yield of the script and continued with Resume. its frames stay on the frame stack
+  // while it is suspended, so it needs a frame stack of its own. suspending and resuming copy and allocate nothing.
+  // everything a coroutine calls is interpreted, native code can't be suspended
+  ExecutionContext(Bytecode *_bytecode, FunctionBytecode *_functionBytecode, FrameStack *_frameStack = nullptr, bool _coroutine = false);
 
   ~ExecutionContext();
 
+  // prepares the context to run the function again like a new context would. return memory is kept
+  void Reset(FunctionBytecode *_functionBytecode);
+
   void CreateReturnMemory();
   inline void DestroyReturnMemory() { delete[] returnValue; }
 
+  // memory the caller owns instead of CreateReturnMemory, at least the return size of the function
+  inline void SetReturnMemory(char *memory) { returnValue = memory; }
+
   inline char *GetReturnValue() { return returnValue; }
 
   void Execute();
 
+  // continues a Suspended or Preempted coroutine where it stopped, until it stops again
+  void Resume();
+
+  // compiles the function a coroutine was preempted for, so it isn't compiled in the next slice. Resume calls it too
+  void CompileDeferred();
+
+  inline ExecutionStatus GetStatus() { return executionStatus; }
+
+  // number of nested script calls allowed before execution stops with CallDepthExceeded
+  inline void SetMaxCallDepth(INT depth) { maxCallDepth = depth; }
+
+  // a coroutine taking more back-edges and calls than this is Preempted, so the host can run other work
+  // between its slices. straight-line code is never interrupted. other contexts ignore it.
+  // a function it tiers up is compiled between slices, it is preempted early for it
+  inline void SetBudget(INT _budget) { budget = _budget; }
+
   void SetParameter(char *data);
 
 };
\ No newline at end of file
@@ -0,0 +1,47 @@
+#include "FrameStack.h"
+
+#include <assert.h>
+
+FrameStack::FrameStack(size_t chunkSize) : current(0)
+{
+  Chunk chunk = { new char[chunkSize], chunkSize, 0 };
+  chunks.push_back(chunk);
+}
+
+FrameStack::~FrameStack()
+{
+  for(auto &chunk : chunks)
+    delete[] chunk.memory;
+}
+
+char *FrameStack::PushToNextChunk(size_t size)
+{
+  // chunks after current one are empty, reuse the next one that is big enough
+  while(current + 1 < chunks.size() && chunks[current + 1].size < size)
+  {
+    delete[] chunks[current + 1].memory;
+    chunks.erase(chunks.begin() + current + 1);
+  }
+
+  if(current + 1 == chunks.size())
+  {
+    size_t chunkSize = chunks[current].size * 2;
+    if(chunkSize < size)
+      chunkSize = size;
+
+    Chunk chunk = { new char[chunkSize], chunkSize, 0 };
+    chunks.push_back(chunk);
+  }
+
+  ++current;
+  assert(chunks[current].top == 0);
+
+  chunks[current].top = size;
+  return chunks[current].memory;
+}
+
+FrameStack *FrameStack::GetThreadFrameStack()
+{
+  static thread_local FrameStack frameStack;
+  return &frameStack;
+}
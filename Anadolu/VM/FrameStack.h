@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Parser/PrimitiveTypes.h"
+
+#include <vector>
+
+// Memory for function frames (locals, registers, parameters)
+// Frames are pushed and popped in LIFO order, like a stack.
+// Memory is kept in chunks, a chunk never moves so a frame stays valid while the stack grows
+class FrameStack
+{
+private:
+
+  class Chunk
+  {
+  public:
+
+    char *memory;
+    size_t size;
+    size_t top;
+
+  };
+
+  std::vector<Chunk> chunks;
+
+  // chunk frames are pushed to
+  size_t current;
+
+  char *PushToNextChunk(size_t size);
+
+public:
+
+  static const size_t defaultChunkSize = 64 * 1024;
+
+  FrameStack(size_t chunkSize = defaultChunkSize);
+
+  ~FrameStack();
+
+  // returns at least size bytes, aligned to 8 bytes. Memory is not cleared
+  inline char *Push(size_t size)
+  {
+    size = (size + 7) & ~(size_t)7;
+
+    Chunk &chunk = chunks[current];
+    if(chunk.top + size > chunk.size)
+      return PushToNextChunk(size);
+
+    char *frame = chunk.memory + chunk.top;
+    chunk.top += size;
+    return frame;
+  }
+
+  // pops the frame and every frame pushed after it
+  inline void Pop(char *frame)
+  {
+    Chunk *chunk = &chunks[current];
+    while(frame < chunk->memory || frame > chunk->memory + chunk->top)
+    {
+      chunk->top = 0;
+      chunk = &chunks[--current];
+    }
+
+    chunk->top = frame - chunk->memory;
+  }
+
+  // frame stack of the calling thread, created on first use
+  static FrameStack *GetThreadFrameStack();
+
+};
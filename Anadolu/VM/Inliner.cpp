@@ -0,0 +1,589 @@
+#include "Inliner.h"
+#include "SSAOptimizer.h"
+
+#include <map>
+#include <deque>
+#include <algorithm>
+
+INT32 Inliner::GetSize(SSAFunction &function)
+{
+  INT32 size = 0;
+  for(auto &block : function.blocks)
+  {
+    if(block.removed)
+      continue;
+
+    for(auto id : block.instructions)
+    {
+      SSAOperation operation = function.instructions[id].operation;
+      if(operation != SO_Const && operation != SO_Param && operation != SO_Phi)
+        ++size;
+    }
+
+    if(block.terminator != TK_Return)
+      ++size;
+  }
+
+  return size;
+}
+
+SSAFunction *Inliner::GetCallee(INT32 functionId)
+{
+  auto cached = callees.find(functionId);
+  if(cached != callees.end())
+    return cached->second.get();
+
+  std::unique_ptr<SSAFunction> &callee = callees[functionId];
+
+  auto body = bodies.find(functionId);
+  if(body == bodies.end())
+    return nullptr;
+
+  std::list<Instruction> code = body->second;
+  std::unique_ptr<SSAFunction> function(new SSAFunction());
+  if(!function->Build(code))
+    return nullptr;
+
+  RemoveSelfTailCalls(*function, functionId);
+
+  SSAOptimizer optimizer;
+  optimizer.Optimize(*function);
+
+  if(GetSize(*function) > maxCalleeSize)
+    return nullptr;
+
+  for(auto &block : function->blocks)
+  {
+    if(block.removed)
+      continue;
+
+    for(auto id : block.instructions)
+    {
+      SSAInstruction &instruction = function->instructions[id];
+
+      // memory of the callee's frame does not exist in the caller
+      if(instruction.operation == SO_Load || instruction.operation == SO_Store)
+        return nullptr;
+
+      // return value has to be set on the way out, in the block that returns
+      if(instruction.operation == SO_Native && instruction.native.opCode == OP_CopyiXR && block.terminator != TK_Return)
+        return nullptr;
+    }
+  }
+
+  callee = std::move(function);
+  return callee.get();
+}
+
+bool Inliner::FindArguments(SSAFunction &function, INT32 call, std::vector<INT32> &uses, std::map<INT32, std::pair<INT32, INT32>> &arguments, std::vector<INT32> &parameterInstructions)
+{
+  std::vector<SSAInstruction> &instructions = function.instructions;
+
+  INT32 callOperand = instructions[call].nativeOperands[instructions[call].native.opCode == OP_TailCall ? 1 : 2];
+  if(callOperand == -1)
+    return true;
+
+  INT32 parameters = instructions[call].operands[callOperand];
+  if(instructions[parameters].operation != SO_Native || instructions[parameters].native.opCode != OP_CallPrep)
+    return false;
+  parameterInstructions.push_back(parameters);
+
+  INT32 found = 1; // the call
+  for(auto &block : function.blocks)
+  {
+    if(block.removed)
+      continue;
+
+    for(auto id : block.instructions)
+    {
+      SSAInstruction &instruction = instructions[id];
+      if(id == call || std::find(instruction.operands.begin(), instruction.operands.end(), parameters) == instruction.operands.end())
+        continue;
+
+      if(instruction.operation != SO_Native)
+        return false;
+
+      OpCode opCode = instruction.native.opCode;
+      if(opCode == OP_CopyData4ROR || opCode == OP_CopyData1ROR)
+      {
+        if(instruction.operands[instruction.nativeOperands[0]] != parameters || arguments.count(instruction.native.param2))
+          return false;
+        arguments[instruction.native.param2] = std::make_pair(instruction.operands[instruction.nativeOperands[2]], opCode == OP_CopyData4ROR ? 4 : 1);
+      }
+      else if(opCode != OP_CallUnprep)
+        return false;
+
+      parameterInstructions.push_back(id);
+      ++found;
+    }
+  }
+
+  return found == uses[parameters];
+}
+
+bool Inliner::PassesParameters(SSAFunction &callee, std::map<INT32, std::pair<INT32, INT32>> &arguments)
+{
+  for(auto &instruction : callee.instructions)
+  {
+    if(instruction.removed || instruction.operation != SO_Param)
+      continue;
+
+    auto argument = arguments.find(instruction.constant);
+    if(argument == arguments.end() || argument->second.second != (instruction.type == SVT_Bool ? 1 : 4))
+      return false;
+  }
+
+  return true;
+}
+
+bool Inliner::InlineCall(SSAFunction &function, INT32 call, SSAFunction &callee)
+{
+  std::vector<SSAInstruction> &instructions = function.instructions;
+  std::vector<SSABlock> &blocks = function.blocks;
+
+  // values copied into parameter memory, by offset. value and size
+  std::map<INT32, std::pair<INT32, INT32>> arguments;
+  std::vector<INT32> parameterInstructions; // CallPrep, CopyData and CallUnprep of the call
+
+  std::vector<INT32> uses;
+  function.CountUses(uses);
+
+  if(!FindArguments(function, call, uses, arguments, parameterInstructions) || !PassesParameters(callee, arguments))
+    return false;
+
+  // a tail call ends its block, returns of the callee stay returns of the function
+  bool tail = instructions[call].native.opCode == OP_TailCall;
+
+  // a return without a value leaves the return register as it is, only fine if nothing reads it
+  bool returnsValue = true;
+  for(auto &block : callee.blocks)
+  {
+    if(block.removed || block.terminator != TK_Return)
+      continue;
+
+    bool copiesValue = false;
+    for(auto id : block.instructions)
+    {
+      const SSAInstruction &instruction = callee.instructions[id];
+      if(instruction.operation == SO_Native && (instruction.native.opCode == OP_CopyiXR || instruction.native.opCode == OP_TailCall))
+        copiesValue = true;
+    }
+    returnsValue &= copiesValue;
+  }
+  if(!returnsValue && uses[call] > 0)
+    return false;
+
+  for(auto id : parameterInstructions)
+    instructions[id].removed = true;
+
+  // instructions after the call move to a block of their own, returns of the callee jump there
+  INT32 callBlock = instructions[call].block;
+  INT32 continuation = -1;
+  if(tail)
+  {
+    SSABlock &block = blocks[callBlock];
+    block.instructions.pop_back();
+    block.terminator = TK_Jump;
+  }
+  else
+  {
+    continuation = (INT32)blocks.size();
+    blocks.emplace_back();
+
+    SSABlock &block = blocks[callBlock];
+    SSABlock &after = blocks[continuation];
+
+    auto position = std::find(block.instructions.begin(), block.instructions.end(), call);
+    after.instructions.assign(position + 1, block.instructions.end());
+    block.instructions.erase(position, block.instructions.end());
+
+    after.terminator = block.terminator;
+    after.conditions[0] = block.conditions[0];
+    after.conditions[1] = block.conditions[1];
+    after.successors.swap(block.successors);
+
+    block.terminator = TK_Jump;
+    block.conditions[0] = block.conditions[1] = -1;
+
+    for(auto id : after.instructions)
+      instructions[id].block = continuation;
+
+    for(auto successor : after.successors)
+      for(auto &predecessor : blocks[successor].predecessors)
+        if(predecessor == callBlock)
+          predecessor = continuation;
+  }
+
+  for(auto &block : blocks)
+  {
+    auto end = std::remove_if(block.instructions.begin(), block.instructions.end(), [&](INT32 id) { return instructions[id].removed; });
+    block.instructions.erase(end, block.instructions.end());
+  }
+
+  // copy of the callee, parameters are replaced with the arguments
+  INT32 valueOffset = (INT32)instructions.size();
+  INT32 blockOffset = (INT32)blocks.size();
+
+  auto MapValue = [&](INT32 value) -> INT32
+  {
+    if(value == -1)
+      return -1;
+    const SSAInstruction &instruction = callee.instructions[value];
+    if(instruction.operation == SO_Param)
+      return arguments[instruction.constant].first;
+    return value + valueOffset;
+  };
+
+  for(auto &instruction : callee.instructions)
+  {
+    instructions.push_back(instruction);
+    SSAInstruction &copy = instructions.back();
+    copy.block += blockOffset;
+    for(auto &operand : copy.operands)
+      operand = MapValue(operand);
+    if(copy.operation == SO_Param)
+      copy.removed = true;
+  }
+
+  // value each return of the callee gives, -1 if it does not give one
+  std::vector<INT32> returnValues;
+
+  for(auto &calleeBlock : callee.blocks)
+  {
+    blocks.push_back(calleeBlock);
+    INT32 b = (INT32)blocks.size() - 1;
+    SSABlock &block = blocks.back();
+
+    for(auto &predecessor : block.predecessors)
+      predecessor += blockOffset;
+    for(auto &successor : block.successors)
+      successor += blockOffset;
+    block.conditions[0] = MapValue(block.conditions[0]);
+    block.conditions[1] = MapValue(block.conditions[1]);
+    block.immediateDominator = -1;
+    block.dominated.clear();
+
+    INT32 returnValue = -1;
+    for(auto &id : block.instructions)
+    {
+      id += valueOffset;
+      SSAInstruction &instruction = instructions[id];
+      if(instruction.operation != SO_Native)
+        continue;
+
+      // caller's frame is used, returning is jumping to the continuation
+      switch(instruction.native.opCode)
+      {
+      case OP_CopyiXR:
+        returnValue = instruction.operands[0];
+        // fall through
+      case OP_DAllocL:
+      case OP_Return:
+        instruction.removed = !tail;
+        break;
+      case OP_AllocL:
+        instruction.removed = true;
+        break;
+      case OP_TailCall:
+        // returns the value of an ordinary call unless the caller returns too
+        if(!tail)
+        {
+          instruction.native = Instruction(OP_Call, instruction.native.param1, 0, 0);
+          instruction.nativeOperands[1] = -1;
+          instruction.nativeOperands[2] = 0;
+          instruction.type = SVT_Int;
+          instruction.hasValue = true;
+          returnValue = id;
+        }
+        break;
+      default:
+        break;
+      }
+    }
+
+    auto end = std::remove_if(block.instructions.begin(), block.instructions.end(), [&](INT32 id) { return instructions[id].removed; });
+    block.instructions.erase(end, block.instructions.end());
+
+    if(!block.removed && block.terminator == TK_Return && !tail)
+    {
+      block.terminator = TK_Jump;
+      block.successors.push_back(continuation);
+      blocks[continuation].predecessors.push_back(b);
+      returnValues.push_back(returnValue);
+    }
+  }
+
+  blocks[callBlock].successors.push_back(blockOffset);
+  blocks[blockOffset].predecessors.push_back(callBlock);
+
+  // call's value is the value returned, a phi if there is more than one return
+  INT32 result = -1;
+  if(uses[call] > 0)
+  {
+    if(returnValues.size() == 1)
+      result = returnValues[0];
+    else if(!returnValues.empty())
+    {
+      result = (INT32)instructions.size();
+      instructions.emplace_back(SO_Phi, SVT_Int, continuation);
+      instructions.back().operands = returnValues;
+      blocks[continuation].instructions.insert(blocks[continuation].instructions.begin(), result);
+    }
+    else
+      result = function.AddConstant(0, SVT_Int); // callee never returns
+  }
+
+  instructions[call].removed = true;
+
+  if(result != -1)
+  {
+    for(auto &block : blocks)
+    {
+      if(block.removed)
+        continue;
+
+      for(auto id : block.instructions)
+        for(auto &operand : instructions[id].operands)
+          if(operand == call)
+            operand = result;
+
+      for(auto &condition : block.conditions)
+        if(condition == call)
+          condition = result;
+    }
+  }
+
+  // callee's blocks go between the call and the instructions after it
+  auto position = std::find(function.layout.begin(), function.layout.end(), callBlock) + 1;
+  std::vector<INT32> inserted;
+  for(auto b : callee.layout)
+    inserted.push_back(b + blockOffset);
+  if(!tail)
+    inserted.push_back(continuation);
+  function.layout.insert(position, inserted.begin(), inserted.end());
+
+  return true;
+}
+
+INT32 Inliner::RemoveSelfTailCalls(SSAFunction &function, INT32 functionId)
+{
+  std::vector<SSAInstruction> &instructions = function.instructions;
+
+  // locals in memory would have to be cleared again, like a new frame
+  for(auto &instruction : instructions)
+    if(!instruction.removed && (instruction.operation == SO_Load || instruction.operation == SO_Store))
+      return 0;
+
+  std::vector<INT32> uses;
+  function.CountUses(uses);
+
+  class TailCall
+  {
+  public:
+    INT32 block;
+    INT32 call;
+    std::map<INT32, std::pair<INT32, INT32>> arguments;
+    std::vector<INT32> parameterInstructions;
+  };
+  std::vector<TailCall> tailCalls;
+
+  for(INT32 b = 0; b < (INT32)function.blocks.size(); ++b)
+  {
+    SSABlock &block = function.blocks[b];
+    if(block.removed || block.terminator != TK_Return)
+      continue;
+
+    // the generator ends a block returning the value of a call with the tail call
+    INT32 call = block.instructions.empty() ? -1 : block.instructions.back();
+    if(call == -1 || instructions[call].operation != SO_Native || instructions[call].native.opCode != OP_TailCall || instructions[call].native.param1 != functionId)
+      continue;
+
+    TailCall tailCall;
+    tailCall.block = b;
+    tailCall.call = call;
+    if(FindArguments(function, call, uses, tailCall.arguments, tailCall.parameterInstructions) && PassesParameters(function, tailCall.arguments))
+      tailCalls.push_back(tailCall);
+  }
+
+  if(tailCalls.empty())
+    return 0;
+
+  // everything after the frame is allocated moves to a loop header
+  INT32 header = (INT32)function.blocks.size();
+  function.blocks.emplace_back();
+  SSABlock &entry = function.blocks[0];
+  SSABlock &loop = function.blocks[header];
+
+  std::vector<INT32> kept;
+  for(auto id : entry.instructions)
+  {
+    SSAInstruction &instruction = instructions[id];
+    if(instruction.operation == SO_Const || instruction.operation == SO_Param || (instruction.operation == SO_Native && instruction.native.opCode == OP_AllocL))
+      kept.push_back(id);
+    else
+    {
+      loop.instructions.push_back(id);
+      instruction.block = header;
+    }
+  }
+  entry.instructions.swap(kept);
+
+  loop.terminator = entry.terminator;
+  loop.conditions[0] = entry.conditions[0];
+  loop.conditions[1] = entry.conditions[1];
+  loop.successors.swap(entry.successors);
+  for(auto successor : loop.successors)
+    for(auto &predecessor : function.blocks[successor].predecessors)
+      if(predecessor == 0)
+        predecessor = header;
+
+  entry.terminator = TK_Jump;
+  entry.conditions[0] = entry.conditions[1] = -1;
+  entry.successors.push_back(header);
+  loop.predecessors.push_back(0);
+  function.layout.insert(std::find(function.layout.begin(), function.layout.end(), 0) + 1, header);
+
+  // each parameter becomes a phi, read in the entry block on the way in. tail calls give its next values
+  std::map<INT32, INT32> phiOfOffset, phiOf;
+  INT32 firstPhi = (INT32)instructions.size();
+  for(INT32 id = 0; id < firstPhi; ++id)
+  {
+    if(instructions[id].removed || instructions[id].operation != SO_Param)
+      continue;
+
+    INT32 offset = instructions[id].constant;
+    auto found = phiOfOffset.find(offset);
+    if(found != phiOfOffset.end())
+    {
+      phiOf[id] = found->second;
+      continue;
+    }
+
+    INT32 initial = id;
+    if(instructions[id].block != 0)
+    {
+      initial = (INT32)instructions.size();
+      instructions.emplace_back(SO_Param, instructions[id].type, 0);
+      instructions[initial].constant = offset;
+      function.blocks[0].instructions.push_back(initial);
+    }
+
+    INT32 phi = (INT32)instructions.size();
+    instructions.emplace_back(SO_Phi, instructions[id].type, header);
+    instructions[phi].operands.push_back(initial);
+    function.blocks[header].instructions.insert(function.blocks[header].instructions.begin(), phi);
+    phiOfOffset[offset] = phi;
+    phiOf[id] = phi;
+  }
+
+  auto Rename = [&](INT32 &value)
+  {
+    auto it = phiOf.find(value);
+    if(it != phiOf.end())
+      value = it->second;
+  };
+
+  for(auto &block : function.blocks)
+  {
+    if(block.removed)
+      continue;
+
+    for(auto id : block.instructions)
+      if(id < firstPhi)
+        for(auto &operand : instructions[id].operands)
+          Rename(operand);
+
+    for(auto &condition : block.conditions)
+      if(condition != -1)
+        Rename(condition);
+  }
+
+  for(auto &tailCall : tailCalls)
+  {
+    for(auto id : tailCall.parameterInstructions)
+      instructions[id].removed = true;
+
+    SSABlock &block = function.blocks[tailCall.block];
+    auto position = std::find(block.instructions.begin(), block.instructions.end(), tailCall.call);
+    for(auto it = position; it != block.instructions.end(); ++it)
+      if(instructions[*it].operation == SO_Native)
+        instructions[*it].removed = true;
+
+    block.terminator = TK_Jump;
+    block.successors.push_back(header);
+    function.blocks[header].predecessors.push_back(tailCall.block);
+
+    for(auto &parameter : phiOfOffset)
+    {
+      INT32 value = tailCall.arguments[parameter.first].first;
+      Rename(value);
+      instructions[parameter.second].operands.push_back(value);
+    }
+  }
+
+  for(auto &block : function.blocks)
+  {
+    auto end = std::remove_if(block.instructions.begin(), block.instructions.end(), [&](INT32 id) { return instructions[id].removed; });
+    block.instructions.erase(end, block.instructions.end());
+  }
+
+  return (INT32)tailCalls.size();
+}
+
+INT32 Inliner::Inline(SSAFunction &function, INT32 functionId)
+{
+  // call and the functions inlined to reach it, starting with the function itself
+  std::deque<std::pair<INT32, std::vector<INT32>>> work;
+
+  auto AddCalls = [&](INT32 first, const std::vector<INT32> &chain)
+  {
+    for(INT32 id = first; id < (INT32)function.instructions.size(); ++id)
+    {
+      SSAInstruction &instruction = function.instructions[id];
+      if(!instruction.removed && instruction.operation == SO_Native && (instruction.native.opCode == OP_Call || instruction.native.opCode == OP_TailCall))
+        work.emplace_back(id, chain);
+    }
+  };
+
+  AddCalls(0, std::vector<INT32>(1, functionId));
+
+  INT32 growth = 0;
+  INT32 inlined = 0;
+
+  while(!work.empty())
+  {
+    INT32 call = work.front().first;
+    std::vector<INT32> chain = work.front().second;
+    work.pop_front();
+
+    if(function.instructions[call].removed)
+      continue;
+
+    INT32 calleeId = function.instructions[call].native.param1;
+    if((INT32)chain.size() > maxDepth || std::count(chain.begin(), chain.end(), calleeId) >= maxRecursion + 1)
+      continue;
+
+    SSAFunction *callee = GetCallee(calleeId);
+    if(!callee)
+      continue;
+
+    INT32 size = GetSize(*callee);
+    if(growth + size > maxGrowth)
+      continue;
+
+    INT32 first = (INT32)function.instructions.size();
+    if(!InlineCall(function, call, *callee))
+      continue;
+
+    growth += size;
+    ++inlined;
+
+    chain.push_back(calleeId);
+    AddCalls(first, chain);
+  }
+
+  if(inlined > 0)
+    function.RemoveUnreachableBlocks();
+
+  return inlined;
+}
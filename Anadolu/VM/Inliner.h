@@ -0,0 +1,62 @@
+#pragma once
+
+#include "SSAFunction.h"
+
+#include <list>
+#include <map>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+// Copies bodies of small functions into their callers, in SSA form.
+// Parameters become the values the caller copies into parameter memory and returns become
+// jumps to the instructions after the call, a tail call keeps the callee's returns. A recursive function is inlined into itself a bounded
+// number of levels, its deepest copies keep calling it. Calls to itself in tail position become jumps
+class Inliner
+{
+private:
+
+  // instructions of every function as the generator gave them, by function id
+  const std::unordered_map<INT32, std::list<Instruction>> &bodies;
+
+  // optimized SSA form of functions that were asked for, nullptr if they can't be inlined
+  std::unordered_map<INT32, std::unique_ptr<SSAFunction>> callees;
+
+  SSAFunction *GetCallee(INT32 functionId);
+
+  // finds values copied into parameter memory of the call by offset, with their sizes, and the instructions handling that memory
+  static bool FindArguments(SSAFunction &function, INT32 call, std::vector<INT32> &uses, std::map<INT32, std::pair<INT32, INT32>> &arguments, std::vector<INT32> &parameterInstructions);
+
+  // parameter memory is not cleared by CallPrep, every parameter the callee reads has to be copied with the same size
+  static bool PassesParameters(SSAFunction &callee, std::map<INT32, std::pair<INT32, INT32>> &arguments);
+
+  // replaces the call with a copy of the callee, returns false if the call is left as it is
+  bool InlineCall(SSAFunction &function, INT32 call, SSAFunction &callee);
+
+public:
+
+  // callees bigger than this many instructions are not inlined
+  static const INT32 maxCalleeSize = 32;
+
+  // calls inside inlined bodies are inlined too, until this many levels
+  static const INT32 maxDepth = 3;
+
+  // times a function can appear in a chain of inlined calls, counting the function being optimized
+  static const INT32 maxRecursion = 1;
+
+  // instructions a function can grow by
+  static const INT32 maxGrowth = 256;
+
+  Inliner(const std::unordered_map<INT32, std::list<Instruction>> &_bodies) : bodies(_bodies) { }
+
+  // inlines calls of the function, returns number of inlined calls
+  INT32 Inline(SSAFunction &function, INT32 functionId);
+
+  // turns tail calls of the function to itself into a jump back to its start,
+  // with parameters given the values passed. returns number of calls removed
+  static INT32 RemoveSelfTailCalls(SSAFunction &function, INT32 functionId);
+
+  // instructions that will be generated, constants, parameters and phis are not counted
+  static INT32 GetSize(SSAFunction &function);
+
+};
@@ -2,6 +2,12 @@
 
 #include "Parser/PrimitiveTypes.h"
 
+// threaded dispatch needs "labels as values", only gcc and clang have it.
+// define ANADOLU_SWITCH_DISPATCH to use the portable switch loop instead
+#if !defined(ANADOLU_SWITCH_DISPATCH) && (defined(__GNUC__) || defined(__clang__))
+#define ANADOLU_THREADED_DISPATCH
+#endif
+
 enum OpCode
 {
   OP_NoOp,
@@ -35,6 +41,37 @@ enum OpCode
   // jump without any conditions
   OP_Jump,
 
+  // compare two INT32 values and jump if they are equal
+  // p1, p2: values to compare, kinds are given in the opcode name
+  // p3: number of instructions to be jumped over if equal, nothing is jumped over otherwise
+  // unlike JumpbR, registers are not cleared
+  OP_JumpEqiLC,
+  OP_JumpEqiPC,
+  OP_JumpEqiRC,
+  OP_JumpEqiLL,
+  OP_JumpEqiPL,
+  OP_JumpEqiPP,
+  OP_JumpEqiRR,
+  OP_JumpEqiRL,
+  OP_JumpEqiRP,
+
+  // same as JumpEqi family but jumps if values are not equal
+  OP_JumpNeiLC,
+  OP_JumpNeiPC,
+  OP_JumpNeiRC,
+  OP_JumpNeiLL,
+  OP_JumpNeiPL,
+  OP_JumpNeiPP,
+  OP_JumpNeiRR,
+  OP_JumpNeiRL,
+  OP_JumpNeiRP,
+
+  // ends a counted loop. adds one to an INT32 value and jumps back if it is not equal to the limit yet
+  // p1: value to increment, kind is given in the opcode name
+  // p2: limit
+  // p3: number of instructions to be jumped over if not equal
+  OP_IncJumpNeiLC,
+  OP_IncJumpNeiRC,
 
   // allocates parameter array
   // after OPCallPrep there are SetPL, SetPR calls. these set parameter values
@@ -50,8 +87,15 @@ enum OpCode
 
   // Recover from function call. unallocs memory reserver for parameters.
   // comes after OP_CallPrep and OP_Call
+  // p1: register number, address of the parameter memory
   OP_CallUnprep,
 
+  // calls a function in place of the running one, like OP_Call followed by returning its value.
+  // frame of the running function is popped and the called function returns to the running function's caller
+  // p1: function id
+  // p2: register number, contains address of the parameter memory. not read if the function has no parameters
+  OP_TailCall,
+
 
   // copies data in param3 register to address stored in register1. param2 is the offset
   // **((p1 + p2) = *p3
@@ -333,6 +377,16 @@ enum OpCode
   // p2: local bool address
   OP_CopybRL,
 
+  // store whole register (INT) to a local, used for spilled registers
+  // p1: local address, 8 byte aligned
+  // p2: register
+  OP_SpillLR,
+
+  // load whole register (INT) from a local, used for spilled registers
+  // p1: target register
+  // p2: local address, 8 byte aligned
+  OP_ReloadRL,
+
 
 
   OP_CmpbRPP,
@@ -424,9 +478,26 @@ enum OpCode
   OP_DiviRLP,
   OP_DiviRRP,
 
-  // ABOVE executing
+  // COROUTINES
+  // suspends a coroutine, it continues with the next instruction when it is resumed. does nothing elsewhere
+  OP_Yield,
+
+  // QUICKENED
+  // the interpreter rewrites generic instructions to these while running, after seeing what they work on.
+  // generators and optimizers work on bytecode before it runs and never see them, compilers may be given
+  // bytecode that has run and compile them like the generic instruction.
+  // parameters are the same as the generic instruction's, a quickened instruction whose assumption
+  // doesn't hold runs as its generic instruction
 
+  // OP_Call of a function that has native code
+  OP_CallNative,
+
+  // OP_Call of a function that is interpreted and doesn't go to a higher tier
+  OP_CallInterpreted,
+
+  // ABOVE executing
 
+  OP_NumOfOpCodes // not an instruction, keep it last
 };
 
 class Instruction
@@ -449,4 +520,25 @@ public:
 
   Instruction(OpCode _opCode, INT32 _param1 = 0, INT32 _param2 = 0, INT32 _param3 = 0) : opCode(_opCode), param1(_param1), param2(_param2), param3(_param3) {}
 
-};
\ No newline at end of file
+};
+
+// handler of an opcode in ExecutionContext::ExecuteInstructions.
+// address of its label with threaded dispatch, opcode of its case with switch dispatch
+#ifdef ANADOLU_THREADED_DISPATCH
+typedef const void *DispatchTarget;
+#else
+typedef OpCode DispatchTarget;
+#endif
+
+// an instruction decoded for the interpreter. registers are given as byte offsets in the frame, like locals
+class DecodedInstruction
+{
+public:
+
+  DispatchTarget handler;
+
+  INT32 param1;
+  INT32 param2;
+  INT32 param3;
+
+};
@@ -0,0 +1,253 @@
+#include "InstructionInfo.h"
+
+// shortcuts for operand descriptions
+// first letter: Register, Local, Param. second: Read, Write, read and write (X). last: width, int, bool, pointer
+static const OperandInfo N = { OT_None, OA_None, OW_Int32 };
+static const OperandInfo C = { OT_Const, OA_None, OW_Int32 };
+static const OperandInfo O = { OT_Offset, OA_None, OW_Int32 };
+static const OperandInfo F = { OT_Function, OA_None, OW_Int32 };
+static const OperandInfo S = { OT_Size, OA_None, OW_Int32 };
+
+static const OperandInfo RRi = { OT_Register, OA_Read, OW_Int32 };
+static const OperandInfo RWi = { OT_Register, OA_Write, OW_Int32 };
+static const OperandInfo RXi = { OT_Register, OA_ReadWrite, OW_Int32 };
+static const OperandInfo RRb = { OT_Register, OA_Read, OW_Byte };
+static const OperandInfo RWb = { OT_Register, OA_Write, OW_Byte };
+static const OperandInfo RXb = { OT_Register, OA_ReadWrite, OW_Byte };
+static const OperandInfo RRp = { OT_Register, OA_Read, OW_Pointer };
+static const OperandInfo RWp = { OT_Register, OA_Write, OW_Pointer };
+
+static const OperandInfo LRi = { OT_Local, OA_Read, OW_Int32 };
+static const OperandInfo LWi = { OT_Local, OA_Write, OW_Int32 };
+static const OperandInfo LXi = { OT_Local, OA_ReadWrite, OW_Int32 };
+static const OperandInfo LRb = { OT_Local, OA_Read, OW_Byte };
+static const OperandInfo LWb = { OT_Local, OA_Write, OW_Byte };
+static const OperandInfo LRp = { OT_Local, OA_Read, OW_Pointer };
+static const OperandInfo LWp = { OT_Local, OA_Write, OW_Pointer };
+
+static const OperandInfo PRi = { OT_Param, OA_Read, OW_Int32 };
+static const OperandInfo PWi = { OT_Param, OA_Write, OW_Int32 };
+static const OperandInfo PXi = { OT_Param, OA_ReadWrite, OW_Int32 };
+static const OperandInfo PRb = { OT_Param, OA_Read, OW_Byte };
+static const OperandInfo PWb = { OT_Param, OA_Write, OW_Byte };
+
+// operands must match what ExecutionContext does for the opcode, optimizers trust this table
+static InstructionInfo *CreateInstructionInfoTable()
+{
+  static InstructionInfo table[OP_NumOfOpCodes];
+
+  auto Set = [](OpCode opCode, const OperandInfo &p1 = N, const OperandInfo &p2 = N, const OperandInfo &p3 = N) -> InstructionInfo&
+  {
+    InstructionInfo &info = table[opCode];
+    info.operands[0] = p1;
+    info.operands[1] = p2;
+    info.operands[2] = p3;
+    info.genericOpCode = opCode;
+
+    // jumps and writing to memory outside of registers
+    info.hasSideEffects = false;
+    for(auto &operand : info.operands)
+    {
+      if(operand.type == OT_Offset)
+        info.hasSideEffects = true;
+      if((operand.type == OT_Local || operand.type == OT_Param) && (operand.access & OA_Write))
+        info.hasSideEffects = true;
+    }
+
+    return info;
+  };
+
+  // blocks and frames
+  Set(OP_NoOp);
+  Set(OP_BStart);
+  Set(OP_AllocL, S, S, S).hasSideEffects = true;
+  Set(OP_DAllocL).hasSideEffects = true;
+  Set(OP_BEnd);
+
+  Set(OP_ResetR, RWi);
+
+  // jumps
+  // also clears the register, only the low byte counts as written
+  Set(OP_JumpbR, RXb, O, O);
+  Set(OP_Jump, O);
+
+  Set(OP_JumpEqiLC, LRi, C, O);
+  Set(OP_JumpEqiPC, PRi, C, O);
+  Set(OP_JumpEqiRC, RRi, C, O);
+  Set(OP_JumpEqiLL, LRi, LRi, O);
+  Set(OP_JumpEqiPL, PRi, LRi, O);
+  Set(OP_JumpEqiPP, PRi, PRi, O);
+  Set(OP_JumpEqiRR, RRi, RRi, O);
+  Set(OP_JumpEqiRL, RRi, LRi, O);
+  Set(OP_JumpEqiRP, RRi, PRi, O);
+
+  Set(OP_JumpNeiLC, LRi, C, O);
+  Set(OP_JumpNeiPC, PRi, C, O);
+  Set(OP_JumpNeiRC, RRi, C, O);
+  Set(OP_JumpNeiLL, LRi, LRi, O);
+  Set(OP_JumpNeiPL, PRi, LRi, O);
+  Set(OP_JumpNeiPP, PRi, PRi, O);
+  Set(OP_JumpNeiRR, RRi, RRi, O);
+  Set(OP_JumpNeiRL, RRi, LRi, O);
+  Set(OP_JumpNeiRP, RRi, PRi, O);
+
+  Set(OP_IncJumpNeiLC, LXi, C, O);
+  Set(OP_IncJumpNeiRC, RXi, C, O);
+
+  // calls
+  Set(OP_CallPrep, RWp, S).hasSideEffects = true;
+  Set(OP_Call, F, RWi, RRp).hasSideEffects = true;
+  Set(OP_CallUnprep, RRp).hasSideEffects = true;
+  Set(OP_TailCall, F, RRp).hasSideEffects = true;
+  Set(OP_CopyData4ROR, RRp, C, RRi).hasSideEffects = true;
+  Set(OP_CopyData1ROR, RRp, C, RRb).hasSideEffects = true;
+  Set(OP_CopyData8ROR, RRp, C, RRp).hasSideEffects = true;
+
+  // parameter copies
+  Set(OP_CopyiLP, LWi, PRi);
+  Set(OP_CopybLP, LWb, PRb);
+  Set(OP_CopyiRP, RWi, PRi);
+  Set(OP_CopybRP, RWb, PRb);
+  Set(OP_CopyiPR, PWi, RRi);
+  Set(OP_CopybPR, PWb, RRb);
+  Set(OP_CopyiPL, PWi, LRi);
+  Set(OP_CopybPL, PWb, LRb);
+
+  // divide
+  Set(OP_DiviRLR, RWi, LRi, RRi);
+  Set(OP_DiviRRL, RWi, RRi, LRi);
+  Set(OP_DiviRRC, RWi, RRi, C);
+  Set(OP_DiviRCR, RWi, C, RRi);
+  Set(OP_DiviRLL, RWi, LRi, LRi);
+  Set(OP_DiviRLC, RWi, LRi, C);
+  Set(OP_DiviRCL, RWi, C, LRi);
+  Set(OP_DiviRRR, RWi, RRi, RRi);
+
+  Set(OP_NotbRR, RWb, RRb);
+
+  // multiply
+  Set(OP_MuliPC, PXi, C);
+  Set(OP_MuliRP, RXi, PRi);
+  Set(OP_MuliLP, LXi, PRi);
+  Set(OP_MuliRPR, RWi, PRi, RRi);
+  Set(OP_MuliRPC, RWi, PRi, C);
+  Set(OP_MuliRPL, RWi, PRi, LRi);
+  Set(OP_MuliRPP, RWi, PRi, PRi);
+  Set(OP_MuliRR, RXi, RRi);
+  Set(OP_MuliRL, RXi, LRi);
+  Set(OP_MuliRLL, RWi, LRi, LRi);
+  Set(OP_MuliRLC, RWi, LRi, C);
+  Set(OP_MuliRC, RXi, C);
+  Set(OP_MuliLC, LXi, C);
+
+  // add
+  Set(OP_AddiPR, PXi, RRi);
+  Set(OP_AddiPC, PXi, C);
+  Set(OP_AddiRP, RXi, PRi);
+  Set(OP_AddiRPL, RWi, PRi, LRi);
+  Set(OP_AddiRPR, RWi, PRi, RRi);
+  Set(OP_AddiRPC, RWi, PRi, C);
+  Set(OP_AddiRPP, RWi, PRi, PRi);
+  Set(OP_AddiRL, RXi, LRi);
+  Set(OP_AddiRRR, RWi, RRi, RRi);
+  Set(OP_AddiRLR, RWi, LRi, RRi);
+  Set(OP_AddiRLL, RWi, LRi, LRi);
+  Set(OP_AddiRLC, RWi, LRi, C);
+  Set(OP_AddiRRC, RWi, RRi, C);
+  Set(OP_AddiLR, LXi, RRi);
+  Set(OP_AddiRR, RXi, RRi);
+  Set(OP_AddiLC, LXi, C);
+  Set(OP_AddiRC, RXi, C);
+
+  // subtract
+  Set(OP_SubiRP, RXi, PRi);
+  Set(OP_SubiPP, PXi, PRi);
+  Set(OP_SubiPC, PXi, C);
+  Set(OP_SubiPL, PXi, LRi);
+  Set(OP_SubiRRP, RWi, RRi, PRi);
+  Set(OP_SubiRPR, RWi, PRi, RRi);
+  Set(OP_SubiRLP, RWi, LRi, PRi);
+  Set(OP_SubiRPL, RWi, PRi, LRi);
+  Set(OP_SubiRPC, RWi, PRi, C);
+  Set(OP_SubiRCP, RWi, C, PRi);
+  Set(OP_SubiRPP, RWi, PRi, PRi);
+  Set(OP_SubiRLL, RWi, LRi, LRi);
+  Set(OP_SubiRCL, RWi, C, LRi);
+  Set(OP_SubiRLC, RWi, LRi, C);
+  Set(OP_SubiRRR, RWi, RRi, RRi);
+  Set(OP_SubiRLR, RWi, LRi, RRi);
+  Set(OP_SubiRRL, RWi, RRi, LRi);
+  Set(OP_SubiRCR, RWi, C, RRi);
+  Set(OP_SubiRRC, RWi, RRi, C);
+  Set(OP_SubiRC, RXi, C);
+  Set(OP_SubiRR, RXi, RRi);
+  Set(OP_SubiRL, RXi, LRi);
+  Set(OP_SubiLR, LXi, RRi);
+
+  // copies
+  Set(OP_CopyiRC, RWi, C);
+  Set(OP_CopyiRR, RWi, RRi);
+  Set(OP_CopyiRL, RWi, LRi);
+  Set(OP_CopyiLR, LWi, RRi);
+  Set(OP_CopyiXR, RRi).hasSideEffects = true; // writes return value
+  Set(OP_CopybRR, RWb, RRb);
+  Set(OP_CopybLR, LWb, RRb);
+  Set(OP_CopybRC, RWb, C);
+  Set(OP_CopybRL, RWb, LRb);
+  Set(OP_SpillLR, LWp, RRp);
+  Set(OP_ReloadRL, RWp, LRp);
+
+  // compare, result is a bool
+  Set(OP_CmpbRPP, RWb, PRb, PRb);
+  Set(OP_CmpbRPL, RWb, PRb, LRb);
+  Set(OP_CmpbRPR, RWb, PRb, RRb);
+  Set(OP_CmpbRPC, RWb, PRb, C);
+  Set(OP_CmpiRPP, RWb, PRi, PRi);
+  Set(OP_CmpiRPL, RWb, PRi, LRi);
+  Set(OP_CmpiRPR, RWb, PRi, RRi);
+  Set(OP_CmpiRPC, RWb, PRi, C);
+  Set(OP_CmpbRC, RXb, LRb);
+  Set(OP_CmpbRLL, RWb, LRb, LRb);
+  Set(OP_CmpbRRR, RWb, RRb, RRb);
+  Set(OP_CmpbRLC, RWb, LRb, C);
+  Set(OP_CmpbRCR, RWb, C, RRb);
+  Set(OP_CmpbRLR, RWb, LRb, RRb);
+  Set(OP_CmpiRLL, RWb, LRi, LRi);
+  Set(OP_CmpiRLC, RWb, LRi, C);
+  Set(OP_CmpiRRR, RWb, RRi, RRi);
+  Set(OP_CmpiRCR, RWb, C, RRi);
+  Set(OP_CmpiRLR, RWb, LRi, RRi);
+
+  Set(OP_Return).hasSideEffects = true;
+
+  // divide
+  Set(OP_DiviRP, RXi, PRi);
+  Set(OP_DiviLP, LXi, PRi);
+  Set(OP_DiviPP, PXi, PRi);
+  Set(OP_DiviPC, PXi, C);
+  Set(OP_DiviPR, PXi, RRi);
+  Set(OP_DiviPL, PXi, LRi);
+  Set(OP_DiviRPC, RWi, PRi, C);
+  Set(OP_DiviRPL, RWi, PRi, LRi);
+  Set(OP_DiviRPP, RWi, PRi, PRi);
+  Set(OP_DiviRPR, RWi, PRi, RRi);
+  Set(OP_DiviRCP, RWi, C, PRi);
+  Set(OP_DiviRLP, RWi, LRi, PRi);
+  Set(OP_DiviRRP, RWi, RRi, PRi);
+
+  Set(OP_Yield).hasSideEffects = true;
+
+  // quickened
+  Set(OP_CallNative, F, RWi, RRp).hasSideEffects = true;
+  table[OP_CallNative].genericOpCode = OP_Call;
+  Set(OP_CallInterpreted, F, RWi, RRp).hasSideEffects = true;
+  table[OP_CallInterpreted].genericOpCode = OP_Call;
+
+  return table;
+}
+
+const InstructionInfo &GetInstructionInfo(OpCode opCode)
+{
+  static InstructionInfo *table = CreateInstructionInfoTable();
+  return table[opCode];
+}
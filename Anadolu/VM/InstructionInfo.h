@@ -0,0 +1,72 @@
+#pragma once
+
+#include "Instruction.h"
+
+// what a parameter of an instruction refers to
+enum OperandType
+{
+  OT_None, // parameter is not used
+  OT_Const, // constant value
+  OT_Register,
+  OT_Local,
+  OT_Param,
+  OT_Offset, // relative jump offset, target = index + offset + 1
+  OT_Function, // function id
+  OT_Size // number of bytes
+};
+
+// how an instruction uses a register, local or parameter
+enum OperandAccess
+{
+  OA_None = 0,
+  OA_Read = 1,
+  OA_Write = 2,
+  OA_ReadWrite = OA_Read | OA_Write
+};
+
+// how many bytes are read or written
+enum OperandWidth
+{
+  OW_Byte, // bools
+  OW_Int32,
+  OW_Pointer // whole INT, memory addresses
+};
+
+class OperandInfo
+{
+public:
+
+  OperandType type;
+  OperandAccess access;
+  OperandWidth width;
+
+};
+
+// describes what an instruction does with its parameters, used by bytecode optimizers
+class InstructionInfo
+{
+public:
+
+  OperandInfo operands[3];
+
+  // instruction does more than writing its register operands (memory, frames, control flow)
+  // it can't be removed even if nobody reads its results
+  bool hasSideEffects;
+
+  // instruction a quickened instruction was rewritten from, the opcode itself for the others
+  OpCode genericOpCode;
+
+  bool IsJump() const
+  {
+    return operands[0].type == OT_Offset || operands[1].type == OT_Offset || operands[2].type == OT_Offset;
+  }
+
+};
+
+const InstructionInfo &GetInstructionInfo(OpCode opCode);
+
+// returns parameter p (0, 1, 2) of the instruction
+inline INT32 &GetInstructionParam(Instruction &instruction, INT32 p)
+{
+  return p == 0 ? instruction.param1 : (p == 1 ? instruction.param2 : instruction.param3);
+}
@@ -0,0 +1,486 @@
+#include "InstructionSelector.h"
+#include "BytecodeAnalysis.h"
+
+#include <map>
+#include <algorithm>
+
+// opcode doing the operation with the given parameter kinds, OP_NumOfOpCodes if there is none.
+// a two address opcode reads its first parameter as the first source
+static OpCode FindOpCode(SSAOperation operation, SSAValueType type, bool twoAddress, OperandType p1, OperandType p2, OperandType p3)
+{
+  static const std::map<std::vector<INT32>, OpCode> table = []()
+  {
+    std::map<std::vector<INT32>, OpCode> opCodes;
+    for(INT32 i = 0; i < OP_NumOfOpCodes; ++i)
+    {
+      SSAOperation opOperation;
+      SSAValueType opType;
+      OpCode opCode = (OpCode)i;
+      if(opCode == OP_ResetR || !GetSSAOperation(opCode, opOperation, opType))
+        continue;
+
+      const InstructionInfo &info = GetInstructionInfo(opCode);
+      bool opTwoAddress = (info.operands[0].access & OA_Read) != 0;
+      std::vector<INT32> key = { opOperation, opType, opTwoAddress, info.operands[0].type, info.operands[1].type, info.operands[2].type };
+      opCodes.insert(std::make_pair(key, opCode));
+    }
+    return opCodes;
+  }();
+
+  std::vector<INT32> key = { operation, type, twoAddress, p1, p2, p3 };
+  auto it = table.find(key);
+  return it == table.end() ? OP_NumOfOpCodes : it->second;
+}
+
+// JumpEqi or JumpNei opcode comparing the given kinds, OP_NumOfOpCodes if there is none
+static OpCode FindJumpOpCode(bool jumpIfEqual, OperandType a, OperandType b)
+{
+  OpCode first = jumpIfEqual ? OP_JumpEqiLC : OP_JumpNeiLC;
+  OpCode last = jumpIfEqual ? OP_JumpEqiRP : OP_JumpNeiRP;
+  for(INT32 i = first; i <= last; ++i)
+  {
+    const InstructionInfo &info = GetInstructionInfo((OpCode)i);
+    if(info.operands[0].type == a && info.operands[1].type == b)
+      return (OpCode)i;
+  }
+  return OP_NumOfOpCodes;
+}
+
+void InstructionSelector::AddJump(OpCode opCode, INT32 target, Operand a, Operand b)
+{
+  if(opCode == OP_Jump)
+  {
+    fixups.emplace_back(code.size(), 0);
+    code.emplace_back(opCode, target);
+  }
+  else
+  {
+    // fused compare and jump
+    fixups.emplace_back(code.size(), 2);
+    code.emplace_back(opCode, a.value, b.value, target);
+  }
+}
+
+void InstructionSelector::SplitCriticalEdges()
+{
+  // phi copies of an edge can't go to the end of a predecessor that has other successors
+  for(INT32 b = 0; b < (INT32)function->blocks.size(); ++b)
+  {
+    if(function->blocks[b].removed || function->blocks[b].successors.size() < 2)
+      continue;
+
+    INT32 inserted = 0;
+    for(INT32 j = 0; j < (INT32)function->blocks[b].successors.size(); ++j)
+    {
+      INT32 successor = function->blocks[b].successors[j];
+      std::vector<INT32> &successorInstructions = function->blocks[successor].instructions;
+      if(successorInstructions.empty() || function->instructions[successorInstructions[0]].operation != SO_Phi)
+        continue;
+
+      INT32 k = function->GetPredecessorIndex(b, j);
+      INT32 split = (INT32)function->blocks.size();
+      function->blocks.emplace_back();
+
+      SSABlock &block = function->blocks[split];
+      block.terminator = TK_Jump;
+      block.successors.push_back(successor);
+      block.predecessors.push_back(b);
+      function->blocks[b].successors[j] = split;
+      function->blocks[successor].predecessors[k] = split;
+
+      auto position = std::find(function->layout.begin(), function->layout.end(), b);
+      function->layout.insert(position + 1 + inserted, split);
+      ++inserted;
+    }
+  }
+}
+
+void InstructionSelector::FoldLoads()
+{
+  std::vector<SSAInstruction> &instructions = function->instructions;
+
+  for(auto &block : function->blocks)
+  {
+    if(block.removed)
+      continue;
+
+    for(size_t i = 0; i < block.instructions.size(); ++i)
+    {
+      INT32 load = block.instructions[i];
+      if(instructions[load].operation != SO_Load || uses[load] != 1 || instructions[load].type == SVT_Pointer)
+        continue;
+
+      // memory must not change before the reader runs
+      bool folded = false;
+      size_t j = i + 1;
+      for(; j < block.instructions.size(); ++j)
+      {
+        SSAInstruction &reader = instructions[block.instructions[j]];
+        if(std::find(reader.operands.begin(), reader.operands.end(), load) != reader.operands.end())
+        {
+          folded = reader.operation != SO_Phi && reader.operation != SO_Native;
+          break;
+        }
+        if(reader.operation == SO_Store)
+          break;
+      }
+
+      if(j == block.instructions.size())
+        folded = block.conditions[0] == load || block.conditions[1] == load;
+
+      if(folded)
+        operands[load] = Operand(instructions[load].memory, instructions[load].constant);
+    }
+  }
+}
+
+bool InstructionSelector::ToRegister(Operand &operand, SSAValueType type)
+{
+  if(operand.type == OT_Register)
+    return true;
+
+  Operand target(OT_Register, NewRegister());
+  if(!Emit(SO_Copy, type, target, operand))
+    return false;
+
+  operand = target;
+  return true;
+}
+
+bool InstructionSelector::Emit(SSAOperation operation, SSAValueType type, Operand target, Operand a, Operand b)
+{
+  bool commutative = operation == SO_Add || operation == SO_Mul || operation == SO_Equal;
+  bool unary = b.type == OT_None;
+
+  // dividing by 0 gives 0, opcodes dividing by a constant don't check it
+  if(operation == SO_Div && b.type == OT_Const && b.value == 0)
+    return Emit(SO_Copy, SVT_Int, target, Operand(OT_Const, 0));
+
+  for(INT32 attempt = 0; attempt < 2; ++attempt)
+  {
+    OpCode opCode = FindOpCode(operation, type, false, target.type, a.type, b.type);
+    if(opCode != OP_NumOfOpCodes)
+    {
+      code.emplace_back(opCode, target.value, a.value, b.value);
+      return true;
+    }
+
+    if(unary)
+    {
+      if(attempt == 0 && a.type != OT_Register && ToRegister(a, type))
+        continue;
+      return false;
+    }
+
+    if(commutative && (opCode = FindOpCode(operation, type, false, target.type, b.type, a.type)) != OP_NumOfOpCodes)
+    {
+      code.emplace_back(opCode, target.value, b.value, a.value);
+      return true;
+    }
+
+    // two address forms, target is the first source
+    for(INT32 swap = 0; swap < (commutative ? 2 : 1); ++swap)
+    {
+      Operand first = swap ? b : a, second = swap ? a : b;
+      opCode = FindOpCode(operation, type, true, target.type, second.type, OT_None);
+      if(opCode == OP_NumOfOpCodes || second == target)
+        continue;
+
+      if(first != target)
+      {
+        if(target.type != OT_Register || !Emit(SO_Copy, type, target, first))
+          continue;
+      }
+
+      code.emplace_back(opCode, target.value, second.value);
+      return true;
+    }
+
+    if(attempt == 0)
+    {
+      bool changed = a.type != OT_Register || b.type != OT_Register;
+      if(!changed || !ToRegister(a, type) || !ToRegister(b, type))
+        return false;
+    }
+  }
+
+  return false;
+}
+
+bool InstructionSelector::EmitNative(INT32 value)
+{
+  SSAInstruction &native = function->instructions[value];
+  Instruction instruction = native.native;
+  const InstructionInfo &info = GetInstructionInfo(instruction.opCode);
+
+  for(INT32 p = 0; p < 3; ++p)
+  {
+    if(native.nativeOperands[p] != -1)
+    {
+      Operand operand = operands[native.operands[native.nativeOperands[p]]];
+      OperandWidth width = info.operands[p].width;
+      if(operand.type != OT_Register && (width == OW_Pointer || !ToRegister(operand, width == OW_Byte ? SVT_Bool : SVT_Int)))
+        return false;
+      GetInstructionParam(instruction, p) = operand.value;
+    }
+
+    if(native.hasValue && info.operands[p].type == OT_Register && (info.operands[p].access & OA_Write))
+      GetInstructionParam(instruction, p) = operands[value].value;
+  }
+
+  code.push_back(instruction);
+  return true;
+}
+
+bool InstructionSelector::EmitBlock(INT32 b, INT32 next)
+{
+  SSABlock &block = function->blocks[b];
+  std::vector<SSAInstruction> &instructions = function->instructions;
+
+  for(size_t i = 0; i < block.instructions.size(); ++i)
+  {
+    INT32 id = block.instructions[i];
+    SSAInstruction &instruction = instructions[id];
+
+    switch(instruction.operation)
+    {
+    case SO_Const:
+    case SO_Param:
+    case SO_Phi:
+      break;
+
+    case SO_Load:
+      if(operands[id].type == OT_Register && !Emit(SO_Copy, instruction.type, operands[id], Operand(instruction.memory, instruction.constant)))
+        return false;
+      break;
+
+    case SO_Store:
+      if(!Emit(SO_Copy, instruction.type, Operand(instruction.memory, instruction.constant), operands[instruction.operands[0]]))
+        return false;
+      break;
+
+    case SO_Native:
+      if(!EmitNative(id))
+        return false;
+      break;
+
+    default:
+      {
+        Operand a = operands[instruction.operands[0]];
+        Operand b = instruction.operands.size() > 1 ? operands[instruction.operands[1]] : Operand();
+
+        // local = local + x is done in place when the sum is only stored back
+        if(i + 1 < block.instructions.size() && uses[id] == 1 && b.type != OT_None)
+        {
+          SSAInstruction &store = instructions[block.instructions[i + 1]];
+          Operand memory(store.memory, store.constant);
+          if(store.operation == SO_Store && store.operands[0] == id && store.type == instruction.type)
+          {
+            bool commutative = instruction.operation == SO_Add || instruction.operation == SO_Mul;
+            Operand other = a == memory ? b : (commutative && b == memory ? a : Operand());
+            OpCode opCode = other.type == OT_None ? OP_NumOfOpCodes : FindOpCode(instruction.operation, instruction.type, true, memory.type, other.type, OT_None);
+
+            // opcodes dividing by a constant don't check for 0
+            if(opCode != OP_NumOfOpCodes && !(instruction.operation == SO_Div && other.type == OT_Const && other.value == 0))
+            {
+              code.emplace_back(opCode, memory.value, other.value);
+              ++i;
+              break;
+            }
+          }
+        }
+
+        if(!Emit(instruction.operation, instruction.type, operands[id], a, b))
+          return false;
+      }
+      break;
+    }
+  }
+
+  return EmitPhiCopies(b) && EmitTerminator(b, next);
+}
+
+bool InstructionSelector::EmitPhiCopies(INT32 b)
+{
+  SSABlock &block = function->blocks[b];
+
+  // each copy is target, source and type
+  class PhiCopy
+  {
+  public:
+    Operand target;
+    Operand source;
+    SSAValueType type;
+  };
+
+  std::vector<PhiCopy> copies;
+  for(INT32 j = 0; j < (INT32)block.successors.size(); ++j)
+  {
+    SSABlock &successor = function->blocks[block.successors[j]];
+    for(auto id : successor.instructions)
+    {
+      SSAInstruction &phi = function->instructions[id];
+      if(phi.operation != SO_Phi)
+        break;
+
+      // critical edges are split already
+      if(block.successors.size() > 1 || phi.type == SVT_Pointer)
+        return false;
+
+      PhiCopy copy = { operands[id], operands[phi.operands[function->GetPredecessorIndex(b, j)]], phi.type };
+      if(copy.target != copy.source)
+        copies.push_back(copy);
+    }
+  }
+
+  // copies happen at once, a target can't be written while another copy still reads it
+  while(!copies.empty())
+  {
+    bool emitted = false;
+    for(size_t i = 0; i < copies.size(); ++i)
+    {
+      bool isRead = false;
+      for(size_t j = 0; j < copies.size(); ++j)
+        if(j != i && copies[j].source == copies[i].target)
+          isRead = true;
+      if(isRead)
+        continue;
+
+      if(!Emit(SO_Copy, copies[i].type, copies[i].target, copies[i].source))
+        return false;
+      copies.erase(copies.begin() + i);
+      emitted = true;
+      break;
+    }
+
+    if(emitted)
+      continue;
+
+    // every target is read by another copy, break the cycle with a temporary
+    Operand temporary(OT_Register, NewRegister());
+    Operand cycle = copies[0].target;
+    if(!Emit(SO_Copy, copies[0].type, temporary, cycle))
+      return false;
+    for(auto &copy : copies)
+      if(copy.source == cycle)
+        copy.source = temporary;
+  }
+
+  return true;
+}
+
+bool InstructionSelector::EmitTerminator(INT32 b, INT32 next)
+{
+  SSABlock &block = function->blocks[b];
+
+  switch(block.terminator)
+  {
+  case TK_Jump:
+    if(block.successors[0] != next)
+      AddJump(OP_Jump, block.successors[0]);
+    return true;
+
+  case TK_Return:
+    return true;
+
+  case TK_Branch:
+    {
+      // JumpbR clears the register, it must not be read again
+      Operand condition = operands[block.conditions[0]];
+      if(condition.type != OT_Register || uses[block.conditions[0]] > 1)
+      {
+        Operand copy(OT_Register, NewRegister());
+        if(!Emit(SO_Copy, SVT_Bool, copy, condition))
+          return false;
+        condition = copy;
+      }
+
+      fixups.emplace_back(code.size(), 1);
+      fixups.emplace_back(code.size(), 2);
+      code.emplace_back(OP_JumpbR, condition.value, block.successors[0], block.successors[1]);
+    }
+    return true;
+
+  case TK_BranchEqual:
+    {
+      Operand a = operands[block.conditions[0]], c = operands[block.conditions[1]];
+      if(FindJumpOpCode(true, a.type, c.type) == OP_NumOfOpCodes)
+        std::swap(a, c);
+      if(FindJumpOpCode(true, a.type, c.type) == OP_NumOfOpCodes && !ToRegister(a, SVT_Int))
+        return false;
+      if(FindJumpOpCode(true, a.type, c.type) == OP_NumOfOpCodes)
+        return false;
+
+      if(block.successors[0] == next)
+        AddJump(FindJumpOpCode(false, a.type, c.type), block.successors[1], a, c);
+      else
+      {
+        AddJump(FindJumpOpCode(true, a.type, c.type), block.successors[0], a, c);
+        if(block.successors[1] != next)
+          AddJump(OP_Jump, block.successors[1]);
+      }
+    }
+    return true;
+  }
+
+  return false;
+}
+
+bool InstructionSelector::Select(SSAFunction &_function, std::list<Instruction> &instructions)
+{
+  function = &_function;
+  code.clear();
+  fixups.clear();
+  registerCount = 0;
+
+  SplitCriticalEdges();
+  function->CountUses(uses);
+
+  // constants and parameters are used in place, everything else gets a register of its own
+  operands.assign(function->instructions.size(), Operand());
+  for(auto &block : function->blocks)
+  {
+    if(block.removed)
+      continue;
+
+    for(auto id : block.instructions)
+    {
+      SSAInstruction &instruction = function->instructions[id];
+      if(instruction.operation == SO_Const)
+        operands[id] = Operand(OT_Const, instruction.constant);
+      else if(instruction.operation == SO_Param)
+        operands[id] = Operand(OT_Param, instruction.constant);
+      else if(instruction.hasValue)
+        operands[id] = Operand(OT_Register, NewRegister());
+    }
+  }
+
+  FoldLoads();
+
+  std::vector<INT32> order;
+  for(auto b : function->layout)
+    if(!function->blocks[b].removed)
+      order.push_back(b);
+
+  std::vector<INT32> blockStart(function->blocks.size(), 0);
+  for(size_t i = 0; i < order.size(); ++i)
+  {
+    blockStart[order[i]] = (INT32)code.size();
+    if(!EmitBlock(order[i], i + 1 < order.size() ? order[i + 1] : -1))
+      return false;
+  }
+
+  // frame must be allocated before anything else
+  if(code.empty() || code[0].opCode != OP_AllocL)
+    return false;
+
+  for(auto &fixup : fixups)
+  {
+    INT32 &target = GetInstructionParam(code[fixup.first], fixup.second);
+    target = blockStart[target];
+  }
+
+  ToRelativeTargets(code);
+  instructions.assign(code.begin(), code.end());
+  return true;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "SSAFunction.h"
+
+#include <list>
+#include <vector>
+
+// Turns a function in SSA form back into instructions with virtual registers.
+// Picks the opcode whose operand kinds fit the operands best, so constants, parameters and
+// locals read once are used in place instead of being copied into registers first.
+// Phis become copies at the end of predecessor blocks, critical edges get blocks of their own for them
+class InstructionSelector
+{
+private:
+
+  class Operand
+  {
+  public:
+
+    OperandType type; // OT_Register, OT_Const, OT_Local or OT_Param
+    INT32 value;
+
+    Operand(OperandType _type = OT_None, INT32 _value = 0) : type(_type), value(_value) { }
+
+    bool operator==(const Operand &other) const { return type == other.type && value == other.value; }
+    bool operator!=(const Operand &other) const { return !(*this == other); }
+
+  };
+
+  SSAFunction *function;
+
+  // jump offsets are block ids until every block is placed, then absolute instruction indices
+  std::vector<Instruction> code;
+
+  // jump parameters to patch, instruction index and parameter
+  std::vector<std::pair<size_t, INT32>> fixups;
+
+  // where each SSA value is found
+  std::vector<Operand> operands;
+
+  std::vector<INT32> uses;
+
+  INT32 registerCount;
+
+  INT32 NewRegister() { return registerCount++; }
+
+  void AddJump(OpCode opCode, INT32 target, Operand a = Operand(), Operand b = Operand());
+
+  void SplitCriticalEdges();
+
+  // places loads read once into the instruction reading them
+  void FoldLoads();
+
+  // emits target = operation(sources), returns false if no opcode can do it
+  bool Emit(SSAOperation operation, SSAValueType type, Operand target, Operand a, Operand b = Operand());
+
+  bool ToRegister(Operand &operand, SSAValueType type);
+
+  bool EmitBlock(INT32 block, INT32 next);
+  bool EmitNative(INT32 value);
+  bool EmitPhiCopies(INT32 block);
+  bool EmitTerminator(INT32 block, INT32 next);
+
+public:
+
+  InstructionSelector() : function(nullptr), registerCount(0) { }
+
+  // returns false if some value can't be lowered, instructions are left as they are then
+  bool Select(SSAFunction &_function, std::list<Instruction> &instructions);
+
+};
@@ -0,0 +1,675 @@
+#include "JITCompiler.h"
+#include "Bytecode.h"
+#include "ExecutionContext.h"
+
+#include <unordered_map>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef _WIN32
+const INT32 JITCompiler::argumentRegisters[] = { MR_CX, MR_DX, MR_R8, MR_R9 };
+#else
+const INT32 JITCompiler::argumentRegisters[] = { MR_DI, MR_SI, MR_DX, MR_CX };
+#endif
+
+JITCompiler::Operation JITCompiler::GetOperation(OpCode opCode)
+{
+  switch(opCode)
+  {
+  case OP_AddiPR: case OP_AddiPC: case OP_AddiRP: case OP_AddiRPL: case OP_AddiRPR: case OP_AddiRPC: case OP_AddiRPP:
+  case OP_AddiRL: case OP_AddiRRR: case OP_AddiRLR: case OP_AddiRLL: case OP_AddiRLC: case OP_AddiRRC: case OP_AddiLR:
+  case OP_AddiRR: case OP_AddiLC: case OP_AddiRC:
+    return JO_Add;
+
+  case OP_SubiRP: case OP_SubiPP: case OP_SubiPC: case OP_SubiPL: case OP_SubiRRP: case OP_SubiRPR: case OP_SubiRLP:
+  case OP_SubiRPL: case OP_SubiRPC: case OP_SubiRCP: case OP_SubiRPP: case OP_SubiRLL: case OP_SubiRCL: case OP_SubiRLC:
+  case OP_SubiRRR: case OP_SubiRLR: case OP_SubiRRL: case OP_SubiRCR: case OP_SubiRRC: case OP_SubiRC: case OP_SubiRR:
+  case OP_SubiRL: case OP_SubiLR:
+    return JO_Subtract;
+
+  case OP_MuliPC: case OP_MuliRP: case OP_MuliLP: case OP_MuliRPR: case OP_MuliRPC: case OP_MuliRPL: case OP_MuliRPP:
+  case OP_MuliRR: case OP_MuliRL: case OP_MuliRLL: case OP_MuliRLC: case OP_MuliRC: case OP_MuliLC:
+    return JO_Multiply;
+
+  case OP_DiviRLR: case OP_DiviRRL: case OP_DiviRRC: case OP_DiviRCR: case OP_DiviRLL: case OP_DiviRLC: case OP_DiviRCL:
+  case OP_DiviRRR: case OP_DiviRP: case OP_DiviLP: case OP_DiviPP: case OP_DiviPC: case OP_DiviPR: case OP_DiviPL:
+  case OP_DiviRPC: case OP_DiviRPL: case OP_DiviRPP: case OP_DiviRPR: case OP_DiviRCP: case OP_DiviRLP: case OP_DiviRRP:
+    return JO_Divide;
+
+  case OP_CopyiLP: case OP_CopybLP: case OP_CopyiRP: case OP_CopybRP: case OP_CopyiPR: case OP_CopybPR: case OP_CopyiPL:
+  case OP_CopybPL: case OP_CopyiRC: case OP_CopyiRR: case OP_CopyiRL: case OP_CopyiLR: case OP_CopybRR: case OP_CopybLR:
+  case OP_CopybRC: case OP_CopybRL: case OP_SpillLR: case OP_ReloadRL:
+    return JO_Copy;
+
+  case OP_CmpbRPP: case OP_CmpbRPL: case OP_CmpbRPR: case OP_CmpbRPC: case OP_CmpiRPP: case OP_CmpiRPL: case OP_CmpiRPR:
+  case OP_CmpiRPC: case OP_CmpbRC: case OP_CmpbRLL: case OP_CmpbRRR: case OP_CmpbRLC: case OP_CmpbRCR: case OP_CmpbRLR:
+  case OP_CmpiRLL: case OP_CmpiRLC: case OP_CmpiRRR: case OP_CmpiRCR: case OP_CmpiRLR:
+    return JO_Compare;
+
+  case OP_JumpEqiLC: case OP_JumpEqiPC: case OP_JumpEqiRC: case OP_JumpEqiLL: case OP_JumpEqiPL: case OP_JumpEqiPP:
+  case OP_JumpEqiRR: case OP_JumpEqiRL: case OP_JumpEqiRP:
+    return JO_JumpEqual;
+
+  case OP_JumpNeiLC: case OP_JumpNeiPC: case OP_JumpNeiRC: case OP_JumpNeiLL: case OP_JumpNeiPL: case OP_JumpNeiPP:
+  case OP_JumpNeiRR: case OP_JumpNeiRL: case OP_JumpNeiRP:
+    return JO_JumpNotEqual;
+
+  default:
+    return JO_None;
+  }
+}
+
+bool JITCompiler::CanCompile(FunctionBytecode *function, bool tailCalls)
+{
+  std::vector<Instruction> &instructions = function->optimizedInstructions;
+
+  // frame is allocated once, by the prologue
+  if(instructions.empty() || instructions[0].opCode != OP_AllocL)
+    return false;
+
+  for(INT32 i = 1; i < (INT32)instructions.size(); ++i)
+  {
+    Instruction &instruction = instructions[i];
+    switch(instruction.opCode)
+    {
+    case OP_NoOp: case OP_BStart: case OP_BEnd: case OP_DAllocL: case OP_ResetR:
+    case OP_CallPrep: case OP_CallUnprep: case OP_Call: case OP_CopyData4ROR: case OP_CopyData1ROR:
+    case OP_CallNative: case OP_CallInterpreted: // quickened if the bytecode has run before it is compiled
+    case OP_Jump: case OP_JumpbR: case OP_IncJumpNeiLC: case OP_IncJumpNeiRC:
+    case OP_NotbRR: case OP_CopyiXR: case OP_Return: case OP_Yield:
+      break;
+    case OP_TailCall:
+      if(!tailCalls)
+        return false;
+      break;
+    default:
+      if(GetOperation(instruction.opCode) == JO_None)
+        return false;
+    }
+
+    // jumps stay in the function and don't go back to the allocation
+    const InstructionInfo &info = GetInstructionInfo(instruction.opCode);
+    for(INT32 p = 0; p < 3; ++p)
+    {
+      if(info.operands[p].type != OT_Offset)
+        continue;
+
+      INT32 target = i + GetInstructionParam(instruction, p) + 1;
+      if(target <= 0 || target >= (INT32)instructions.size())
+        return false;
+    }
+  }
+
+  return true;
+}
+
+void JITCompiler::Emit32(INT32 value)
+{
+  for(INT32 i = 0; i < 4; ++i)
+    Emit8((value >> (i * 8)) & 0xFF);
+}
+
+void JITCompiler::Emit64(INT64 value)
+{
+  for(INT32 i = 0; i < 8; ++i)
+    Emit8((INT32)((value >> (i * 8)) & 0xFF));
+}
+
+void JITCompiler::EmitMemory(INT32 opCode, bool wide, INT32 reg, INT32 base, INT32 displacement)
+{
+  INT32 rex = (wide ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((base & 8) ? 1 : 0);
+  if(rex)
+    Emit8(0x40 | rex);
+
+  if(opCode > 0xFF)
+    Emit8(opCode >> 8);
+  Emit8(opCode & 0xFF);
+
+  // always a 32 bit displacement, rsp and r12 bases need a SIB byte
+  Emit8(0x80 | ((reg & 7) << 3) | (base & 7));
+  if((base & 7) == MR_SP)
+    Emit8(0x24);
+  Emit32(displacement);
+}
+
+void JITCompiler::EmitMoveRegister(INT32 target, INT32 source)
+{
+  Emit8(0x48 | ((source & 8) ? 4 : 0) | ((target & 8) ? 1 : 0));
+  Emit8(0x89);
+  Emit8(0xC0 | ((source & 7) << 3) | (target & 7));
+}
+
+void JITCompiler::EmitMoveConstant(INT32 target, INT64 value)
+{
+  // 32 bit values go to the low half, for addresses the whole register is written
+  if(value >= INT32_MIN && value <= INT32_MAX)
+  {
+    if(target & 8)
+      Emit8(0x41);
+    Emit8(0xB8 + (target & 7));
+    Emit32((INT32)value);
+  }
+  else
+  {
+    Emit8(0x48 | ((target & 8) ? 1 : 0));
+    Emit8(0xB8 + (target & 7));
+    Emit64(value);
+  }
+}
+
+INT32 JITCompiler::EmitJump(INT32 conditionCode)
+{
+  if(conditionCode == -1)
+    Emit8(0xE9);
+  else
+  {
+    Emit8(0x0F);
+    Emit8(0x80 | conditionCode);
+  }
+
+  INT32 position = (INT32)code.size();
+  Emit32(0);
+  return position;
+}
+
+void JITCompiler::SetOffset(INT32 position, INT32 target)
+{
+  INT32 offset = target - (position + 4);
+  memcpy(&code[position], &offset, 4);
+}
+
+void JITCompiler::EmitJumpToInstruction(INT32 target, INT32 conditionCode)
+{
+  Fixup fixup = { EmitJump(conditionCode), target };
+  jumpFixups.push_back(fixup);
+}
+
+void JITCompiler::GetAddress(const OperandInfo &operand, INT32 param, INT32 &base, INT32 &displacement)
+{
+  switch(operand.type)
+  {
+  case OT_Register:
+    base = MR_BX;
+    displacement = RegisterOffset(param);
+    break;
+  case OT_Local:
+    base = MR_BX;
+    displacement = param;
+    break;
+  default:
+    base = MR_R12;
+    displacement = param;
+  }
+}
+
+void JITCompiler::EmitLoad(INT32 reg, const OperandInfo &operand, INT32 param)
+{
+  if(operand.type == OT_Const)
+  {
+    EmitMoveConstant(reg, param);
+    return;
+  }
+
+  INT32 base, displacement;
+  GetAddress(operand, param, base, displacement);
+
+  if(operand.width == OW_Byte)
+    EmitMemory(0x0FBE, false, reg, base, displacement); // movsx
+  else
+    EmitMemory(0x8B, operand.width == OW_Pointer, reg, base, displacement);
+}
+
+void JITCompiler::EmitStore(INT32 reg, const OperandInfo &operand, INT32 param)
+{
+  INT32 base, displacement;
+  GetAddress(operand, param, base, displacement);
+
+  if(operand.width == OW_Byte)
+    EmitMemory(0x88, false, reg, base, displacement);
+  else
+    EmitMemory(0x89, operand.width == OW_Pointer, reg, base, displacement);
+}
+
+void JITCompiler::EmitPrologue(INT32 frameBytes, INT32 clearedBytes)
+{
+  // rbx: frame base, r12: parameters, r13: return value, r14: execution context
+  Emit8(0x53); // push rbx
+  Emit8(0x41); Emit8(0x54); // push r12
+  Emit8(0x41); Emit8(0x55); // push r13
+  Emit8(0x41); Emit8(0x56); // push r14
+
+  // return address and 4 pushes leave the stack 8 bytes off a 16 byte boundary
+  frameSize = ((shadowSpace + frameBytes + 15) & ~15) + 8;
+  Emit8(0x48); Emit8(0x81); Emit8(0xEC); Emit32(frameSize); // sub rsp, frameSize
+  EmitMemory(0x8D, true, MR_BX, MR_SP, shadowSpace); // lea rbx, [rsp + shadowSpace]
+
+  EmitMoveRegister(MR_R14, argumentRegisters[0]);
+  EmitMoveRegister(MR_R12, argumentRegisters[1]);
+  EmitMoveRegister(MR_R13, argumentRegisters[2]);
+
+  // locals and registers start cleared, like frames of the interpreter
+  Emit8(0x31); Emit8(0xC0); // xor eax, eax
+  EmitMoveConstant(MR_CX, clearedBytes / 8);
+  Emit8(0x48); Emit8(0x89); Emit8(0x44); Emit8(0xCB); Emit8(0xF8); // mov [rbx + rcx * 8 - 8], rax
+  Emit8(0xFF); Emit8(0xC9); // dec ecx
+  Emit8(0x75); Emit8(0xF7); // jnz back to the mov
+}
+
+void JITCompiler::EmitLeave()
+{
+  Emit8(0x48); Emit8(0x81); Emit8(0xC4); Emit32(frameSize); // add rsp, frameSize
+  Emit8(0x41); Emit8(0x5E); // pop r14
+  Emit8(0x41); Emit8(0x5D); // pop r13
+  Emit8(0x41); Emit8(0x5C); // pop r12
+  Emit8(0x5B); // pop rbx
+}
+
+void JITCompiler::EmitEpilogue()
+{
+  EmitLeave();
+  Emit8(0xC3); // ret
+}
+
+void JITCompiler::EmitCall(INT32 function, INT32 paramsRegister, INT32 returnRegister)
+{
+  const INT32 callDepth = (INT32)offsetof(ExecutionContext, callDepth);
+  const INT32 maxCallDepth = (INT32)offsetof(ExecutionContext, maxCallDepth);
+  const INT32 nativeDepth = (INT32)offsetof(ExecutionContext, nativeDepth);
+
+  // same limit as interpreted calls
+  EmitMemory(0x8B, true, MR_AX, MR_R14, callDepth);
+  EmitMemory(0x3B, true, MR_AX, MR_R14, maxCallDepth);
+  INT32 belowLimit = EmitJump(CC_NotEqual);
+  EmitMoveConstant(MR_AX, ExecutionContext::CallDepthExceeded);
+  EmitEpilogue();
+  PatchJump(belowLimit);
+  EmitMemory(0xFF, true, 0, MR_R14, callDepth); // inc
+
+  auto EmitReturnMemory = [this, returnRegister](INT32 reg)
+  {
+    if(returnRegister == -1)
+      EmitMoveRegister(reg, MR_R13);
+    else
+      EmitMemory(0x8D, true, reg, MR_BX, RegisterOffset(returnRegister));
+  };
+
+  INT32 called = -1;
+  auto nativeFunction = nativeFunctions.find(function);
+  if(compiledFunctions.count(function) || nativeFunction != nativeFunctions.end())
+  {
+    // machine stack is limited, deep recursion continues in the interpreter
+    EmitMemory(0x81, true, 7, MR_R14, nativeDepth);
+    Emit32(ExecutionContext::maxNativeDepth);
+    INT32 tooDeep = EmitJump(CC_GreaterOrEqual);
+
+    EmitMemory(0xFF, true, 0, MR_R14, nativeDepth);
+    EmitMoveRegister(argumentRegisters[0], MR_R14);
+    EmitMemory(0x8B, true, argumentRegisters[1], MR_BX, RegisterOffset(paramsRegister));
+    EmitReturnMemory(argumentRegisters[2]);
+    if(compiledFunctions.count(function))
+    {
+      Emit8(0xE8); // call
+      Fixup fixup = { (INT32)code.size(), function };
+      callFixups.push_back(fixup);
+      Emit32(0);
+    }
+    else
+    {
+      EmitMoveConstant(MR_AX, (INT64)nativeFunction->second);
+      Emit8(0xFF); Emit8(0xD0); // call rax
+    }
+    EmitMemory(0xFF, true, 1, MR_R14, nativeDepth); // dec
+
+    called = EmitJump();
+    PatchJump(tooDeep);
+  }
+
+  EmitMoveRegister(argumentRegisters[0], MR_R14);
+  EmitMoveConstant(argumentRegisters[1], function);
+  EmitMemory(0x8B, true, argumentRegisters[2], MR_BX, RegisterOffset(paramsRegister));
+  EmitReturnMemory(argumentRegisters[3]);
+  EmitMoveConstant(MR_AX, (INT64)&ExecutionContext::CallInterpreted);
+  Emit8(0xFF); Emit8(0xD0); // call rax
+
+  if(called != -1)
+    PatchJump(called);
+  EmitMemory(0xFF, true, 1, MR_R14, callDepth); // dec
+
+  // execution stopped in the called function, stop this one too
+  Emit8(0x3D); Emit32(ExecutionContext::Returned); // cmp eax, Returned
+  INT32 returned = EmitJump(CC_Equal);
+  EmitEpilogue();
+  PatchJump(returned);
+}
+
+void JITCompiler::EmitTailCall(Instruction &instruction, INT32 parameterSize, INT32 calleeParameterSize)
+{
+  // interpreted functions and parameters that don't fit are called, then this function returns
+  INT32 function = instruction.param1;
+  auto nativeFunction = nativeFunctions.find(function);
+  bool native = compiledFunctions.count(function) || nativeFunction != nativeFunctions.end();
+  if(!native || calleeParameterSize > parameterSize)
+  {
+    EmitCall(function, instruction.param2, -1);
+    EmitMoveConstant(MR_AX, ExecutionContext::Returned);
+    EmitEpilogue();
+    return;
+  }
+
+  // arguments are in this frame, the caller's parameter memory outlives it
+  if(calleeParameterSize)
+    EmitMemory(0x8B, true, MR_AX, MR_BX, RegisterOffset(instruction.param2));
+  for(INT32 offset = 0; offset < calleeParameterSize;)
+  {
+    INT32 left = calleeParameterSize - offset;
+    if(left >= 8)
+    {
+      EmitMemory(0x8B, true, MR_CX, MR_AX, offset);
+      EmitMemory(0x89, true, MR_CX, MR_R12, offset);
+      offset += 8;
+    }
+    else if(left >= 4)
+    {
+      EmitMemory(0x8B, false, MR_CX, MR_AX, offset);
+      EmitMemory(0x89, false, MR_CX, MR_R12, offset);
+      offset += 4;
+    }
+    else
+    {
+      EmitMemory(0x8A, false, MR_CX, MR_AX, offset);
+      EmitMemory(0x88, false, MR_CX, MR_R12, offset);
+      offset += 1;
+    }
+  }
+
+  // callee returns to this function's caller, with the same context, parameter memory and return memory.
+  // depths stay the same like they do in the interpreter
+  EmitMoveRegister(argumentRegisters[0], MR_R14);
+  EmitMoveRegister(argumentRegisters[1], MR_R12);
+  EmitMoveRegister(argumentRegisters[2], MR_R13);
+  EmitLeave();
+  if(compiledFunctions.count(function))
+  {
+    Emit8(0xE9); // jmp
+    Fixup fixup = { (INT32)code.size(), function };
+    callFixups.push_back(fixup);
+    Emit32(0);
+  }
+  else
+  {
+    EmitMoveConstant(MR_AX, (INT64)nativeFunction->second);
+    Emit8(0xFF); Emit8(0xE0); // jmp rax
+  }
+}
+
+void JITCompiler::EmitOperation(Instruction &instruction, INT32 index)
+{
+  const InstructionInfo &info = GetInstructionInfo(instruction.opCode);
+  Operation operation = GetOperation(instruction.opCode);
+
+  if(operation == JO_Copy)
+  {
+    EmitLoad(MR_AX, info.operands[1], instruction.param2);
+    EmitStore(MR_AX, info.operands[0], instruction.param1);
+    return;
+  }
+
+  if(operation == JO_JumpEqual || operation == JO_JumpNotEqual)
+  {
+    EmitLoad(MR_AX, info.operands[0], instruction.param1);
+    EmitLoad(MR_CX, info.operands[1], instruction.param2);
+    Emit8(0x39); Emit8(0xC8); // cmp eax, ecx
+    EmitJumpToInstruction(index + instruction.param3 + 1, operation == JO_JumpEqual ? CC_Equal : CC_NotEqual);
+    return;
+  }
+
+  // two operand forms change their first operand, the others write the result to it
+  INT32 first = info.operands[2].type == OT_None ? 0 : 1;
+  EmitLoad(MR_AX, info.operands[first], GetInstructionParam(instruction, first));
+  EmitLoad(MR_CX, info.operands[first + 1], GetInstructionParam(instruction, first + 1));
+
+  switch(operation)
+  {
+  case JO_Add:
+    Emit8(0x01); Emit8(0xC8); // add eax, ecx
+    break;
+  case JO_Subtract:
+    Emit8(0x29); Emit8(0xC8); // sub eax, ecx
+    break;
+  case JO_Multiply:
+    Emit8(0x0F); Emit8(0xAF); Emit8(0xC1); // imul eax, ecx
+    break;
+  case JO_Divide:
+    {
+      // dividing by zero gives zero, like the interpreter
+      Emit8(0x85); Emit8(0xC9); // test ecx, ecx
+      INT32 byZero = EmitJump(CC_Equal);
+      Emit8(0x99); // cdq
+      Emit8(0xF7); Emit8(0xF9); // idiv ecx
+      INT32 divided = EmitJump();
+      PatchJump(byZero);
+      Emit8(0x31); Emit8(0xC0); // xor eax, eax
+      PatchJump(divided);
+    }
+    break;
+  case JO_Compare:
+    Emit8(0x39); Emit8(0xC8); // cmp eax, ecx
+    Emit8(0x0F); Emit8(0x94); Emit8(0xC0); // sete al
+    break;
+  default:
+    break;
+  }
+
+  EmitStore(MR_AX, info.operands[0], instruction.param1);
+}
+
+void JITCompiler::CompileFunction(Bytecode *bytecode, FunctionBytecode *function)
+{
+  std::vector<Instruction> &instructions = function->optimizedInstructions;
+  Instruction &allocation = instructions[0];
+
+  // parameter memory of each call, after the registers. a call is never prepared again before it is done
+  std::vector<INT32> callMemory(instructions.size(), 0);
+  INT32 callMemorySize = 0;
+  for(size_t i = 0; i < instructions.size(); ++i)
+  {
+    if(instructions[i].opCode != OP_CallPrep)
+      continue;
+
+    callMemory[i] = callMemorySize;
+    callMemorySize += (instructions[i].param2 + 7) & ~7;
+  }
+
+  registersOffset = (allocation.param1 + 7) & ~7;
+  INT32 callMemoryOffset = registersOffset + (allocation.param2 + 1) * sizeof(INT);
+  EmitPrologue(callMemoryOffset + callMemorySize, callMemoryOffset);
+
+  instructionPositions.assign(instructions.size(), 0);
+  jumpFixups.clear();
+
+  for(INT32 i = 1; i < (INT32)instructions.size(); ++i)
+  {
+    Instruction &instruction = instructions[i];
+    const InstructionInfo &info = GetInstructionInfo(instruction.opCode);
+    instructionPositions[i] = (INT32)code.size();
+
+    switch(instruction.opCode)
+    {
+    case OP_NoOp: case OP_BStart: case OP_BEnd: case OP_CallUnprep:
+    case OP_DAllocL: // frame is given back when returning
+    case OP_Yield: // coroutines are interpreted, native code never suspends
+      break;
+
+    case OP_ResetR:
+      EmitMemory(0xC7, false, 0, MR_BX, RegisterOffset(instruction.param1));
+      Emit32(0);
+      break;
+
+    case OP_CallPrep:
+      EmitMemory(0x8D, true, MR_AX, MR_BX, callMemoryOffset + callMemory[i]);
+      EmitMemory(0x89, true, MR_AX, MR_BX, RegisterOffset(instruction.param1));
+      break;
+
+    case OP_CopyData4ROR:
+    case OP_CopyData1ROR:
+      EmitMemory(0x8B, true, MR_AX, MR_BX, RegisterOffset(instruction.param1));
+      EmitLoad(MR_CX, info.operands[2], instruction.param3);
+      EmitMemory(instruction.opCode == OP_CopyData4ROR ? 0x89 : 0x88, false, MR_CX, MR_AX, instruction.param2);
+      break;
+
+    case OP_Call:
+    case OP_CallNative:
+    case OP_CallInterpreted:
+      EmitCall(instruction.param1, instruction.param3, instruction.param2);
+      break;
+
+    case OP_TailCall:
+      EmitTailCall(instruction, function->parameterSize, bytecode->functionBytecodes[instruction.param1]->parameterSize);
+      break;
+
+    case OP_Jump:
+      EmitJumpToInstruction(i + instruction.param1 + 1);
+      break;
+
+    case OP_JumpbR:
+      EmitLoad(MR_AX, info.operands[0], instruction.param1);
+      EmitMemory(0xC7, false, 0, MR_BX, RegisterOffset(instruction.param1));
+      Emit32(0);
+      Emit8(0x83); Emit8(0xF8); Emit8(0x01); // cmp eax, 1
+      EmitJumpToInstruction(i + instruction.param2 + 1, CC_Equal);
+      EmitJumpToInstruction(i + instruction.param3 + 1);
+      break;
+
+    case OP_IncJumpNeiLC:
+    case OP_IncJumpNeiRC:
+      EmitLoad(MR_AX, info.operands[0], instruction.param1);
+      Emit8(0x83); Emit8(0xC0); Emit8(0x01); // add eax, 1
+      EmitStore(MR_AX, info.operands[0], instruction.param1);
+      Emit8(0x3D); Emit32(instruction.param2); // cmp eax, param2
+      EmitJumpToInstruction(i + instruction.param3 + 1, CC_NotEqual);
+      break;
+
+    case OP_NotbRR:
+      EmitLoad(MR_AX, info.operands[1], instruction.param2);
+      Emit8(0x85); Emit8(0xC0); // test eax, eax
+      Emit8(0x0F); Emit8(0x94); Emit8(0xC0); // sete al
+      EmitStore(MR_AX, info.operands[0], instruction.param1);
+      break;
+
+    case OP_CopyiXR:
+      EmitLoad(MR_AX, info.operands[0], instruction.param1);
+      EmitMemory(0x89, false, MR_AX, MR_R13, 0);
+      break;
+
+    case OP_Return:
+      EmitMoveConstant(MR_AX, ExecutionContext::Returned);
+      EmitEpilogue();
+      break;
+
+    default:
+      EmitOperation(instruction, i);
+    }
+  }
+
+  for(auto &fixup : jumpFixups)
+    SetOffset(fixup.position, instructionPositions[fixup.target]);
+}
+
+char *JITCompiler::Finish(Bytecode *bytecode, std::unordered_map<INT, INT32> &functionPositions)
+{
+  for(auto &fixup : callFixups)
+    SetOffset(fixup.position, functionPositions[fixup.target]);
+
+  bytecode->nativeMemory.emplace_back();
+  ExecutableMemory &executableMemory = bytecode->nativeMemory.back();
+
+  char *memory = executableMemory.Allocate(code.size());
+  if(memory)
+  {
+    memcpy(memory, code.data(), code.size());
+    if(!executableMemory.MakeExecutable())
+      memory = nullptr;
+  }
+
+  code.clear();
+  if(!memory)
+    bytecode->nativeMemory.pop_back();
+  return memory;
+}
+
+INT32 JITCompiler::Compile(Bytecode *bytecode)
+{
+#if defined(_M_X64) || defined(__x86_64__)
+  code.clear();
+  callFixups.clear();
+  compiledFunctions.clear();
+  nativeFunctions.clear();
+
+  // calls to compiled functions are direct, so they are known before any code is generated
+  for(auto function : bytecode->functionBytecodes)
+    if(function && CanCompile(function))
+      compiledFunctions.insert(function->id);
+
+  if(compiledFunctions.empty())
+    return 0;
+
+  std::unordered_map<INT, INT32> functionPositions;
+  for(auto function : bytecode->functionBytecodes)
+  {
+    if(!function || !compiledFunctions.count(function->id))
+      continue;
+
+    // functions start at 16 byte boundaries, padding traps
+    while(code.size() & 15)
+      Emit8(0xCC);
+
+    functionPositions[function->id] = (INT32)code.size();
+    CompileFunction(bytecode, function);
+  }
+
+  char *memory = Finish(bytecode, functionPositions);
+  if(!memory)
+    return 0;
+
+  for(auto &position : functionPositions)
+    bytecode->functionBytecodes[position.first]->nativeCode = (NativeFunction)(memory + position.second);
+
+  return (INT32)functionPositions.size();
+#else
+  return 0;
+#endif
+}
+
+bool JITCompiler::Compile(Bytecode *bytecode, FunctionBytecode *function)
+{
+#if defined(_M_X64) || defined(__x86_64__)
+  if(!CanCompile(function))
+    return false;
+
+  code.clear();
+  callFixups.clear();
+  compiledFunctions.clear();
+  nativeFunctions.clear();
+
+  // calls to itself are calls to the new code, unless it is a loop entry that calls go past
+  bool called = bytecode->functionBytecodes[function->id] == function;
+  if(called)
+    compiledFunctions.insert(function->id);
+  for(auto other : bytecode->functionBytecodes)
+    if(other && other->nativeCode && !(called && other->id == function->id))
+      nativeFunctions[other->id] = other->nativeCode;
+
+  std::unordered_map<INT, INT32> functionPositions;
+  functionPositions[function->id] = 0;
+  CompileFunction(bytecode, function);
+
+  char *memory = Finish(bytecode, functionPositions);
+  if(!memory)
+    return false;
+
+  function->nativeCode = (NativeFunction)memory;
+  return true;
+#else
+  return false;
+#endif
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "InstructionInfo.h"
+#include "Bytecode.h"
+
+#include <vector>
+#include <unordered_set>
+#include <unordered_map>
+
+// Translates optimized bytecode of functions to x86-64 machine code, one instruction at a time.
+// Locals, registers and parameter memory of the calls a function makes are a single frame on the machine stack,
+// addressed at fixed offsets from a base register. Parameters are addressed from the pointer the caller gives.
+// Calls between compiled functions are direct native calls. Functions with instructions the compiler doesn't
+// translate are left to the interpreter, compiled code calls them through ExecutionContext.
+// A tail call to native code gives back the frame and jumps to the callee, its arguments go to the parameter
+// memory of the caller if they fit there
+class JITCompiler
+{
+private:
+
+  // translates the same instructions to C++
+  friend class AOTCompiler;
+
+  enum MachineRegister
+  {
+    MR_AX, MR_CX, MR_DX, MR_BX, MR_SP, MR_BP, MR_SI, MR_DI,
+    MR_R8, MR_R9, MR_R10, MR_R11, MR_R12, MR_R13, MR_R14, MR_R15
+  };
+
+  // conditions of jcc instructions
+  enum ConditionCode
+  {
+    CC_Equal = 0x4,
+    CC_NotEqual = 0x5,
+    CC_GreaterOrEqual = 0xD
+  };
+
+  // what an instruction computes, operands come from its instruction info
+  enum Operation
+  {
+    JO_None, // not a computation, translated on its own or not at all
+    JO_Add,
+    JO_Subtract,
+    JO_Multiply,
+    JO_Divide,
+    JO_Copy,
+    JO_Compare,
+    JO_JumpEqual,
+    JO_JumpNotEqual
+  };
+
+  // 32 bit offset written at position, relative to the end of the offset
+  class Fixup
+  {
+  public:
+
+    INT32 position;
+    INT32 target; // instruction index for jumps, function id for calls
+
+  };
+
+  std::vector<unsigned char> code;
+
+  // functions compiled together, called directly with offsets patched once their positions are known
+  std::unordered_set<INT> compiledFunctions;
+  std::vector<Fixup> callFixups;
+
+  // functions compiled before, called at their addresses
+  std::unordered_map<INT, NativeFunction> nativeFunctions;
+
+  // code positions of the instructions of the function being compiled
+  std::vector<INT32> instructionPositions;
+  std::vector<Fixup> jumpFixups;
+
+  // frame of the function being compiled, offsets from the frame base
+  INT32 registersOffset;
+  INT32 frameSize; // bytes taken from the machine stack
+
+  // space below the frame for calls out of native code, needed by Windows calling convention
+  static const INT32 shadowSpace = 32;
+
+  // first four integer arguments of a call
+  static const INT32 argumentRegisters[4];
+
+  static Operation GetOperation(OpCode opCode);
+
+  // functions with tail calls are compiled only if tailCalls is true, they need the frame given back before the jump
+  static bool CanCompile(FunctionBytecode *function, bool tailCalls = true);
+
+  void Emit8(INT32 value) { code.push_back((unsigned char)value); }
+  void Emit32(INT32 value);
+  void Emit64(INT64 value);
+
+  // opCode is one byte, or two bytes starting with 0x0F. reg is a register or an opcode extension
+  void EmitMemory(INT32 opCode, bool wide, INT32 reg, INT32 base, INT32 displacement);
+  void EmitMoveRegister(INT32 target, INT32 source);
+  void EmitMoveConstant(INT32 target, INT64 value);
+
+  // unconditional if conditionCode is -1. returns position of the offset
+  INT32 EmitJump(INT32 conditionCode = -1);
+  void SetOffset(INT32 position, INT32 target);
+  // jump goes to the code emitted next
+  void PatchJump(INT32 position) { SetOffset(position, (INT32)code.size()); }
+  void EmitJumpToInstruction(INT32 target, INT32 conditionCode = -1);
+
+  inline INT32 RegisterOffset(INT32 reg) { return registersOffset + reg * (INT32)sizeof(INT); }
+  void GetAddress(const OperandInfo &operand, INT32 param, INT32 &base, INT32 &displacement);
+
+  // operand of an instruction to a machine register and back, bools are sign extended like chars
+  void EmitLoad(INT32 reg, const OperandInfo &operand, INT32 param);
+  void EmitStore(INT32 reg, const OperandInfo &operand, INT32 param);
+
+  // takes frameBytes from the machine stack, clears the first clearedBytes of it
+  void EmitPrologue(INT32 frameBytes, INT32 clearedBytes);
+  // gives back the frame and the saved registers, the return address is left on top of the stack
+  void EmitLeave();
+  // returns with the status in eax
+  void EmitEpilogue();
+
+  // return value goes to the register, or to the return memory of the function if returnRegister is -1
+  void EmitCall(INT32 function, INT32 paramsRegister, INT32 returnRegister);
+  // parameterSize is the size of the parameters of the function making the call
+  void EmitTailCall(Instruction &instruction, INT32 parameterSize, INT32 calleeParameterSize);
+  void EmitOperation(Instruction &instruction, INT32 index);
+  void CompileFunction(Bytecode *bytecode, FunctionBytecode *function);
+
+  // copies the code to executable memory of the bytecode and patches calls. returns null if there is no memory for it
+  char *Finish(Bytecode *bytecode, std::unordered_map<INT, INT32> &functionPositions);
+
+public:
+
+  JITCompiler() : registersOffset(0), frameSize(0) { }
+
+  // compiles every function it can and sets their native code. returns number of compiled functions.
+  // compiles nothing on machines other than x86-64
+  INT32 Compile(Bytecode *bytecode);
+
+  // compiles a function optimized again after the bytecode is running, or a loop entry of it. sets its native code.
+  // its calls go directly to functions of the bytecode that have native code. returns false if it is not compiled
+  bool Compile(Bytecode *bytecode, FunctionBytecode *function);
+
+};
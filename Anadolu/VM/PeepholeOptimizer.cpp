@@ -0,0 +1,406 @@
+#include "PeepholeOptimizer.h"
+
+size_t PeepholeOptimizer::NextInstruction(size_t index)
+{
+  while(index < code.size() && code[index].opCode == OP_NoOp)
+    ++index;
+  return index;
+}
+
+void PeepholeOptimizer::FindJumpTargets()
+{
+  isJumpTarget.assign(code.size() + 1, false);
+
+  for(auto &instruction : code)
+  {
+    const InstructionInfo &info = GetInstructionInfo(instruction.opCode);
+    for(INT32 p = 0; p < 3; ++p)
+      if(info.operands[p].type == OT_Offset)
+        isJumpTarget[NextInstruction(GetInstructionParam(instruction, p))] = true;
+  }
+}
+
+bool PeepholeOptimizer::RemoveBlockMarkers()
+{
+  // blocks don't have constructors or destructors yet, markers do nothing
+  bool changed = false;
+  for(auto &instruction : code)
+  {
+    if(instruction.opCode == OP_BStart || instruction.opCode == OP_BEnd)
+    {
+      instruction = Instruction(OP_NoOp);
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+bool PeepholeOptimizer::ThreadJumps()
+{
+  bool changed = false;
+
+  for(size_t i = 0; i < code.size(); ++i)
+  {
+    Instruction &instruction = code[i];
+    const InstructionInfo &info = GetInstructionInfo(instruction.opCode);
+    if(!info.IsJump())
+      continue;
+
+    // JumpbR also clears its register, IncJumpNei increments it
+    bool removable = true;
+    for(INT32 p = 0; p < 3; ++p)
+      if(info.operands[p].access & OA_Write)
+        removable = false;
+
+    for(INT32 p = 0; p < 3; ++p)
+    {
+      if(info.operands[p].type != OT_Offset)
+        continue;
+
+      INT32 &target = GetInstructionParam(instruction, p);
+
+      // follow jumps to jumps, a loop of jumps is left alone
+      size_t newTarget = NextInstruction(target);
+      for(size_t steps = 0; newTarget < code.size() && code[newTarget].opCode == OP_Jump && steps < code.size(); ++steps)
+        newTarget = NextInstruction(code[newTarget].param1);
+
+      if(newTarget != (size_t)target)
+      {
+        target = (INT32)newTarget;
+        changed = true;
+      }
+
+      if(newTarget != NextInstruction(i + 1))
+        removable = false;
+    }
+
+    // jumps to the next instruction
+    if(removable)
+    {
+      instruction = Instruction(OP_NoOp);
+      changed = true;
+    }
+  }
+
+  return changed;
+}
+
+bool PeepholeOptimizer::InvertJumps()
+{
+  FindJumpTargets();
+
+  bool changed = false;
+  for(size_t i = 0; i < code.size(); ++i)
+  {
+    Instruction &instruction = code[i];
+    bool jumpIfEqual = instruction.opCode >= OP_JumpEqiLC && instruction.opCode <= OP_JumpEqiRP;
+    bool jumpIfNotEqual = instruction.opCode >= OP_JumpNeiLC && instruction.opCode <= OP_JumpNeiRP;
+    if(!jumpIfEqual && !jumpIfNotEqual)
+      continue;
+
+    // JumpEqi a b L1; Jump L2; L1: becomes JumpNei a b L2
+    size_t next = NextInstruction(i + 1);
+    if(next >= code.size() || code[next].opCode != OP_Jump || isJumpTarget[next])
+      continue;
+    if(NextInstruction(instruction.param3) != NextInstruction(next + 1))
+      continue;
+
+    // both families list operand kinds in the same order
+    INT32 distance = OP_JumpNeiLC - OP_JumpEqiLC;
+    instruction.opCode = (OpCode)(instruction.opCode + (jumpIfEqual ? distance : -distance));
+    instruction.param3 = code[next].param1;
+    code[next] = Instruction(OP_NoOp);
+    changed = true;
+  }
+  return changed;
+}
+
+bool PeepholeOptimizer::FuseCountedLoops()
+{
+  FindJumpTargets();
+
+  bool changed = false;
+  size_t previous = code.size();
+  for(size_t i = NextInstruction(0); i < code.size(); previous = i, i = NextInstruction(i + 1))
+  {
+    Instruction &jump = code[i];
+    if(jump.opCode != OP_Jump || isJumpTarget[i] || previous == code.size())
+      continue;
+
+    // v++; Jump header; exit: with header: JumpEqi v N exit becomes IncJumpNei v N header + 1
+    size_t header = NextInstruction(jump.param1);
+    if(header >= code.size())
+      continue;
+
+    Instruction &test = code[header];
+    Instruction &increment = code[previous];
+
+    OpCode fused = OP_NoOp;
+    if(test.opCode == OP_JumpEqiRC && increment.param1 == test.param1 &&
+      ((increment.opCode == OP_AddiRRC && increment.param2 == test.param1 && increment.param3 == 1) || (increment.opCode == OP_AddiRC && increment.param2 == 1)))
+      fused = OP_IncJumpNeiRC;
+    else if(test.opCode == OP_JumpEqiLC && increment.opCode == OP_AddiLC && increment.param1 == test.param1 && increment.param2 == 1)
+      fused = OP_IncJumpNeiLC;
+    else
+      continue;
+
+    if(NextInstruction(test.param3) != NextInstruction(i + 1))
+      continue;
+
+    increment = Instruction(fused, test.param1, test.param2, (INT32)header + 1);
+    jump = Instruction(OP_NoOp);
+    changed = true;
+  }
+  return changed;
+}
+
+bool PeepholeOptimizer::FormTailCalls()
+{
+  bool changed = false;
+  for(size_t i = 0; i < code.size(); ++i)
+  {
+    Instruction &call = code[i];
+    if(call.opCode != OP_Call)
+      continue;
+
+    // Call f ret params; CallUnprep params; CopyiXR ret; DAllocL; Return becomes TailCall f params.
+    // instructions after the call are kept for other paths jumping to them
+    size_t next = NextInstruction(i + 1);
+    if(next < code.size() && code[next].opCode == OP_CallUnprep && code[next].param1 == call.param3)
+      next = NextInstruction(next + 1);
+
+    if(next >= code.size() || code[next].opCode != OP_CopyiXR || code[next].param1 != call.param2)
+      continue;
+    next = NextInstruction(next + 1);
+    if(next >= code.size() || code[next].opCode != OP_DAllocL)
+      continue;
+    next = NextInstruction(next + 1);
+    if(next >= code.size() || code[next].opCode != OP_Return)
+      continue;
+
+    call = Instruction(OP_TailCall, call.param1, call.param3);
+    changed = true;
+  }
+  return changed;
+}
+
+bool PeepholeOptimizer::RemoveUnreachable()
+{
+  std::vector<bool> reachable(code.size(), false);
+  std::vector<size_t> work(1, 0);
+  std::vector<size_t> successors;
+
+  reachable[0] = true;
+  while(!work.empty())
+  {
+    size_t index = work.back();
+    work.pop_back();
+
+    GetSuccessors(code, index, successors);
+    for(auto successor : successors)
+    {
+      if(!reachable[successor])
+      {
+        reachable[successor] = true;
+        work.push_back(successor);
+      }
+    }
+  }
+
+  bool changed = false;
+  for(size_t i = 0; i < code.size(); ++i)
+  {
+    if(!reachable[i] && code[i].opCode != OP_NoOp)
+    {
+      code[i] = Instruction(OP_NoOp);
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+bool PeepholeOptimizer::RemoveDeadWrites()
+{
+  bool changed = false;
+
+  for(size_t i = 0; i < code.size(); ++i)
+  {
+    Instruction &instruction = code[i];
+    const InstructionInfo &info = GetInstructionInfo(instruction.opCode);
+    if(instruction.opCode == OP_NoOp || info.hasSideEffects)
+      continue;
+
+    // registers written but not read afterwards. ResetR is the most common one
+    RegisterSet written;
+    for(INT32 p = 0; p < 3; ++p)
+      if(info.operands[p].type == OT_Register && (info.operands[p].access & OA_Write))
+        written.AddRegister(GetInstructionParam(instruction, p), info.operands[p].width);
+
+    if(!written.IsEmpty() && !written.Intersects(liveness.liveOut[i]))
+    {
+      instruction = Instruction(OP_NoOp);
+      changed = true;
+    }
+  }
+
+  return changed;
+}
+
+bool PeepholeOptimizer::ForwardCopies()
+{
+  bool changed = false;
+
+  for(size_t i = NextInstruction(0); i < code.size();)
+  {
+    size_t j = NextInstruction(i + 1);
+    if(j >= code.size())
+      break;
+
+    Instruction &first = code[i];
+    Instruction &second = code[j];
+
+    // copy to itself
+    if((first.opCode == OP_CopyiRR || first.opCode == OP_CopybRR) && first.param1 == first.param2)
+    {
+      first = Instruction(OP_NoOp);
+      changed = true;
+      i = j;
+      continue;
+    }
+
+    // other paths jump into second, it must stay as it is
+    if(isJumpTarget[j])
+    {
+      i = j;
+      continue;
+    }
+
+    const InstructionInfo &firstInfo = GetInstructionInfo(first.opCode);
+    const InstructionInfo &secondInfo = GetInstructionInfo(second.opCode);
+
+    // x = a + b; y = x => y = a + b
+    if((second.opCode == OP_CopyiRR || second.opCode == OP_CopybRR) && second.param1 != second.param2)
+    {
+      OperandWidth width = second.opCode == OP_CopyiRR ? OW_Int32 : OW_Byte;
+
+      INT32 writeOperand = -1;
+      INT32 writeCount = 0;
+      for(INT32 p = 0; p < 3; ++p)
+      {
+        if(firstInfo.operands[p].type == OT_Register && (firstInfo.operands[p].access & OA_Write))
+        {
+          ++writeCount;
+          if(firstInfo.operands[p].access == OA_Write && firstInfo.operands[p].width == width && GetInstructionParam(first, p) == second.param2)
+            writeOperand = p;
+        }
+      }
+
+      if(writeCount == 1 && writeOperand != -1 && !liveness.liveOut[j].HasRegister(second.param2))
+      {
+        GetInstructionParam(first, writeOperand) = second.param1;
+        second = Instruction(OP_NoOp);
+        changed = true;
+        i = NextInstruction(j + 1);
+        continue;
+      }
+    }
+
+    // y = x; z = y + c => z = x + c
+    if(first.opCode == OP_CopyiRR || first.opCode == OP_CopybRR)
+    {
+      INT32 copy = first.param1;
+      INT32 source = first.param2;
+
+      bool canForward = !liveness.liveOut[j].HasRegister(copy);
+      bool readsCopy = false;
+      for(INT32 p = 0; p < 3 && canForward; ++p)
+      {
+        const OperandInfo &operand = secondInfo.operands[p];
+        if(operand.type != OT_Register || GetInstructionParam(second, p) != copy)
+          continue;
+
+        // only the low byte of a bool copy is valid
+        if(operand.access != OA_Read || operand.width == OW_Pointer || (first.opCode == OP_CopybRR && operand.width != OW_Byte))
+          canForward = false;
+        readsCopy = true;
+      }
+
+      if(canForward && readsCopy)
+      {
+        for(INT32 p = 0; p < 3; ++p)
+          if(secondInfo.operands[p].type == OT_Register && GetInstructionParam(second, p) == copy)
+            GetInstructionParam(second, p) = source;
+
+        first = Instruction(OP_NoOp);
+        changed = true;
+        i = NextInstruction(j + 1);
+        continue;
+      }
+    }
+
+    // storing a register to a local then loading it back, or the other way
+    if((first.opCode == OP_CopyiLR && second.opCode == OP_CopyiRL) || (first.opCode == OP_CopybLR && second.opCode == OP_CopybRL) ||
+      (first.opCode == OP_CopyiRL && second.opCode == OP_CopyiLR) || (first.opCode == OP_CopybRL && second.opCode == OP_CopybLR))
+    {
+      if(first.param1 == second.param2 && first.param2 == second.param1)
+      {
+        second = Instruction(OP_NoOp);
+        changed = true;
+        i = NextInstruction(j + 1);
+        continue;
+      }
+    }
+
+    i = j;
+  }
+
+  return changed;
+}
+
+size_t PeepholeOptimizer::Optimize(std::list<Instruction> &instructions)
+{
+  code.assign(instructions.begin(), instructions.end());
+  if(code.empty())
+    return 0;
+
+  ToAbsoluteTargets(code);
+
+  RemoveBlockMarkers();
+
+  // one change often makes another one possible
+  bool changed = true;
+  while(changed)
+  {
+    changed = ThreadJumps();
+    changed |= InvertJumps();
+    changed |= FuseCountedLoops();
+    changed |= FormTailCalls();
+    changed |= RemoveUnreachable();
+
+    liveness.Compute(code);
+    changed |= RemoveDeadWrites();
+
+    liveness.Compute(code);
+    FindJumpTargets();
+    changed |= ForwardCopies();
+  }
+
+  ToRelativeTargets(code);
+
+  size_t removed = 0;
+  instructions.clear();
+  for(auto &instruction : code)
+  {
+    if(instruction.opCode != OP_NoOp)
+      instructions.push_back(instruction);
+    else
+      ++removed;
+  }
+
+  code.clear();
+  liveness.liveIn.clear();
+  liveness.liveOut.clear();
+  isJumpTarget.clear();
+
+  return removed;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "BytecodeAnalysis.h"
+
+#include <list>
+#include <vector>
+
+// Cleans up instructions of a single function before they are compacted.
+// Removes resets and writes nobody reads, block markers, unreachable instructions,
+// forwards register copies into their only consumer, threads jumps to jumps
+// turns a compare and jump over a jump into the opposite compare and jump
+// ends counted loops with a single increment, compare and jump back
+// and turns returning the value of a call into a call replacing the frame.
+class PeepholeOptimizer
+{
+private:
+
+  // while optimizing, jump offsets are absolute instruction indices and removed instructions are OP_NoOp
+  std::vector<Instruction> code;
+
+  RegisterLiveness liveness;
+
+  std::vector<bool> isJumpTarget;
+
+  size_t NextInstruction(size_t index);
+
+  void FindJumpTargets();
+
+  bool RemoveBlockMarkers();
+  bool ThreadJumps();
+  bool InvertJumps();
+  bool FuseCountedLoops();
+  bool FormTailCalls();
+  bool RemoveUnreachable();
+  bool RemoveDeadWrites();
+  bool ForwardCopies();
+
+public:
+
+  // optimizes instructions in place, returns number of removed instructions
+  size_t Optimize(std::list<Instruction> &instructions);
+
+};
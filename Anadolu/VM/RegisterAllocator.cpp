@@ -0,0 +1,341 @@
+#include "RegisterAllocator.h"
+
+#include <algorithm>
+#include <set>
+#include <assert.h>
+
+RegisterAllocator::RegisterAllocator(INT32 _registerLimit) : registerLimit(_registerLimit)
+{
+}
+
+bool RegisterAllocator::CoalesceCopies(std::vector<Instruction> &code)
+{
+  RegisterLiveness liveness;
+  liveness.Compute(code);
+
+  INT32 registerCount = GetRegisterCount(code);
+
+  // 1 if a register is used as a bool, 2 if wider. merged registers must agree, lanes are tracked apart
+  std::vector<INT32> widths(registerCount, 0);
+  for(auto &instruction : code)
+  {
+    const InstructionInfo &info = GetInstructionInfo(instruction.opCode);
+    for(INT32 p = 0; p < 3; ++p)
+      if(info.operands[p].type == OT_Register)
+        widths[GetInstructionParam(instruction, p)] |= info.operands[p].width == OW_Byte ? 1 : 2;
+  }
+
+  // a register is written while the other one still holds a value somebody reads
+  auto Interfere = [&](INT32 a, INT32 b) -> bool
+  {
+    for(size_t i = 0; i < code.size(); ++i)
+    {
+      Instruction &instruction = code[i];
+      bool isCopy = (instruction.opCode == OP_CopyiRR || instruction.opCode == OP_CopybRR) &&
+        ((instruction.param1 == a && instruction.param2 == b) || (instruction.param1 == b && instruction.param2 == a));
+      if(isCopy)
+        continue;
+
+      const InstructionInfo &info = GetInstructionInfo(instruction.opCode);
+      for(INT32 p = 0; p < 3; ++p)
+      {
+        if(info.operands[p].type != OT_Register || !(info.operands[p].access & OA_Write))
+          continue;
+
+        INT32 reg = GetInstructionParam(instruction, p);
+        if((reg == a && liveness.liveOut[i].HasRegister(b)) || (reg == b && liveness.liveOut[i].HasRegister(a)))
+          return true;
+      }
+    }
+    return false;
+  };
+
+  // each register is merged at most once per pass, so liveness stays valid for the other pairs
+  std::vector<bool> merged(registerCount, false);
+  std::vector<INT32> rename(registerCount);
+  for(INT32 r = 0; r < registerCount; ++r)
+    rename[r] = r;
+
+  bool changed = false;
+  for(auto &instruction : code)
+  {
+    if(instruction.opCode != OP_CopyiRR && instruction.opCode != OP_CopybRR)
+      continue;
+
+    INT32 target = instruction.param1, source = instruction.param2;
+    if(target == source || merged[target] || merged[source] || widths[target] != widths[source] || Interfere(target, source))
+      continue;
+
+    rename[source] = target;
+    merged[target] = merged[source] = true;
+    changed = true;
+  }
+
+  if(!changed)
+    return false;
+
+  for(auto &instruction : code)
+  {
+    const InstructionInfo &info = GetInstructionInfo(instruction.opCode);
+    for(INT32 p = 0; p < 3; ++p)
+      if(info.operands[p].type == OT_Register)
+        GetInstructionParam(instruction, p) = rename[GetInstructionParam(instruction, p)];
+  }
+
+  return true;
+}
+
+void RegisterAllocator::BuildIntervals(std::vector<Instruction> &code)
+{
+  RegisterLiveness liveness;
+  liveness.Compute(code);
+
+  INT32 registerCount = GetRegisterCount(code);
+
+  intervals.clear();
+  intervals.resize(registerCount);
+  for(INT32 r = 0; r < registerCount; ++r)
+  {
+    intervals[r].virtualRegister = r;
+    intervals[r].start = INT32_MAX;
+    intervals[r].end = -1;
+  }
+
+  auto Extend = [this](INT32 reg, INT32 position)
+  {
+    LiveInterval &interval = intervals[reg];
+    if(position < interval.start)
+      interval.start = position;
+    if(position > interval.end)
+      interval.end = position;
+  };
+
+  for(INT32 i = 0; i < (INT32)code.size(); ++i)
+  {
+    for(INT32 r = 0; r < registerCount; ++r)
+    {
+      if(liveness.liveIn[i].HasRegister(r))
+        Extend(r, i * 2);
+      if(liveness.liveOut[i].HasRegister(r))
+        Extend(r, i * 2 + 1);
+    }
+
+    // a write takes the register even if nobody reads it
+    const InstructionInfo &info = GetInstructionInfo(code[i].opCode);
+    for(INT32 p = 0; p < 3; ++p)
+    {
+      const OperandInfo &operand = info.operands[p];
+      if(operand.type != OT_Register)
+        continue;
+
+      INT32 reg = GetInstructionParam(code[i], p);
+      if(operand.access & OA_Read)
+        Extend(reg, i * 2);
+      if(operand.access & OA_Write)
+        Extend(reg, i * 2 + 1);
+    }
+  }
+
+  // virtual registers optimized away
+  intervals.erase(std::remove_if(intervals.begin(), intervals.end(), [](LiveInterval &interval) { return interval.end == -1; }), intervals.end());
+
+  std::sort(intervals.begin(), intervals.end(), [](const LiveInterval &a, const LiveInterval &b) { return a.start < b.start; });
+}
+
+INT32 RegisterAllocator::LinearScan(INT32 availableRegisters)
+{
+  std::set<INT32> freeRegisters;
+  for(INT32 r = 0; r < availableRegisters; ++r)
+    freeRegisters.insert(r);
+
+  // intervals holding a register
+  std::vector<LiveInterval*> active;
+  INT32 spillCount = 0;
+
+  for(auto &interval : intervals)
+  {
+    interval.physicalRegister = -1;
+    interval.spillSlot = -1;
+
+    // registers of intervals that ended are free again
+    for(auto it = active.begin(); it != active.end();)
+    {
+      if((*it)->end < interval.start)
+      {
+        freeRegisters.insert((*it)->physicalRegister);
+        it = active.erase(it);
+      }
+      else
+        ++it;
+    }
+
+    // lowest free register keeps register file small
+    if(!freeRegisters.empty())
+    {
+      interval.physicalRegister = *freeRegisters.begin();
+      freeRegisters.erase(freeRegisters.begin());
+      active.push_back(&interval);
+      continue;
+    }
+
+    // spill the interval that lives longest
+    ++spillCount;
+    auto longest = std::max_element(active.begin(), active.end(), [](LiveInterval *a, LiveInterval *b) { return a->end < b->end; });
+    if(longest != active.end() && (*longest)->end > interval.end)
+    {
+      interval.physicalRegister = (*longest)->physicalRegister;
+      (*longest)->physicalRegister = -1;
+      *longest = &interval;
+    }
+  }
+
+  return spillCount;
+}
+
+void RegisterAllocator::RewriteInstructions(std::vector<Instruction> &code, INT32 firstScratchRegister)
+{
+  INT32 registerCount = GetRegisterCount(code);
+  std::vector<LiveInterval*> intervalOf(registerCount, nullptr);
+  for(auto &interval : intervals)
+    intervalOf[interval.virtualRegister] = &interval;
+
+  std::vector<Instruction> result;
+  result.reserve(code.size());
+
+  // jumps to an instruction must land on the loads placed before it
+  std::vector<INT32> newIndex(code.size() + 1);
+
+  for(size_t i = 0; i < code.size(); ++i)
+  {
+    newIndex[i] = (INT32)result.size();
+
+    Instruction instruction = code[i];
+    const InstructionInfo &info = GetInstructionInfo(instruction.opCode);
+
+    // spilled virtual registers of this instruction and scratch registers they are loaded into
+    LiveInterval *spilled[3] = { nullptr, nullptr, nullptr };
+    bool load[3] = { false, false, false };
+    bool store[3] = { false, false, false };
+
+    for(INT32 p = 0; p < 3; ++p)
+    {
+      const OperandInfo &operand = info.operands[p];
+      if(operand.type != OT_Register)
+        continue;
+
+      INT32 &reg = GetInstructionParam(instruction, p);
+      LiveInterval *interval = intervalOf[reg];
+      assert(interval);
+
+      if(interval->physicalRegister != -1)
+      {
+        reg = interval->physicalRegister;
+        continue;
+      }
+
+      // same register twice in an instruction uses the same scratch register
+      INT32 s = 0;
+      while(spilled[s] && spilled[s] != interval)
+        ++s;
+      spilled[s] = interval;
+
+      // a bool write keeps the rest of the register, so it has to be loaded too
+      if((operand.access & OA_Read) || operand.width == OW_Byte)
+        load[s] = true;
+      if(operand.access & OA_Write)
+        store[s] = true;
+
+      reg = firstScratchRegister + s;
+    }
+
+    for(INT32 s = 0; s < 3; ++s)
+      if(load[s])
+        result.emplace_back(OP_ReloadRL, firstScratchRegister + s, spilled[s]->spillSlot);
+
+    if(instruction.opCode == OP_JumpbR && store[0])
+    {
+      // JumpbR clears its register, clear the spill slot before jumping
+      result.emplace_back(OP_ResetR, firstScratchRegister + 1);
+      result.emplace_back(OP_SpillLR, spilled[0]->spillSlot, firstScratchRegister + 1);
+      store[0] = false;
+    }
+
+    if(instruction.opCode == OP_IncJumpNeiRC && store[0])
+    {
+      // increment has to be stored before jumping, increment and jump separately
+      result.emplace_back(OP_AddiRRC, firstScratchRegister, firstScratchRegister, 1);
+      result.emplace_back(OP_SpillLR, spilled[0]->spillSlot, firstScratchRegister);
+      instruction.opCode = OP_JumpNeiRC;
+      store[0] = false;
+    }
+
+    result.push_back(instruction);
+
+    for(INT32 s = 0; s < 3; ++s)
+      if(store[s])
+        result.emplace_back(OP_SpillLR, spilled[s]->spillSlot, firstScratchRegister + s);
+  }
+
+  newIndex[code.size()] = (INT32)result.size();
+
+  // loads and stores added above are not jumps, only original instructions are fixed
+  for(auto &instruction : result)
+  {
+    const InstructionInfo &info = GetInstructionInfo(instruction.opCode);
+    for(INT32 p = 0; p < 3; ++p)
+      if(info.operands[p].type == OT_Offset)
+        GetInstructionParam(instruction, p) = newIndex[GetInstructionParam(instruction, p)];
+  }
+
+  code.swap(result);
+}
+
+INT32 RegisterAllocator::Allocate(std::list<Instruction> &instructions, INT32 &localsSize)
+{
+  std::vector<Instruction> code(instructions.begin(), instructions.end());
+  ToAbsoluteTargets(code);
+
+  for(INT32 pass = 0; pass < maxCoalescePasses && CoalesceCopies(code); ++pass)
+    ;
+
+  BuildIntervals(code);
+
+  INT32 registerCount = 0;
+  INT32 firstScratchRegister = -1;
+
+  if(LinearScan(registerLimit) > 0)
+  {
+    // try again, keeping registers to load spilled values into
+    assert(registerLimit > scratchRegisterCount);
+    firstScratchRegister = registerLimit - scratchRegisterCount;
+    LinearScan(firstScratchRegister);
+
+    INT32 slot = (localsSize + 7) & ~7;
+    for(auto &interval : intervals)
+    {
+      if(interval.physicalRegister == -1)
+      {
+        interval.spillSlot = slot;
+        slot += sizeof(INT);
+      }
+    }
+
+    localsSize = slot;
+    registerCount = registerLimit;
+  }
+  else
+  {
+    for(auto &interval : intervals)
+      if(interval.physicalRegister >= registerCount)
+        registerCount = interval.physicalRegister + 1;
+  }
+
+  RewriteInstructions(code, firstScratchRegister);
+
+  ToRelativeTargets(code);
+  instructions.assign(code.begin(), code.end());
+
+  intervals.clear();
+
+  return registerCount;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "BytecodeAnalysis.h"
+
+#include <list>
+#include <vector>
+
+// Maps virtual registers of a function to the registers of its frame.
+// Registers copied into each other are merged first when their values never live at the same time.
+// Linear scan over live intervals, a register is given to another virtual register once its interval ends.
+// When more than registerLimit registers are live at once, virtual registers with the longest intervals
+// are spilled to locals and loaded into scratch registers around each instruction that uses them
+class RegisterAllocator
+{
+private:
+
+  class LiveInterval
+  {
+  public:
+
+    INT32 virtualRegister;
+
+    // two positions per instruction, 2 * index when it reads, 2 * index + 1 when it writes
+    INT32 start;
+    INT32 end;
+
+    INT32 physicalRegister; // -1 if spilled
+    INT32 spillSlot; // local address, -1 if not spilled
+
+  };
+
+  std::vector<LiveInterval> intervals;
+
+  INT32 registerLimit;
+
+  // scratch registers needed by spilled operands, one per register operand
+  static const INT32 scratchRegisterCount = 3;
+
+  static const INT32 maxCoalescePasses = 8;
+
+  // renames the source of register to register copies to their target when it is safe,
+  // copies become copies to themselves. returns true if a register was renamed
+  bool CoalesceCopies(std::vector<Instruction> &code);
+
+  void BuildIntervals(std::vector<Instruction> &code);
+
+  // returns number of spilled intervals
+  INT32 LinearScan(INT32 availableRegisters);
+
+  void RewriteInstructions(std::vector<Instruction> &code, INT32 firstScratchRegister);
+
+public:
+
+  static const INT32 defaultRegisterLimit = 256;
+
+  RegisterAllocator(INT32 _registerLimit = defaultRegisterLimit);
+
+  // rewrites registers of the instructions in place, returns number of registers the frame needs.
+  // spill slots are placed after the locals, localsSize grows by their size
+  INT32 Allocate(std::list<Instruction> &instructions, INT32 &localsSize);
+
+};
@@ -0,0 +1,918 @@
+#include "SSAFunction.h"
+#include "BytecodeAnalysis.h"
+
+#include <map>
+#include <algorithm>
+#include <sstream>
+#include <assert.h>
+
+bool GetSSAOperation(OpCode opCode, SSAOperation &operation, SSAValueType &type)
+{
+  type = SVT_Int;
+
+  switch(opCode)
+  {
+  case OP_ResetR:
+    operation = SO_Const;
+    return true;
+
+  case OP_AddiPR: case OP_AddiPC: case OP_AddiRP: case OP_AddiRPL: case OP_AddiRPR: case OP_AddiRPC: case OP_AddiRPP:
+  case OP_AddiRL: case OP_AddiRRR: case OP_AddiRLR: case OP_AddiRLL: case OP_AddiRLC: case OP_AddiRRC: case OP_AddiLR:
+  case OP_AddiRR: case OP_AddiLC: case OP_AddiRC:
+    operation = SO_Add;
+    return true;
+
+  case OP_SubiRP: case OP_SubiPP: case OP_SubiPC: case OP_SubiPL: case OP_SubiRRP: case OP_SubiRPR: case OP_SubiRLP:
+  case OP_SubiRPL: case OP_SubiRPC: case OP_SubiRCP: case OP_SubiRPP: case OP_SubiRLL: case OP_SubiRCL: case OP_SubiRLC:
+  case OP_SubiRRR: case OP_SubiRLR: case OP_SubiRRL: case OP_SubiRCR: case OP_SubiRRC: case OP_SubiRC: case OP_SubiRR:
+  case OP_SubiRL: case OP_SubiLR:
+    operation = SO_Sub;
+    return true;
+
+  case OP_MuliPC: case OP_MuliRP: case OP_MuliLP: case OP_MuliRPR: case OP_MuliRPC: case OP_MuliRPL: case OP_MuliRPP:
+  case OP_MuliRR: case OP_MuliRL: case OP_MuliRLL: case OP_MuliRLC: case OP_MuliRC: case OP_MuliLC:
+    operation = SO_Mul;
+    return true;
+
+  case OP_DiviRLR: case OP_DiviRRL: case OP_DiviRRC: case OP_DiviRCR: case OP_DiviRLL: case OP_DiviRLC: case OP_DiviRCL:
+  case OP_DiviRRR: case OP_DiviRP: case OP_DiviLP: case OP_DiviPP: case OP_DiviPC: case OP_DiviPR: case OP_DiviPL:
+  case OP_DiviRPC: case OP_DiviRPL: case OP_DiviRPP: case OP_DiviRPR: case OP_DiviRCP: case OP_DiviRLP: case OP_DiviRRP:
+    operation = SO_Div;
+    return true;
+
+  case OP_CmpiRPP: case OP_CmpiRPL: case OP_CmpiRPR: case OP_CmpiRPC: case OP_CmpiRLL: case OP_CmpiRLC: case OP_CmpiRRR:
+  case OP_CmpiRCR: case OP_CmpiRLR:
+    operation = SO_Equal;
+    return true;
+
+  case OP_CmpbRPP: case OP_CmpbRPL: case OP_CmpbRPR: case OP_CmpbRPC: case OP_CmpbRC: case OP_CmpbRLL: case OP_CmpbRRR:
+  case OP_CmpbRLC: case OP_CmpbRCR: case OP_CmpbRLR:
+    operation = SO_Equal;
+    type = SVT_Bool;
+    return true;
+
+  case OP_CopyiLP: case OP_CopyiRP: case OP_CopyiPR: case OP_CopyiPL: case OP_CopyiRC: case OP_CopyiRR: case OP_CopyiRL:
+  case OP_CopyiLR:
+    operation = SO_Copy;
+    return true;
+
+  case OP_CopybLP: case OP_CopybRP: case OP_CopybPR: case OP_CopybPL: case OP_CopybRR: case OP_CopybLR: case OP_CopybRC:
+  case OP_CopybRL:
+    operation = SO_Copy;
+    type = SVT_Bool;
+    return true;
+
+  case OP_NotbRR:
+    operation = SO_Not;
+    type = SVT_Bool;
+    return true;
+
+  default:
+    return false;
+  }
+}
+
+static SSAValueType GetWidthType(OperandWidth width)
+{
+  return width == OW_Byte ? SVT_Bool : (width == OW_Int32 ? SVT_Int : SVT_Pointer);
+}
+
+static INT32 GetWidthSize(OperandWidth width)
+{
+  return width == OW_Byte ? 1 : (width == OW_Int32 ? 4 : 8);
+}
+
+INT32 SSAFunction::AddInstruction(SSAOperation operation, SSAValueType type, INT32 block)
+{
+  INT32 id = (INT32)instructions.size();
+  instructions.emplace_back(operation, type, block);
+  blocks[block].instructions.push_back(id);
+  return id;
+}
+
+INT32 SSAFunction::AddConstant(INT32 value, SSAValueType type)
+{
+  INT32 id = AddInstruction(SO_Const, type, 0);
+  instructions[id].constant = value;
+  return id;
+}
+
+void SSAFunction::FindBlocks(std::vector<Instruction> &code, std::vector<INT32> &blockOf)
+{
+  std::vector<bool> isLeader(code.size() + 1, false);
+  isLeader[0] = true;
+
+  for(size_t i = 0; i < code.size(); ++i)
+  {
+    const InstructionInfo &info = GetInstructionInfo(code[i].opCode);
+    if(info.IsJump() || code[i].opCode == OP_Return || code[i].opCode == OP_TailCall)
+      isLeader[i + 1] = true;
+
+    for(INT32 p = 0; p < 3; ++p)
+      if(info.operands[p].type == OT_Offset)
+        isLeader[GetInstructionParam(code[i], p)] = true;
+  }
+
+  blockOf.assign(code.size() + 1, -1);
+  INT32 block = -1;
+  for(size_t i = 0; i < code.size(); ++i)
+  {
+    if(isLeader[i])
+    {
+      ++block;
+      blocks.emplace_back();
+      layout.push_back(block);
+    }
+    blockOf[i] = block;
+  }
+}
+
+bool SSAFunction::Build(std::list<Instruction> &list)
+{
+  std::vector<Instruction> code(list.begin(), list.end());
+  if(code.empty() || code[0].opCode != OP_AllocL)
+    return false;
+
+  ToAbsoluteTargets(code);
+
+  for(auto &instruction : code)
+  {
+    const InstructionInfo &info = GetInstructionInfo(instruction.opCode);
+    for(INT32 p = 0; p < 3; ++p)
+      if(info.operands[p].type == OT_Offset && (GetInstructionParam(instruction, p) < 0 || GetInstructionParam(instruction, p) >= (INT32)code.size()))
+        return false;
+  }
+
+  // registers are the first variables
+  variableCount = GetRegisterCount(code);
+
+  // a register used as a bool and as a wider value has two lanes, one variable can't hold it
+  std::vector<INT32> registerWidths(variableCount, 0);
+  for(auto &instruction : code)
+  {
+    const InstructionInfo &info = GetInstructionInfo(instruction.opCode);
+    for(INT32 p = 0; p < 3; ++p)
+    {
+      // calls without parameters pass register 0 here without reading it. a reset clears any register
+      if(info.operands[p].type != OT_Register || (instruction.opCode == OP_Call && p == 2) || instruction.opCode == OP_ResetR)
+        continue;
+      INT32 &widths = registerWidths[GetInstructionParam(instruction, p)];
+      widths |= info.operands[p].width == OW_Byte ? 1 : 2;
+      if(widths == 3)
+        return false;
+    }
+  }
+
+  // every address of a local or a parameter the function reads or writes
+  class MemoryAccess
+  {
+  public:
+    INT32 size;
+    bool mixedSizes;
+    bool overlaps;
+    bool written;
+    INT32 variable; // promoted locals only
+  };
+
+  std::map<std::pair<INT32, INT32>, MemoryAccess> accesses;
+  for(auto &instruction : code)
+  {
+    const InstructionInfo &info = GetInstructionInfo(instruction.opCode);
+    for(INT32 p = 0; p < 3; ++p)
+    {
+      const OperandInfo &operand = info.operands[p];
+      if(operand.type != OT_Local && operand.type != OT_Param)
+        continue;
+
+      auto key = std::make_pair((INT32)operand.type, GetInstructionParam(instruction, p));
+      auto it = accesses.find(key);
+      if(it == accesses.end())
+      {
+        MemoryAccess access = { GetWidthSize(operand.width), false, false, false, -1 };
+        it = accesses.insert(std::make_pair(key, access)).first;
+      }
+      else if(it->second.size != GetWidthSize(operand.width))
+        it->second.mixedSizes = true;
+
+      if(operand.access & OA_Write)
+        it->second.written = true;
+    }
+  }
+
+  // a local is promoted if it is always read and written as a whole.
+  // a parameter that nobody writes (even partially) is read straight from the parameters
+  for(auto &a : accesses)
+  {
+    for(auto &b : accesses)
+    {
+      if(&a == &b || a.first.first != b.first.first)
+        continue;
+
+      INT32 aStart = a.first.second, bStart = b.first.second;
+      bool overlap = aStart < bStart + b.second.size && bStart < aStart + a.second.size;
+      if(overlap)
+        a.second.overlaps = true;
+      if(overlap && b.second.written && a.first.first == OT_Param)
+        a.second.written = true;
+    }
+
+    if(a.first.first == OT_Local && !a.second.mixedSizes && !a.second.overlaps)
+      a.second.variable = NewVariable();
+  }
+
+  std::vector<INT32> blockOf;
+  FindBlocks(code, blockOf);
+
+  // lift instructions, operands are variables until they are renamed
+  INT32 block = -1;
+  for(size_t i = 0; i < code.size(); ++i)
+  {
+    Instruction &instruction = code[i];
+    const InstructionInfo &info = GetInstructionInfo(instruction.opCode);
+    block = blockOf[i];
+
+    auto ReadOperand = [&](INT32 p) -> INT32
+    {
+      const OperandInfo &operand = info.operands[p];
+      INT32 param = GetInstructionParam(instruction, p);
+
+      if(operand.type == OT_Register)
+        return param;
+
+      INT32 variable = NewVariable();
+      INT32 id;
+      if(operand.type == OT_Const)
+      {
+        id = AddInstruction(SO_Const, SVT_Int, block);
+        instructions[id].constant = param;
+      }
+      else
+      {
+        MemoryAccess &access = accesses[std::make_pair((INT32)operand.type, param)];
+        if(access.variable != -1)
+          return access.variable;
+
+        id = AddInstruction(operand.type == OT_Param && !access.written ? SO_Param : SO_Load, GetWidthType(operand.width), block);
+        instructions[id].constant = param;
+        instructions[id].memory = operand.type;
+      }
+
+      instructions[id].variable = variable;
+      return variable;
+    };
+
+    auto WriteOperand = [&](INT32 p, INT32 id)
+    {
+      const OperandInfo &operand = info.operands[p];
+      INT32 param = GetInstructionParam(instruction, p);
+
+      if(operand.type == OT_Register)
+      {
+        instructions[id].variable = param;
+        return;
+      }
+
+      MemoryAccess &access = accesses[std::make_pair((INT32)operand.type, param)];
+      if(access.variable != -1)
+      {
+        instructions[id].variable = access.variable;
+        return;
+      }
+
+      INT32 variable = NewVariable();
+      instructions[id].variable = variable;
+
+      INT32 store = AddInstruction(SO_Store, GetWidthType(operand.width), block);
+      instructions[store].operands.push_back(variable);
+      instructions[store].constant = param;
+      instructions[store].memory = operand.type;
+    };
+
+    SSAOperation operation;
+    SSAValueType type;
+
+    if(instruction.opCode == OP_BStart || instruction.opCode == OP_BEnd || instruction.opCode == OP_NoOp)
+      ; // blocks markers do nothing
+    else if(GetSSAOperation(instruction.opCode, operation, type))
+    {
+      if(operation == SO_Const)
+      {
+        // ResetR
+        INT32 id = AddInstruction(SO_Const, SVT_Int, block);
+        WriteOperand(0, id);
+      }
+      else
+      {
+        // two address instructions read their target first
+        std::vector<INT32> sources;
+        for(INT32 p = (info.operands[0].access & OA_Read) ? 0 : 1; p < 3; ++p)
+          if(info.operands[p].type != OT_None)
+            sources.push_back(ReadOperand(p));
+
+        INT32 id = AddInstruction(operation, type, block);
+        instructions[id].operands = sources;
+        WriteOperand(0, id);
+      }
+    }
+    else if(instruction.opCode == OP_Jump)
+    {
+      blocks[block].terminator = TK_Jump;
+      blocks[block].successors.push_back(blockOf[instruction.param1]);
+    }
+    else if(instruction.opCode == OP_JumpbR)
+    {
+      // JumpbR clears its register after reading it
+      INT32 condition = NewVariable();
+      INT32 id = AddInstruction(SO_Copy, SVT_Bool, block);
+      instructions[id].operands.push_back(instruction.param1);
+      instructions[id].variable = condition;
+
+      id = AddInstruction(SO_Const, SVT_Int, block);
+      instructions[id].variable = instruction.param1;
+
+      blocks[block].terminator = TK_Branch;
+      blocks[block].conditions[0] = condition;
+      blocks[block].successors.push_back(blockOf[instruction.param2]);
+      blocks[block].successors.push_back(blockOf[instruction.param3]);
+    }
+    else if(info.IsJump())
+    {
+      // fused compare and jump
+      if(i + 1 >= code.size())
+        return false;
+
+      bool jumpIfEqual = instruction.opCode >= OP_JumpEqiLC && instruction.opCode <= OP_JumpEqiRP;
+      blocks[block].terminator = TK_BranchEqual;
+      blocks[block].conditions[0] = ReadOperand(0);
+      blocks[block].conditions[1] = ReadOperand(1);
+      blocks[block].successors.push_back(jumpIfEqual ? blockOf[instruction.param3] : blockOf[i + 1]);
+      blocks[block].successors.push_back(jumpIfEqual ? blockOf[i + 1] : blockOf[instruction.param3]);
+    }
+    else if(instruction.opCode == OP_AllocL || instruction.opCode == OP_DAllocL || instruction.opCode == OP_Return ||
+      instruction.opCode == OP_CallPrep || instruction.opCode == OP_Call || instruction.opCode == OP_CallUnprep || instruction.opCode == OP_TailCall ||
+      instruction.opCode == OP_CopyData4ROR || instruction.opCode == OP_CopyData1ROR || instruction.opCode == OP_CopyData8ROR ||
+      instruction.opCode == OP_CopyiXR || instruction.opCode == OP_Yield)
+    {
+      INT32 id = AddInstruction(SO_Native, SVT_Int, block);
+      SSAInstruction &native = instructions[id];
+      native.native = instruction;
+      native.hasValue = false;
+
+      // a call without parameters does not prepare parameter memory, its last parameter means nothing
+      bool hasParameters = instruction.opCode != OP_Call || (i + 1 < code.size() && code[i + 1].opCode == OP_CallUnprep && code[i + 1].param1 == instruction.param3);
+
+      for(INT32 p = 0; p < 3; ++p)
+      {
+        const OperandInfo &operand = info.operands[p];
+        if(operand.type == OT_Local || operand.type == OT_Param)
+          return false;
+        if(operand.type != OT_Register)
+          continue;
+
+        if((operand.access & OA_Read) && hasParameters)
+        {
+          native.nativeOperands[p] = (INT32)native.operands.size();
+          native.operands.push_back(GetInstructionParam(instruction, p));
+        }
+        if(operand.access & OA_Write)
+        {
+          native.variable = GetInstructionParam(instruction, p);
+          native.type = GetWidthType(operand.width);
+          native.hasValue = true;
+        }
+      }
+
+      if(instruction.opCode == OP_Return || instruction.opCode == OP_TailCall)
+        blocks[block].terminator = TK_Return;
+    }
+    else
+      return false; // not generated before registers are allocated
+
+    // falls into the next block
+    bool lastOfBlock = i + 1 == code.size() || blockOf[i + 1] != block;
+    if(lastOfBlock && blocks[block].successors.empty() && blocks[block].terminator == TK_Jump)
+    {
+      if(i + 1 == code.size())
+        return false;
+      blocks[block].successors.push_back(blockOf[i + 1]);
+    }
+  }
+
+  for(INT32 b = 0; b < (INT32)blocks.size(); ++b)
+    for(auto successor : blocks[b].successors)
+      blocks[successor].predecessors.push_back(b);
+
+  // frame is allocated once, nothing can jump back to it
+  if(!blocks[0].predecessors.empty())
+    return false;
+
+  RemoveUnreachableBlocks();
+  ComputeDominators();
+
+  std::vector<INT32> order;
+  GetReversePostOrder(order);
+  InsertPhis(order);
+  RenameVariables();
+
+  return true;
+}
+
+void SSAFunction::GetReversePostOrder(std::vector<INT32> &order)
+{
+  order.clear();
+  std::vector<bool> visited(blocks.size(), false);
+
+  // block and index of the next successor to visit
+  std::vector<std::pair<INT32, size_t>> stack;
+  stack.emplace_back(0, 0);
+  visited[0] = true;
+
+  while(!stack.empty())
+  {
+    auto &top = stack.back();
+    SSABlock &block = blocks[top.first];
+    if(top.second < block.successors.size())
+    {
+      INT32 successor = block.successors[top.second++];
+      if(!visited[successor])
+      {
+        visited[successor] = true;
+        stack.emplace_back(successor, 0);
+      }
+    }
+    else
+    {
+      order.push_back(top.first);
+      stack.pop_back();
+    }
+  }
+
+  std::reverse(order.begin(), order.end());
+}
+
+INT32 SSAFunction::GetPredecessorIndex(INT32 block, INT32 successorIndex)
+{
+  SSABlock &from = blocks[block];
+  INT32 successor = from.successors[successorIndex];
+
+  // two edges to the same block are told apart by their order
+  INT32 occurrence = 0;
+  for(INT32 j = 0; j < successorIndex; ++j)
+    if(from.successors[j] == successor)
+      ++occurrence;
+
+  std::vector<INT32> &predecessors = blocks[successor].predecessors;
+  for(INT32 k = 0; k < (INT32)predecessors.size(); ++k)
+    if(predecessors[k] == block && occurrence-- == 0)
+      return k;
+
+  assert(0);
+  return -1;
+}
+
+void SSAFunction::RemoveEdge(INT32 block, INT32 successorIndex)
+{
+  INT32 successor = blocks[block].successors[successorIndex];
+  INT32 k = GetPredecessorIndex(block, successorIndex);
+
+  SSABlock &to = blocks[successor];
+  to.predecessors.erase(to.predecessors.begin() + k);
+  for(auto id : to.instructions)
+  {
+    if(instructions[id].operation != SO_Phi)
+      break;
+    if(k < (INT32)instructions[id].operands.size())
+      instructions[id].operands.erase(instructions[id].operands.begin() + k);
+  }
+
+  blocks[block].successors.erase(blocks[block].successors.begin() + successorIndex);
+}
+
+bool SSAFunction::RemoveUnreachableBlocks()
+{
+  std::vector<INT32> order;
+  GetReversePostOrder(order);
+
+  std::vector<bool> reachable(blocks.size(), false);
+  for(auto b : order)
+    reachable[b] = true;
+
+  bool changed = false;
+  for(INT32 b = 0; b < (INT32)blocks.size(); ++b)
+  {
+    SSABlock &block = blocks[b];
+    if(reachable[b] || block.removed)
+      continue;
+
+    while(!block.successors.empty())
+      RemoveEdge(b, 0);
+
+    for(auto id : block.instructions)
+      instructions[id].removed = true;
+    block.instructions.clear();
+    block.removed = true;
+    changed = true;
+  }
+
+  return changed;
+}
+
+void SSAFunction::ComputeDominators()
+{
+  std::vector<INT32> order;
+  GetReversePostOrder(order);
+
+  std::vector<INT32> position(blocks.size(), -1);
+  for(size_t i = 0; i < order.size(); ++i)
+    position[order[i]] = (INT32)i;
+
+  for(auto &block : blocks)
+  {
+    block.immediateDominator = -1;
+    block.dominated.clear();
+  }
+
+  // Cooper, Harvey, Kennedy. entry is its own dominator while computing
+  blocks[0].immediateDominator = 0;
+
+  auto Intersect = [&](INT32 a, INT32 b) -> INT32
+  {
+    while(a != b)
+    {
+      while(position[a] > position[b])
+        a = blocks[a].immediateDominator;
+      while(position[b] > position[a])
+        b = blocks[b].immediateDominator;
+    }
+    return a;
+  };
+
+  bool changed = true;
+  while(changed)
+  {
+    changed = false;
+    for(size_t i = 1; i < order.size(); ++i)
+    {
+      SSABlock &block = blocks[order[i]];
+
+      INT32 dominator = -1;
+      for(auto predecessor : block.predecessors)
+      {
+        if(blocks[predecessor].immediateDominator == -1)
+          continue;
+        dominator = dominator == -1 ? predecessor : Intersect(predecessor, dominator);
+      }
+
+      if(dominator != block.immediateDominator)
+      {
+        block.immediateDominator = dominator;
+        changed = true;
+      }
+    }
+  }
+
+  blocks[0].immediateDominator = -1;
+  for(size_t i = 1; i < order.size(); ++i)
+    blocks[blocks[order[i]].immediateDominator].dominated.push_back(order[i]);
+}
+
+bool SSAFunction::Dominates(INT32 dominator, INT32 block) const
+{
+  for(; block != -1; block = blocks[block].immediateDominator)
+    if(block == dominator)
+      return true;
+  return false;
+}
+
+void SSAFunction::FindLoops(std::vector<SSALoop> &loops)
+{
+  loops.clear();
+
+  std::vector<INT32> order;
+  GetReversePostOrder(order);
+
+  // headers are visited last first, a loop inside another one has a header later in the order
+  for(auto it = order.rbegin(); it != order.rend(); ++it)
+  {
+    INT32 header = *it;
+
+    std::vector<INT32> work;
+    for(auto predecessor : blocks[header].predecessors)
+      if(Dominates(header, predecessor))
+        work.push_back(predecessor);
+
+    if(work.empty())
+      continue;
+
+    SSALoop loop;
+    loop.header = header;
+    loop.contains.assign(blocks.size(), false);
+    loop.contains[header] = true;
+
+    while(!work.empty())
+    {
+      INT32 b = work.back();
+      work.pop_back();
+      if(loop.contains[b])
+        continue;
+
+      loop.contains[b] = true;
+      for(auto predecessor : blocks[b].predecessors)
+        work.push_back(predecessor);
+    }
+
+    loop.blocks.push_back(header);
+    for(auto b : order)
+      if(b != header && loop.contains[b])
+        loop.blocks.push_back(b);
+
+    loops.push_back(loop);
+  }
+}
+
+void SSAFunction::ComputeDominanceFrontiers(std::vector<std::vector<INT32>> &frontiers)
+{
+  frontiers.assign(blocks.size(), std::vector<INT32>());
+
+  for(INT32 b = 0; b < (INT32)blocks.size(); ++b)
+  {
+    SSABlock &block = blocks[b];
+    if(block.removed || block.predecessors.size() < 2)
+      continue;
+
+    for(auto predecessor : block.predecessors)
+    {
+      for(INT32 runner = predecessor; runner != block.immediateDominator && runner != -1; runner = blocks[runner].immediateDominator)
+      {
+        if(std::find(frontiers[runner].begin(), frontiers[runner].end(), b) == frontiers[runner].end())
+          frontiers[runner].push_back(b);
+      }
+    }
+  }
+}
+
+void SSAFunction::InsertPhis(std::vector<INT32> &order)
+{
+  // variables read in a block before it writes them, only these need phis
+  std::vector<bool> isGlobal(variableCount, false);
+  std::vector<std::vector<INT32>> definingBlocks(variableCount, std::vector<INT32>(1, 0)); // entry defines everything as 0
+  std::vector<INT32> definedIn(variableCount, -1);
+
+  for(auto b : order)
+  {
+    SSABlock &block = blocks[b];
+
+    auto Read = [&](INT32 variable)
+    {
+      if(variable != -1 && definedIn[variable] != b)
+        isGlobal[variable] = true;
+    };
+
+    for(auto id : block.instructions)
+    {
+      for(auto operand : instructions[id].operands)
+        Read(operand);
+
+      INT32 variable = instructions[id].variable;
+      if(variable != -1 && definedIn[variable] != b)
+      {
+        definedIn[variable] = b;
+        if(b != 0)
+          definingBlocks[variable].push_back(b);
+      }
+    }
+
+    Read(block.conditions[0]);
+    Read(block.conditions[1]);
+  }
+
+  std::vector<std::vector<INT32>> frontiers;
+  ComputeDominanceFrontiers(frontiers);
+
+  std::vector<std::vector<INT32>> phis(blocks.size());
+  std::vector<INT32> hasPhi(blocks.size(), -1);
+  std::vector<INT32> inWork(blocks.size(), -1);
+
+  for(INT32 variable = 0; variable < variableCount; ++variable)
+  {
+    if(!isGlobal[variable])
+      continue;
+
+    std::vector<INT32> work = definingBlocks[variable];
+    for(auto b : work)
+      inWork[b] = variable;
+
+    while(!work.empty())
+    {
+      INT32 b = work.back();
+      work.pop_back();
+
+      for(auto frontier : frontiers[b])
+      {
+        if(hasPhi[frontier] == variable)
+          continue;
+        hasPhi[frontier] = variable;
+
+        INT32 id = (INT32)instructions.size();
+        instructions.emplace_back(SO_Phi, SVT_Int, frontier);
+        instructions[id].variable = variable;
+        instructions[id].operands.assign(blocks[frontier].predecessors.size(), variable);
+        phis[frontier].push_back(id);
+
+        if(inWork[frontier] != variable)
+        {
+          inWork[frontier] = variable;
+          work.push_back(frontier);
+        }
+      }
+    }
+  }
+
+  for(size_t b = 0; b < blocks.size(); ++b)
+    blocks[b].instructions.insert(blocks[b].instructions.begin(), phis[b].begin(), phis[b].end());
+}
+
+void SSAFunction::RenameVariables()
+{
+  // registers and locals start as 0, frame is cleared when it is allocated
+  INT32 zero = AddConstant(0, SVT_Int);
+
+  std::vector<std::vector<INT32>> current(variableCount);
+  auto Current = [&](INT32 variable) -> INT32
+  {
+    return current[variable].empty() ? zero : current[variable].back();
+  };
+
+  // variables each visited block pushed, popped when its dominator subtree is done
+  std::vector<INT32> pushed;
+
+  class Visit
+  {
+  public:
+    INT32 block;
+    size_t child;
+    size_t pushedStart;
+  };
+
+  std::vector<Visit> stack;
+  Visit entry = { 0, 0, 0 };
+  stack.push_back(entry);
+
+  bool enter = true;
+  while(!stack.empty())
+  {
+    Visit &visit = stack.back();
+    SSABlock &block = blocks[visit.block];
+
+    if(enter)
+    {
+      visit.pushedStart = pushed.size();
+
+      for(auto id : block.instructions)
+      {
+        SSAInstruction &instruction = instructions[id];
+        if(instruction.operation != SO_Phi)
+          for(auto &operand : instruction.operands)
+            operand = Current(operand);
+
+        if(instruction.variable != -1)
+        {
+          current[instruction.variable].push_back(id);
+          pushed.push_back(instruction.variable);
+        }
+      }
+
+      for(auto &condition : block.conditions)
+        if(condition != -1)
+          condition = Current(condition);
+
+      for(INT32 j = 0; j < (INT32)block.successors.size(); ++j)
+      {
+        SSABlock &successor = blocks[block.successors[j]];
+        INT32 k = GetPredecessorIndex(visit.block, j);
+        for(auto id : successor.instructions)
+        {
+          if(instructions[id].operation != SO_Phi)
+            break;
+          instructions[id].operands[k] = Current(instructions[id].variable);
+        }
+      }
+    }
+
+    if(visit.child < block.dominated.size())
+    {
+      Visit next = { block.dominated[visit.child++], 0, 0 };
+      stack.push_back(next);
+      enter = true;
+      continue;
+    }
+
+    while(pushed.size() > visit.pushedStart)
+    {
+      current[pushed.back()].pop_back();
+      pushed.pop_back();
+    }
+    stack.pop_back();
+    enter = false;
+  }
+
+  for(auto &instruction : instructions)
+    instruction.variable = -1;
+
+  // phi takes the type of the values coming in, constants fit any type
+  bool changed = true;
+  std::vector<bool> typed(instructions.size(), false);
+  while(changed)
+  {
+    changed = false;
+    for(size_t id = 0; id < instructions.size(); ++id)
+    {
+      SSAInstruction &phi = instructions[id];
+      if(phi.operation != SO_Phi || typed[id])
+        continue;
+
+      for(auto operand : phi.operands)
+      {
+        SSAInstruction &incoming = instructions[operand];
+        if(incoming.operation == SO_Const || (incoming.operation == SO_Phi && !typed[operand]))
+          continue;
+
+        phi.type = incoming.GetValueType();
+        typed[id] = true;
+        changed = true;
+        break;
+      }
+    }
+  }
+}
+
+void SSAFunction::CountUses(std::vector<INT32> &uses)
+{
+  uses.assign(instructions.size(), 0);
+
+  for(auto &block : blocks)
+  {
+    if(block.removed)
+      continue;
+
+    for(auto id : block.instructions)
+      for(auto operand : instructions[id].operands)
+        ++uses[operand];
+
+    for(auto condition : block.conditions)
+      if(condition != -1)
+        ++uses[condition];
+  }
+}
+
+void SSAFunction::GetAsString(std::string &str)
+{
+  static const char *operationNames[] = { "Const", "Param", "Load", "Store", "Copy", "Add", "Sub", "Mul", "Div", "Equal", "Not", "Phi", "Native" };
+  static const char *typeNames[] = { "i", "b", "p" };
+
+  std::stringstream ss;
+
+  for(auto b : layout)
+  {
+    SSABlock &block = blocks[b];
+    if(block.removed)
+      continue;
+
+    ss << "block " << b << " <-";
+    for(auto predecessor : block.predecessors)
+      ss << " " << predecessor;
+    ss << "\n";
+
+    for(auto id : block.instructions)
+    {
+      SSAInstruction &instruction = instructions[id];
+      ss << "  ";
+      if(instruction.hasValue)
+        ss << "v" << id << " = ";
+      ss << operationNames[instruction.operation] << "." << typeNames[instruction.type];
+
+      if(instruction.operation == SO_Const)
+        ss << " " << instruction.constant;
+      else if(instruction.operation == SO_Param || instruction.operation == SO_Load || instruction.operation == SO_Store)
+        ss << (instruction.memory == OT_Local ? " l" : " p") << instruction.constant;
+      else if(instruction.operation == SO_Native)
+        ss << " op" << instruction.native.opCode;
+
+      for(auto operand : instruction.operands)
+        ss << " v" << operand;
+      ss << "\n";
+    }
+
+    static const char *terminatorNames[] = { "Jump", "Branch", "BranchEqual", "Return" };
+    ss << "  " << terminatorNames[block.terminator];
+    for(auto condition : block.conditions)
+      if(condition != -1)
+        ss << " v" << condition;
+    ss << " ->";
+    for(auto successor : block.successors)
+      ss << " " << successor;
+    ss << "\n";
+  }
+
+  str = ss.str();
+}
@@ -0,0 +1,204 @@
+#pragma once
+
+#include "InstructionInfo.h"
+
+#include <list>
+#include <vector>
+#include <string>
+
+// what an SSA instruction computes
+enum SSAOperation
+{
+  SO_Const, // constant value, kept in constant
+  SO_Param, // parameter the function never writes, address is in constant
+  SO_Load, // reads a local or parameter that stays in memory, address is in constant
+  SO_Store, // writes operand 0 to a local or parameter that stays in memory, defines no value
+  SO_Copy,
+  SO_Add,
+  SO_Sub,
+  SO_Mul,
+  SO_Div, // dividing by zero gives 0, like the VM does
+  SO_Equal, // result is a bool
+  SO_Not, // result is a bool
+  SO_Phi, // one operand for each predecessor of the block, in the same order
+  SO_Native // frames, calls, return values. optimizer does not look into these and never removes them
+};
+
+// type of an SSA value
+enum SSAValueType
+{
+  SVT_Int,
+  SVT_Bool, // always 0 or 1, the rest of a register holding it is 0
+  SVT_Pointer
+};
+
+// how a block ends
+enum SSATerminator
+{
+  TK_Jump, // goes to successor 0
+  TK_Branch, // JumpbR. successor 0 if condition 0 is true, successor 1 otherwise
+  TK_BranchEqual, // successor 0 if condition 0 == condition 1 (INT32), successor 1 otherwise
+  TK_Return // no successors, last instruction is OP_Return or OP_TailCall
+};
+
+class SSAInstruction
+{
+public:
+
+  SSAOperation operation;
+
+  // type the operation works on. SO_Equal and SO_Not always give a bool
+  SSAValueType type;
+
+  // values read by the instruction
+  std::vector<INT32> operands;
+
+  // value of SO_Const, address of SO_Param, SO_Load and SO_Store
+  INT32 constant;
+
+  // OT_Local or OT_Param for SO_Param, SO_Load and SO_Store
+  OperandType memory;
+
+  // original instruction of SO_Native. register parameters are taken from operands and the value when lowered
+  Instruction native;
+
+  // operand index of each native parameter that reads a register, -1 if the parameter is kept as it is
+  INT32 nativeOperands[3];
+
+  bool hasValue;
+
+  INT32 block;
+
+  bool removed;
+
+  // while building, variable the instruction writes and operands are variables, not values
+  INT32 variable;
+
+  SSAInstruction(SSAOperation _operation, SSAValueType _type, INT32 _block)
+    : operation(_operation), type(_type), constant(0), memory(OT_None), hasValue(_operation != SO_Store), block(_block), removed(false), variable(-1)
+  {
+    nativeOperands[0] = nativeOperands[1] = nativeOperands[2] = -1;
+  }
+
+  // type of the value the instruction defines
+  SSAValueType GetValueType() const
+  {
+    return (operation == SO_Equal || operation == SO_Not) ? SVT_Bool : type;
+  }
+
+};
+
+class SSABlock
+{
+public:
+
+  // instruction ids in order, phis come first
+  std::vector<INT32> instructions;
+
+  std::vector<INT32> predecessors;
+  std::vector<INT32> successors;
+
+  SSATerminator terminator;
+
+  // values the terminator reads
+  INT32 conditions[2];
+
+  INT32 immediateDominator;
+
+  // blocks this one immediately dominates
+  std::vector<INT32> dominated;
+
+  bool removed;
+
+  SSABlock() : terminator(TK_Jump), immediateDominator(-1), removed(false)
+  {
+    conditions[0] = conditions[1] = -1;
+  }
+
+};
+
+// natural loop of a header, blocks reaching a back edge to the header without going through it
+class SSALoop
+{
+public:
+
+  INT32 header;
+
+  // header first, then the rest in reverse post order
+  std::vector<INT32> blocks;
+
+  // by block id
+  std::vector<bool> contains;
+
+};
+
+// Instructions of a single function in SSA form, every value is written once.
+// Built from the instructions the generator gives, before any register is allocated.
+// Registers and the locals only read and written directly (not through overlapping accesses) become SSA values,
+// everything else stays in memory and is reached with SO_Load and SO_Store.
+// A value id is the id of the instruction defining it.
+class SSAFunction
+{
+private:
+
+  // variables are registers, then promoted locals, then temporaries of the builder
+  INT32 variableCount;
+
+  INT32 NewVariable() { return variableCount++; }
+
+  void FindBlocks(std::vector<Instruction> &code, std::vector<INT32> &blockOf);
+
+  void ComputeDominanceFrontiers(std::vector<std::vector<INT32>> &frontiers);
+
+  void InsertPhis(std::vector<INT32> &order);
+
+  void RenameVariables();
+
+public:
+
+  std::vector<SSAInstruction> instructions;
+  std::vector<SSABlock> blocks;
+
+  // order blocks are placed in when instructions are generated again
+  std::vector<INT32> layout;
+
+  SSAFunction() : variableCount(0) { }
+
+  // returns false if the instructions use something SSA form can't describe, function should be left as it is
+  bool Build(std::list<Instruction> &code);
+
+  INT32 AddInstruction(SSAOperation operation, SSAValueType type, INT32 block);
+
+  // constants have no position, they are kept in the entry block
+  INT32 AddConstant(INT32 value, SSAValueType type);
+
+  bool IsConstant(INT32 value) const { return instructions[value].operation == SO_Const; }
+
+  // reachable blocks, every block comes before its successors unless the edge is a back edge
+  void GetReversePostOrder(std::vector<INT32> &order);
+
+  // marks blocks that can't be reached from the entry removed, with their instructions
+  bool RemoveUnreachableBlocks();
+
+  // index in the successor's predecessors (and phi operands) of the edge block -> successors[successorIndex]
+  INT32 GetPredecessorIndex(INT32 block, INT32 successorIndex);
+
+  void RemoveEdge(INT32 block, INT32 successorIndex);
+
+  void ComputeDominators();
+
+  // needs dominators
+  bool Dominates(INT32 dominator, INT32 block) const;
+
+  // loops of the function, inner loops come before the loops around them. needs dominators
+  void FindLoops(std::vector<SSALoop> &loops);
+
+  // number of times each value is read, by instructions and terminators
+  void CountUses(std::vector<INT32> &uses);
+
+  void GetAsString(std::string &str);
+
+};
+
+// maps an opcode to the operation it does. returns false for jumps, calls, frames and other opcodes the SSA form keeps as they are
+bool GetSSAOperation(OpCode opCode, SSAOperation &operation, SSAValueType &type);
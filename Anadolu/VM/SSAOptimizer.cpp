@@ -0,0 +1,712 @@
+#include "SSAOptimizer.h"
+
+#include <map>
+#include <algorithm>
+#include <limits.h>
+
+void SSAOptimizer::Replace(INT32 value, INT32 with)
+{
+  with = Resolve(with);
+  if(with == value)
+    return;
+
+  replacements.resize(function->instructions.size(), -1);
+  replacements[value] = with;
+  function->instructions[value].removed = true;
+}
+
+INT32 SSAOptimizer::Resolve(INT32 value)
+{
+  while(value < (INT32)replacements.size() && replacements[value] != -1)
+    value = replacements[value];
+  return value;
+}
+
+void SSAOptimizer::ApplyReplacements()
+{
+  for(auto &block : function->blocks)
+  {
+    if(block.removed)
+      continue;
+
+    auto end = std::remove_if(block.instructions.begin(), block.instructions.end(), [&](INT32 id) { return function->instructions[id].removed; });
+    block.instructions.erase(end, block.instructions.end());
+
+    for(auto id : block.instructions)
+      for(auto &operand : function->instructions[id].operands)
+        operand = Resolve(operand);
+
+    for(auto &condition : block.conditions)
+      if(condition != -1)
+        condition = Resolve(condition);
+  }
+}
+
+void SSAOptimizer::MakeConstant(INT32 value, INT32 constant, SSAValueType type)
+{
+  SSAInstruction &instruction = function->instructions[value];
+  instruction.operation = SO_Const;
+  instruction.type = type;
+  instruction.constant = constant;
+  instruction.operands.clear();
+}
+
+bool SSAOptimizer::PropagateCopies()
+{
+  bool changed = false;
+
+  for(auto &block : function->blocks)
+  {
+    if(block.removed)
+      continue;
+
+    for(auto id : block.instructions)
+    {
+      SSAInstruction &instruction = function->instructions[id];
+      if(instruction.removed || instruction.operation != SO_Copy)
+        continue;
+
+      INT32 source = Resolve(instruction.operands[0]);
+      SSAInstruction &value = function->instructions[source];
+
+      // a bool copy only keeps the lowest byte
+      if(value.GetValueType() == instruction.type)
+        Replace(id, source);
+      else if(value.operation == SO_Const)
+        MakeConstant(id, instruction.type == SVT_Bool ? (value.constant & 0xFF) : value.constant, instruction.type);
+      else
+        continue;
+
+      changed = true;
+    }
+  }
+
+  return changed;
+}
+
+bool SSAOptimizer::FoldConstants()
+{
+  bool changed = false;
+  std::vector<SSAInstruction> &instructions = function->instructions;
+
+  for(auto &block : function->blocks)
+  {
+    if(block.removed)
+      continue;
+
+    for(auto id : block.instructions)
+    {
+      SSAInstruction &instruction = instructions[id];
+      if(instruction.removed)
+        continue;
+
+      for(auto &operand : instruction.operands)
+        operand = Resolve(operand);
+
+      if(instruction.operation == SO_Phi)
+      {
+        // every incoming value is the same, ignoring the phi itself coming around a loop
+        INT32 unique = -1;
+        bool same = true;
+        for(auto operand : instruction.operands)
+        {
+          if(operand == id || operand == unique)
+            continue;
+          if(unique != -1)
+            same = false;
+          unique = operand;
+        }
+
+        if(same && unique != -1)
+        {
+          Replace(id, unique);
+          changed = true;
+        }
+        continue;
+      }
+
+      if(instruction.operation < SO_Add || instruction.operation > SO_Not)
+        continue;
+
+      INT32 a = instruction.operands[0];
+      INT32 b = instruction.operands.size() > 1 ? instruction.operands[1] : -1;
+      bool aConstant = function->IsConstant(a);
+      bool bConstant = b != -1 && function->IsConstant(b);
+
+      // values wrap around like INT32 arithmetic of the VM
+      uint32_t x = aConstant ? (uint32_t)instructions[a].constant : 0;
+      uint32_t y = bConstant ? (uint32_t)instructions[b].constant : 0;
+
+      if(aConstant && (b == -1 || bConstant))
+      {
+        switch(instruction.operation)
+        {
+        case SO_Add:
+          MakeConstant(id, (INT32)(x + y), SVT_Int);
+          break;
+        case SO_Sub:
+          MakeConstant(id, (INT32)(x - y), SVT_Int);
+          break;
+        case SO_Mul:
+          MakeConstant(id, (INT32)(x * y), SVT_Int);
+          break;
+        case SO_Div:
+          if((INT32)x == INT_MIN && (INT32)y == -1)
+            continue;
+          MakeConstant(id, y == 0 ? 0 : (INT32)x / (INT32)y, SVT_Int);
+          break;
+        case SO_Equal:
+          if(instruction.type == SVT_Bool)
+            MakeConstant(id, (x & 0xFF) == (y & 0xFF), SVT_Bool);
+          else
+            MakeConstant(id, x == y, SVT_Bool);
+          break;
+        case SO_Not:
+          MakeConstant(id, (x & 0xFF) == 0, SVT_Bool);
+          break;
+        default:
+          continue;
+        }
+
+        changed = true;
+        continue;
+      }
+
+      // identities, one side is enough
+      switch(instruction.operation)
+      {
+      case SO_Add:
+        if(aConstant && x == 0)
+          Replace(id, b);
+        else if(bConstant && y == 0)
+          Replace(id, a);
+        else
+          continue;
+        break;
+      case SO_Sub:
+        if(bConstant && y == 0)
+          Replace(id, a);
+        else if(a == b)
+          MakeConstant(id, 0, SVT_Int);
+        else
+          continue;
+        break;
+      case SO_Mul:
+        if((aConstant && x == 0) || (bConstant && y == 0))
+          MakeConstant(id, 0, SVT_Int);
+        else if(aConstant && x == 1)
+          Replace(id, b);
+        else if(bConstant && y == 1)
+          Replace(id, a);
+        else
+          continue;
+        break;
+      case SO_Div:
+        if((aConstant && x == 0) || (bConstant && y == 0))
+          MakeConstant(id, 0, SVT_Int);
+        else if(bConstant && y == 1)
+          Replace(id, a);
+        else
+          continue;
+        break;
+      case SO_Equal:
+        if(a == b)
+          MakeConstant(id, 1, SVT_Bool);
+        else
+          continue;
+        break;
+      default:
+        continue;
+      }
+
+      changed = true;
+    }
+  }
+
+  return changed;
+}
+
+bool SSAOptimizer::SimplifyBranches()
+{
+  bool changed = false;
+  std::vector<SSAInstruction> &instructions = function->instructions;
+
+  for(INT32 b = 0; b < (INT32)function->blocks.size(); ++b)
+  {
+    SSABlock &block = function->blocks[b];
+    if(block.removed)
+      continue;
+
+    for(auto &condition : block.conditions)
+      if(condition != -1)
+        condition = Resolve(condition);
+
+    // a taken successor of -1 means the branch stays
+    INT32 taken = -1;
+
+    if(block.terminator == TK_Branch)
+    {
+      SSAInstruction &condition = instructions[block.conditions[0]];
+
+      if(condition.operation == SO_Const)
+        taken = (condition.constant & 0xFF) == 1 ? 0 : 1;
+      else if(condition.operation == SO_Not && instructions[condition.operands[0]].GetValueType() == SVT_Bool && block.successors[0] != block.successors[1])
+      {
+        block.conditions[0] = condition.operands[0];
+        std::swap(block.successors[0], block.successors[1]);
+        changed = true;
+      }
+      else if(condition.operation == SO_Equal && condition.type == SVT_Int)
+      {
+        block.terminator = TK_BranchEqual;
+        block.conditions[1] = condition.operands[1];
+        block.conditions[0] = condition.operands[0];
+        changed = true;
+      }
+    }
+    else if(block.terminator == TK_BranchEqual)
+    {
+      INT32 a = block.conditions[0], c = block.conditions[1];
+      if(a == c)
+        taken = 0;
+      else if(function->IsConstant(a) && function->IsConstant(c))
+        taken = instructions[a].constant == instructions[c].constant ? 0 : 1;
+    }
+
+    if(taken == -1 && (block.terminator == TK_Branch || block.terminator == TK_BranchEqual) && block.successors[0] == block.successors[1])
+      taken = 0;
+
+    if(taken != -1)
+    {
+      function->RemoveEdge(b, 1 - taken);
+      block.terminator = TK_Jump;
+      block.conditions[0] = block.conditions[1] = -1;
+      changed = true;
+    }
+  }
+
+  if(function->RemoveUnreachableBlocks())
+    changed = true;
+
+  return changed;
+}
+
+INT32 SSAOptimizer::GetPreheader(SSALoop &loop)
+{
+  std::vector<SSABlock> &blocks = function->blocks;
+  INT32 header = loop.header;
+
+  std::vector<INT32> outside, inside;
+  for(size_t k = 0; k < blocks[header].predecessors.size(); ++k)
+  {
+    INT32 predecessor = blocks[header].predecessors[k];
+    (loop.contains[predecessor] ? inside : outside).push_back((INT32)k);
+  }
+
+  if(outside.empty())
+    return -1;
+
+  INT32 single = blocks[header].predecessors[outside[0]];
+  if(outside.size() == 1 && blocks[single].successors.size() == 1)
+    return single;
+
+  // every edge entering the loop goes through a new block
+  INT32 preheader = (INT32)blocks.size();
+  blocks.emplace_back();
+  blocks[preheader].successors.push_back(header);
+
+  std::vector<INT32> predecessors(1, preheader);
+  for(auto k : inside)
+    predecessors.push_back(blocks[header].predecessors[k]);
+
+  for(auto k : outside)
+  {
+    INT32 predecessor = blocks[header].predecessors[k];
+    blocks[preheader].predecessors.push_back(predecessor);
+    *std::find(blocks[predecessor].successors.begin(), blocks[predecessor].successors.end(), header) = preheader;
+  }
+
+  // values entering the loop are merged in the preheader first
+  for(auto id : blocks[header].instructions)
+  {
+    if(function->instructions[id].operation != SO_Phi || function->instructions[id].removed)
+      continue;
+
+    std::vector<INT32> entering;
+    for(auto k : outside)
+      entering.push_back(function->instructions[id].operands[k]);
+
+    INT32 value = entering[0];
+    if(std::count(entering.begin(), entering.end(), value) != (INT32)entering.size())
+    {
+      value = (INT32)function->instructions.size();
+      function->instructions.emplace_back(SO_Phi, function->instructions[id].type, preheader);
+      function->instructions.back().operands = entering;
+      blocks[preheader].instructions.push_back(value);
+    }
+
+    std::vector<INT32> operands(1, value);
+    for(auto k : inside)
+      operands.push_back(function->instructions[id].operands[k]);
+    function->instructions[id].operands.swap(operands);
+  }
+
+  blocks[header].predecessors.swap(predecessors);
+
+  auto position = std::find(function->layout.begin(), function->layout.end(), header);
+  function->layout.insert(position, preheader);
+
+  return preheader;
+}
+
+bool SSAOptimizer::HoistInvariants(SSALoop &loop, INT32 preheader)
+{
+  bool changed = false;
+  std::vector<SSAInstruction> &instructions = function->instructions;
+
+  // constants can be read anywhere, wherever they are defined
+  auto IsInLoop = [&](INT32 value)
+  {
+    if(function->IsConstant(value))
+      return false;
+    INT32 block = instructions[value].block;
+    return block < (INT32)loop.contains.size() && loop.contains[block];
+  };
+
+  // blocks are in reverse post order, operands are hoisted before the instructions reading them
+  for(auto b : loop.blocks)
+  {
+    std::vector<INT32> &blockInstructions = function->blocks[b].instructions;
+    for(size_t i = 0; i < blockInstructions.size();)
+    {
+      INT32 id = blockInstructions[i];
+      SSAInstruction &instruction = instructions[id];
+
+      bool pure = false;
+      switch(instruction.operation)
+      {
+      case SO_Copy: case SO_Add: case SO_Sub: case SO_Mul: case SO_Equal: case SO_Not:
+        pure = true;
+        break;
+      case SO_Div:
+        // INT_MIN / -1 traps, a division the loop might not run is not moved
+        pure = function->IsConstant(instruction.operands[1]) && instructions[instruction.operands[1]].constant != -1;
+        break;
+      default:
+        break;
+      }
+
+      bool invariant = pure && !instruction.removed;
+      for(auto operand : instruction.operands)
+        if(IsInLoop(Resolve(operand)))
+          invariant = false;
+
+      if(!invariant)
+      {
+        ++i;
+        continue;
+      }
+
+      blockInstructions.erase(blockInstructions.begin() + i);
+      function->blocks[preheader].instructions.push_back(id);
+      instruction.block = preheader;
+      changed = true;
+    }
+  }
+
+  return changed;
+}
+
+bool SSAOptimizer::ReduceStrength(SSALoop &loop, INT32 preheader)
+{
+  bool changed = false;
+  std::vector<SSAInstruction> &instructions = function->instructions;
+  SSABlock &header = function->blocks[loop.header];
+
+  // i = phi(start, i + step) and i * k in the loop become j = phi(start * k, j + step * k)
+  for(size_t h = 0; h < header.instructions.size(); ++h)
+  {
+    INT32 counter = header.instructions[h];
+    if(instructions[counter].operation != SO_Phi || instructions[counter].type != SVT_Int || instructions[counter].removed)
+      continue;
+
+    INT32 start = -1, next = -1;
+    bool induction = true;
+    for(size_t k = 0; k < header.predecessors.size(); ++k)
+    {
+      INT32 operand = Resolve(instructions[counter].operands[k]);
+      INT32 &value = loop.contains[header.predecessors[k]] ? next : start;
+      if(value != -1 && value != operand)
+        induction = false;
+      value = operand;
+    }
+
+    if(!induction || start == -1 || next == -1 || instructions[next].operation != SO_Add)
+      continue;
+
+    std::vector<INT32> &addOperands = instructions[next].operands;
+    INT32 step = addOperands[0] == counter ? addOperands[1] : (addOperands[1] == counter ? addOperands[0] : -1);
+    if(step == -1 || !function->IsConstant(step))
+      continue;
+
+    for(auto b : loop.blocks)
+    {
+      for(auto id : function->blocks[b].instructions)
+      {
+        SSAInstruction &multiply = instructions[id];
+        if(multiply.removed || multiply.operation != SO_Mul)
+          continue;
+
+        INT32 a = Resolve(multiply.operands[0]), c = Resolve(multiply.operands[1]);
+        if(c == counter)
+          std::swap(a, c);
+        if(a != counter || !function->IsConstant(c))
+          continue;
+
+        uint32_t factor = (uint32_t)instructions[c].constant;
+
+        INT32 scaledStart;
+        if(function->IsConstant(start))
+          scaledStart = function->AddConstant((INT32)((uint32_t)instructions[start].constant * factor), SVT_Int);
+        else
+        {
+          scaledStart = function->AddInstruction(SO_Mul, SVT_Int, preheader);
+          instructions[scaledStart].operands.push_back(start);
+          instructions[scaledStart].operands.push_back(c);
+        }
+
+        INT32 scaledStep = function->AddConstant((INT32)((uint32_t)instructions[step].constant * factor), SVT_Int);
+
+        INT32 scaled = (INT32)instructions.size();
+        instructions.emplace_back(SO_Phi, SVT_Int, loop.header);
+
+        // next value is computed where the counter's is
+        INT32 scaledNext = (INT32)instructions.size();
+        instructions.emplace_back(SO_Add, SVT_Int, instructions[next].block);
+        instructions[scaledNext].operands.push_back(scaled);
+        instructions[scaledNext].operands.push_back(scaledStep);
+
+        std::vector<INT32> &nextBlock = function->blocks[instructions[next].block].instructions;
+        nextBlock.insert(std::find(nextBlock.begin(), nextBlock.end(), next) + 1, scaledNext);
+
+        for(auto predecessor : header.predecessors)
+          instructions[scaled].operands.push_back(loop.contains[predecessor] ? scaledNext : scaledStart);
+        header.instructions.insert(header.instructions.begin(), scaled);
+        ++h;
+
+        Replace(id, scaled);
+        changed = true;
+        break;
+      }
+    }
+  }
+
+  return changed;
+}
+
+bool SSAOptimizer::OptimizeLoops()
+{
+  std::vector<SSALoop> loops;
+  function->FindLoops(loops);
+
+  bool changed = false;
+  for(auto &loop : loops)
+  {
+    size_t blockCount = function->blocks.size();
+    INT32 preheader = GetPreheader(loop);
+    if(preheader == -1)
+      continue;
+
+    if(function->blocks.size() != blockCount)
+    {
+      // preheader is inside the loops around this one
+      for(auto &other : loops)
+      {
+        other.contains.resize(function->blocks.size(), false);
+        if(&other != &loop && other.contains[loop.header])
+        {
+          other.contains[preheader] = true;
+          other.blocks.insert(std::find(other.blocks.begin(), other.blocks.end(), loop.header), preheader);
+        }
+      }
+      changed = true;
+    }
+
+    changed |= HoistInvariants(loop, preheader);
+    changed |= ReduceStrength(loop, preheader);
+  }
+
+  return changed;
+}
+
+bool SSAOptimizer::EliminateCommonSubexpressions()
+{
+  bool changed = false;
+  std::vector<SSAInstruction> &instructions = function->instructions;
+
+  // values available in the dominators of the visited block, undone when leaving a block
+  std::map<std::vector<INT32>, INT32> available;
+  std::vector<std::map<std::vector<INT32>, INT32>::iterator> added;
+  std::vector<std::pair<INT32, size_t>> stack; // block, number of dominated blocks visited
+  std::vector<size_t> addedStart;
+
+  stack.emplace_back(0, 0);
+  addedStart.push_back(0);
+  bool enter = true;
+
+  while(!stack.empty())
+  {
+    SSABlock &block = function->blocks[stack.back().first];
+
+    if(enter)
+    {
+      for(auto id : block.instructions)
+      {
+        SSAInstruction &instruction = instructions[id];
+        if(instruction.removed)
+          continue;
+
+        switch(instruction.operation)
+        {
+        case SO_Const: case SO_Param: case SO_Copy: case SO_Add: case SO_Sub: case SO_Mul: case SO_Div: case SO_Equal: case SO_Not:
+          break;
+        default:
+          continue;
+        }
+
+        std::vector<INT32> key;
+        key.push_back(instruction.operation);
+        key.push_back(instruction.type);
+        key.push_back(instruction.constant);
+        key.push_back(instruction.memory);
+        for(auto operand : instruction.operands)
+          key.push_back(Resolve(operand));
+
+        if((instruction.operation == SO_Add || instruction.operation == SO_Mul || instruction.operation == SO_Equal) && key[4] > key[5])
+          std::swap(key[4], key[5]);
+
+        auto it = available.find(key);
+        if(it != available.end())
+        {
+          Replace(id, it->second);
+          changed = true;
+        }
+        else
+          added.push_back(available.insert(std::make_pair(key, id)).first);
+      }
+    }
+
+    if(stack.back().second < block.dominated.size())
+    {
+      stack.emplace_back(block.dominated[stack.back().second++], 0);
+      addedStart.push_back(added.size());
+      enter = true;
+      continue;
+    }
+
+    while(added.size() > addedStart.back())
+    {
+      available.erase(added.back());
+      added.pop_back();
+    }
+    addedStart.pop_back();
+    stack.pop_back();
+    enter = false;
+  }
+
+  return changed;
+}
+
+bool SSAOptimizer::RemoveDeadInstructions()
+{
+  std::vector<SSAInstruction> &instructions = function->instructions;
+  std::vector<bool> live(instructions.size(), false);
+  std::vector<INT32> work;
+
+  auto MarkLive = [&](INT32 value)
+  {
+    if(!live[value])
+    {
+      live[value] = true;
+      work.push_back(value);
+    }
+  };
+
+  for(auto &block : function->blocks)
+  {
+    if(block.removed)
+      continue;
+
+    for(auto id : block.instructions)
+      if(instructions[id].operation == SO_Store || instructions[id].operation == SO_Native)
+        MarkLive(id);
+
+    for(auto condition : block.conditions)
+      if(condition != -1)
+        MarkLive(condition);
+  }
+
+  while(!work.empty())
+  {
+    INT32 value = work.back();
+    work.pop_back();
+    for(auto operand : instructions[value].operands)
+      MarkLive(operand);
+  }
+
+  bool changed = false;
+  for(auto &block : function->blocks)
+  {
+    if(block.removed)
+      continue;
+
+    for(auto id : block.instructions)
+    {
+      if(!live[id])
+      {
+        instructions[id].removed = true;
+        changed = true;
+      }
+    }
+
+    auto end = std::remove_if(block.instructions.begin(), block.instructions.end(), [&](INT32 id) { return instructions[id].removed; });
+    block.instructions.erase(end, block.instructions.end());
+  }
+
+  return changed;
+}
+
+bool SSAOptimizer::Optimize(SSAFunction &_function)
+{
+  function = &_function;
+  replacements.clear();
+
+  bool changed = false;
+  for(INT32 iteration = 0; iteration < maxIterations; ++iteration)
+  {
+    bool changedNow = PropagateCopies();
+    ApplyReplacements();
+    changedNow |= FoldConstants();
+    ApplyReplacements();
+    changedNow |= SimplifyBranches();
+    ApplyReplacements();
+
+    function->ComputeDominators();
+    if(OptimizeLoops())
+    {
+      changedNow = true;
+      ApplyReplacements();
+      function->ComputeDominators();
+    }
+
+    changedNow |= EliminateCommonSubexpressions();
+    ApplyReplacements();
+    changedNow |= RemoveDeadInstructions();
+
+    if(!changedNow)
+      break;
+    changed = true;
+  }
+
+  return changed;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "SSAFunction.h"
+
+#include <vector>
+
+// Optimizes a function in SSA form until nothing changes.
+// Propagates copies, folds constants and algebraic identities, removes branches with known conditions
+// and the blocks they make unreachable, moves values that don't change in a loop out of it,
+// turns multiplications of a loop counter into additions, reuses values already computed in a dominating block
+// and removes instructions whose values nobody reads
+class SSAOptimizer
+{
+private:
+
+  SSAFunction *function;
+
+  // value each replaced value is replaced with, -1 if it is not replaced
+  std::vector<INT32> replacements;
+
+  static const INT32 maxIterations = 16;
+
+  void Replace(INT32 value, INT32 with);
+
+  // follows replacements until a value that is not replaced
+  INT32 Resolve(INT32 value);
+
+  // changes every read of a replaced value to its replacement
+  void ApplyReplacements();
+
+  // turns the instruction into a constant in place
+  void MakeConstant(INT32 value, INT32 constant, SSAValueType type);
+
+  bool PropagateCopies();
+  bool FoldConstants();
+  bool SimplifyBranches();
+
+  // block before the loop header that only jumps to it, created if there isn't one. -1 if the loop can't be entered
+  INT32 GetPreheader(SSALoop &loop);
+
+  bool HoistInvariants(SSALoop &loop, INT32 preheader);
+  bool ReduceStrength(SSALoop &loop, INT32 preheader);
+  bool OptimizeLoops();
+  bool EliminateCommonSubexpressions();
+  bool RemoveDeadInstructions();
+
+public:
+
+  SSAOptimizer() : function(nullptr) { }
+
+  // returns true if the function changed
+  bool Optimize(SSAFunction &_function);
+
+};
@@ -0,0 +1,298 @@
+#include "Scheduler.h"
+#include "Bytecode.h"
+#include "FrameStack.h"
+
+#include <string.h>
+#include <algorithm>
+
+Scheduler::Scheduler(Bytecode *_bytecode, INT workerCount)
+  : bytecode(_bytecode),
+  nextWorker(0),
+  queuedJobs(0),
+  sleepingWorkers(0),
+  stopping(false),
+  pendingJobs(0)
+{
+  if(workerCount <= 0)
+    workerCount = std::max((INT)std::thread::hardware_concurrency(), (INT)1);
+
+  // tiered bytecode counts calls and replaces functions while it runs
+  if(bytecode->tieredCompiler)
+    workerCount = 1;
+
+  for(auto function : bytecode->functionBytecodes)
+  {
+    parameterSizes.push_back(function ? function->parameterSize : -1);
+    returnSizes.push_back(function ? function->optimizedInstructions[0].param3 : -1);
+  }
+
+  // every queue exists before any worker looks for jobs to steal
+  for(INT i = 0; i < workerCount; ++i)
+    workers.push_back(new Worker());
+
+  for(INT i = 0; i < workerCount; ++i)
+    workers[i]->thread = std::thread(&Scheduler::Run, this, i);
+}
+
+Scheduler::~Scheduler()
+{
+  Wait();
+
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    stopping = true;
+  }
+  wakeUp.notify_all();
+
+  // workers look at each other's queues until they stop
+  for(auto worker : workers)
+    worker->thread.join();
+
+  for(auto worker : workers)
+    delete worker;
+}
+
+bool Scheduler::Submit(INT id, const char *params, INT32 parameterSize, Callback callback, bool coroutine)
+{
+  if(id < 0 || id >= (INT)parameterSizes.size() || parameterSizes[id] == -1)
+    return false;
+
+  if(parameterSizes[id] != parameterSize || returnSizes[id] > maxReturnSize)
+    return false;
+
+  Job *job = new Job();
+  job->id = id;
+  job->params.assign(params, params + parameterSize);
+  memset(job->returnMemory, 0, sizeof(job->returnMemory));
+  job->callback = callback;
+  job->coroutine = coroutine;
+  job->first = 0;
+  job->count = 1;
+  job->context = nullptr;
+  job->frameStack = nullptr;
+
+  ++pendingJobs;
+  Push(workers[(size_t)nextWorker++ % workers.size()], job);
+  return true;
+}
+
+bool Scheduler::SubmitBatch(INT id, const char *params, INT32 parameterSize, INT count, BatchCallback callback)
+{
+  if(id < 0 || id >= (INT)parameterSizes.size() || parameterSizes[id] == -1)
+    return false;
+
+  if(parameterSizes[id] != parameterSize || returnSizes[id] > maxReturnSize || count < 1)
+    return false;
+
+  // a few jobs for each worker so idle ones can steal when calls take different time,
+  // the first jobs get a call more if they don't divide evenly
+  INT jobCount = std::min(count, (INT)workers.size() * batchJobsPerWorker);
+  INT first = 0;
+  for(INT i = 0; i < jobCount; ++i)
+  {
+    Job *job = new Job();
+    job->id = id;
+    job->first = first;
+    job->count = count / jobCount + (i < count % jobCount ? 1 : 0);
+    job->params.assign(params + (size_t)first * parameterSize, params + (size_t)(first + job->count) * parameterSize);
+    memset(job->returnMemory, 0, sizeof(job->returnMemory));
+    job->batchCallback = callback;
+    job->coroutine = false;
+    job->context = nullptr;
+    job->frameStack = nullptr;
+    first += job->count;
+
+    ++pendingJobs;
+    Push(workers[(size_t)nextWorker++ % workers.size()], job);
+  }
+
+  return true;
+}
+
+void Scheduler::Push(Worker *worker, Job *job)
+{
+  {
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    worker->jobs.push_back(job);
+  }
+
+  // a worker is woken when there were no jobs, it wakes another one if it leaves jobs behind.
+  // jobs can be taken before they are counted, the count goes below zero for a while
+  if(queuedJobs++ <= 0)
+    WakeWorker();
+}
+
+void Scheduler::WakeWorker()
+{
+  // a worker going to sleep counts itself before it looks at queued jobs, one of the two sees the other
+  if(sleepingWorkers > 0)
+  {
+    { std::lock_guard<std::mutex> lock(sleepMutex); }
+    wakeUp.notify_one();
+  }
+}
+
+bool Scheduler::Take(INT index, std::vector<Job*> &batch)
+{
+  INT workerCount = (INT)workers.size();
+  for(INT i = 0; i < workerCount && batch.empty(); ++i)
+  {
+    Worker *worker = workers[(index + i) % workerCount];
+    std::lock_guard<std::mutex> lock(worker->mutex);
+
+    INT count = std::min((INT)(worker->jobs.size() + 1) / 2, (INT)batchSize);
+    for(INT j = 0; j < count; ++j)
+    {
+      // own queue runs in the order jobs came, the earliest ones don't wait behind later ones.
+      // jobs are stolen from the other end
+      if(i == 0)
+      {
+        batch.push_back(worker->jobs.front());
+        worker->jobs.pop_front();
+      }
+      else
+      {
+        batch.push_back(worker->jobs.back());
+        worker->jobs.pop_back();
+      }
+    }
+  }
+
+  queuedJobs -= (INT)batch.size();
+  return !batch.empty();
+}
+
+void Scheduler::Finish(Job *job, INT index, ExecutionContext::ExecutionStatus status)
+{
+  if(!job->callback && !job->batchCallback)
+    return;
+
+  if(status != ExecutionContext::Returned)
+    memset(job->returnMemory, 0, sizeof(job->returnMemory));
+  if(job->batchCallback)
+    job->batchCallback(job->first + index, status, (char*)job->returnMemory);
+  else
+    job->callback(status, (char*)job->returnMemory);
+}
+
+void Scheduler::RunJob(Worker *worker, ExecutionContext &context, Job *job)
+{
+  ExecutionContext *running = &context;
+
+  if(!job->coroutine)
+  {
+    // calls of a batch but the last one finish here
+    INT32 parameterSize = parameterSizes[job->id];
+    for(INT i = 0; i < job->count; ++i)
+    {
+      if(i > 0)
+        Finish(job, i - 1, context.GetStatus());
+
+      context.Reset(bytecode->GetCalledFunctionBytecode(job->id));
+      context.SetParameter(job->params.data() + (size_t)i * parameterSize);
+      context.SetReturnMemory((char*)job->returnMemory);
+      context.Execute();
+    }
+  }
+  else if(job->context)
+  {
+    running = job->context;
+    running->Resume();
+  }
+  else
+  {
+    FunctionBytecode *function = bytecode->GetCalledFunctionBytecode(job->id);
+    if(worker->coroutines.empty())
+    {
+      job->frameStack = new FrameStack(coroutineStackSize);
+      job->context = new ExecutionContext(bytecode, function, job->frameStack, true);
+      job->context->SetBudget(coroutineBudget);
+    }
+    else
+    {
+      job->context = worker->coroutines.back().first;
+      job->frameStack = worker->coroutines.back().second;
+      worker->coroutines.pop_back();
+      job->context->Reset(function);
+    }
+
+    running = job->context;
+    running->SetParameter(job->params.data());
+    running->SetReturnMemory((char*)job->returnMemory);
+    running->Execute();
+  }
+
+  // jobs in the queue run before a suspended coroutine continues, other workers can take it
+  if(running->GetStatus() == ExecutionContext::Suspended || running->GetStatus() == ExecutionContext::Preempted)
+  {
+    Push(worker, job);
+    return;
+  }
+
+  Finish(job, job->count - 1, running->GetStatus());
+
+  if(job->context)
+    worker->coroutines.push_back(std::make_pair(job->context, job->frameStack));
+  delete job;
+
+  if(--pendingJobs == 0)
+  {
+    { std::lock_guard<std::mutex> lock(finishMutex); }
+    finished.notify_all();
+  }
+}
+
+void Scheduler::Run(INT index)
+{
+  Worker *worker = workers[index];
+
+  // calls are made on the frame stack of this thread
+  ExecutionContext context(bytecode, nullptr);
+  std::vector<Job*> batch;
+  batch.reserve(batchSize);
+
+  for(;;)
+  {
+    if(Take(index, batch))
+    {
+      if(queuedJobs > 0)
+        WakeWorker();
+
+      for(auto job : batch)
+        RunJob(worker, context, job);
+      batch.clear();
+      continue;
+    }
+
+    // jobs submitted one at a time come in faster than waking a sleeping worker for each of them,
+    // a worker gives its core to the others for a while before it sleeps and takes them in full batches
+    bool queued = false;
+    for(INT i = 0; i < idleYields && !queued; ++i)
+    {
+      std::this_thread::yield();
+      queued = queuedJobs > 0;
+    }
+    if(queued)
+      continue;
+
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    ++sleepingWorkers;
+    wakeUp.wait(lock, [this]() { return queuedJobs > 0 || stopping; });
+    --sleepingWorkers;
+
+    if(stopping && queuedJobs == 0)
+      break;
+  }
+
+  for(auto &coroutine : worker->coroutines)
+  {
+    delete coroutine.first;
+    delete coroutine.second;
+  }
+}
+
+void Scheduler::Wait()
+{
+  std::unique_lock<std::mutex> lock(finishMutex);
+  finished.wait(lock, [this]() { return pendingJobs == 0; });
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+#include "Parser/PrimitiveTypes.h"
+#include "ExecutionContext.h"
+#include "ScriptFunction.h"
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+
+class Bytecode;
+class FrameStack;
+
+// sets the value of a promise from the return memory of a script call
+template<typename R>
+class ScriptPromise
+{
+public:
+
+  static void Set(std::promise<R> &promise, const char *returnValue) { promise.set_value(ScriptType<R>::Read(returnValue)); }
+
+};
+
+template<>
+class ScriptPromise<void>
+{
+public:
+
+  static void Set(std::promise<void> &promise, const char *returnValue) { promise.set_value(); }
+
+};
+
+// keeps a parameter pack from being deduced from the arguments
+template<typename T>
+class ScriptArgument
+{
+public:
+
+  typedef T Type;
+
+};
+
+// Runs calls of global functions of a bytecode on worker threads, submitted from any thread.
+// each worker has a queue of its own. submitted jobs are spread over the queues, a worker takes a batch of jobs
+// from the front of its queue at a time and steals a batch from the back of another queue when its own is empty.
+// calls run on the frame stack of the worker's thread. a coroutine job has a frame stack of its own, each time it
+// yields or is preempted it goes to the back of a queue and the worker runs other jobs, any worker can resume it.
+// a submitted job costs a few hundred nanoseconds more than calling the function directly. calls shorter than a few
+// microseconds should be submitted together with SubmitBatch, its calls run one after another in a few jobs.
+// tiered bytecode runs on one thread at a time, it gets a single worker
+class Scheduler
+{
+public:
+
+  // called on the worker thread when a job stops. return memory of the call is zero unless it Returned
+  typedef std::function<void(ExecutionContext::ExecutionStatus status, const char *returnValue)> Callback;
+
+  // called on the worker thread when a call of a batch stops, index is the position of the call in the batch
+  typedef std::function<void(INT index, ExecutionContext::ExecutionStatus status, const char *returnValue)> BatchCallback;
+
+  // functions returning more than this can't be submitted
+  static const INT32 maxReturnSize = 2 * sizeof(INT);
+
+  // most jobs a worker takes from a queue at once, it leaves at least half of them for other workers
+  static const INT32 batchSize = 32;
+
+  // most jobs a batch is split into for each worker
+  static const INT batchJobsPerWorker = 4;
+
+  // times a worker without jobs yields its core before it sleeps
+  static const INT idleYields = 64;
+
+  // frame stacks of coroutines grow from this size
+  static const size_t coroutineStackSize = 4 * 1024;
+
+  // back-edges and calls a coroutine job runs before it is preempted, a long one doesn't keep the jobs behind it waiting
+  static const INT coroutineBudget = 10000;
+
+private:
+
+  class Job
+  {
+  public:
+
+    INT id;
+    std::vector<char> params;
+    INT returnMemory[maxReturnSize / sizeof(INT)];
+    Callback callback;
+    bool coroutine;
+
+    // calls of a batch the job runs, parameters of each are after the ones before. count is 1 for other jobs
+    INT first;
+    INT count;
+    BatchCallback batchCallback;
+
+    // context of a coroutine and the frame stack its frames stay on, from the first time it runs
+    ExecutionContext *context;
+    FrameStack *frameStack;
+
+  };
+
+  class Worker
+  {
+  public:
+
+    std::mutex mutex;
+    std::deque<Job*> jobs;
+    std::thread thread;
+
+    // contexts of finished coroutines and their frame stacks, used only by the worker's thread
+    std::vector<std::pair<ExecutionContext*, FrameStack*>> coroutines;
+
+  };
+
+  Bytecode *bytecode;
+  std::vector<Worker*> workers;
+
+  // sizes of the parameters and the return value of each function, -1 if there is no function with the id.
+  // they are the same in every tier, submitting doesn't look at bytecode the workers may be replacing
+  std::vector<INT32> parameterSizes;
+  std::vector<INT32> returnSizes;
+
+  // queue the next submitted job goes to
+  std::atomic<INT> nextWorker;
+
+  // jobs in queues, workers sleep while there are none
+  std::atomic<INT> queuedJobs;
+  std::atomic<INT> sleepingWorkers;
+  std::atomic<bool> stopping;
+  std::mutex sleepMutex;
+  std::condition_variable wakeUp;
+
+  // jobs submitted and not finished
+  std::atomic<INT> pendingJobs;
+  std::mutex finishMutex;
+  std::condition_variable finished;
+
+  void Push(Worker *worker, Job *job);
+  void WakeWorker();
+
+  // moves jobs from the front of the worker's queue, or from the back of another one to batch
+  bool Take(INT index, std::vector<Job*> &batch);
+
+  // sends the status and the return value of a call of the job to its callback
+  void Finish(Job *job, INT index, ExecutionContext::ExecutionStatus status);
+
+  void RunJob(Worker *worker, ExecutionContext &context, Job *job);
+  void Run(INT index);
+
+public:
+
+  // starts workerCount workers, one for each core if it is 0
+  Scheduler(Bytecode *_bytecode, INT workerCount = 0);
+
+  // runs every submitted job, then stops the workers
+  ~Scheduler();
+
+  inline INT GetWorkerCount() { return (INT)workers.size(); }
+
+  // runs the function with a copy of parameterSize bytes of params and calls callback when it stops.
+  // a coroutine job suspends at each yield of the script. false if there is no such function,
+  // the parameter size is not its size or it returns more than maxReturnSize
+  bool Submit(INT id, const char *params, INT32 parameterSize, Callback callback, bool coroutine = false);
+
+  // runs count calls of the function, with a copy of parameterSize bytes of params for each after the ones before.
+  // calls are split into batchJobsPerWorker jobs for each worker at most, the calls of a job run one after another.
+  // false like Submit, or if count is below 1
+  bool SubmitBatch(INT id, const char *params, INT32 parameterSize, INT count, BatchCallback callback);
+
+  // runs a function bound by the VM that started the scheduler with the arguments, the future gets its return value.
+  // the value is zero if it doesn't return
+  template<typename R, typename... Args>
+  std::future<R> Submit(const ScriptFunction<R(Args...)> &function, typename ScriptArgument<Args>::Type... args)
+  {
+    typedef typename ScriptFunction<R(Args...)>::Parameters Parameters;
+    char params[Parameters::size + 1];
+    Parameters::Write(params, args...);
+
+    auto promise = std::make_shared<std::promise<R>>();
+    std::future<R> future = promise->get_future();
+    bool submitted = Submit(function.GetId(), params, Parameters::size, [promise](ExecutionContext::ExecutionStatus status, const char *returnValue)
+    {
+      ScriptPromise<R>::Set(*promise, returnValue);
+    });
+
+    if(!submitted)
+    {
+      INT returnMemory[maxReturnSize / sizeof(INT)] = {};
+      ScriptPromise<R>::Set(*promise, (char*)returnMemory);
+    }
+    return future;
+  }
+
+  // returns once every job submitted before is finished. callbacks must not call it
+  void Wait();
+
+};
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "Parser/PrimitiveTypes.h"
+#include "Parser/Package.h"
+#include "Bytecode.h"
+#include "ExecutionContext.h"
+
+#include <string.h>
+
+// C++ types script values are given as and returned as, with their type id and size in script memory
+template<typename T>
+class ScriptType;
+
+template<>
+class ScriptType<INT32>
+{
+public:
+
+  static const INT typeId = TypeIdInteger;
+  static const INT32 size = 4;
+
+  static void Write(char *memory, INT32 value) { memcpy(memory, &value, size); }
+  static INT32 Read(const char *memory) { INT32 value; memcpy(&value, memory, size); return value; }
+
+};
+
+template<>
+class ScriptType<bool>
+{
+public:
+
+  static const INT typeId = TypeIdBool;
+  static const INT32 size = 1;
+
+  static void Write(char *memory, bool value) { *memory = value ? 1 : 0; }
+  static bool Read(const char *memory) { return *memory != 0; }
+
+};
+
+template<>
+class ScriptType<void>
+{
+public:
+
+  static const INT typeId = TypeIdVoid;
+  static const INT32 size = 0;
+
+  static void Read(const char *memory) { }
+
+};
+
+// parameters are one after another in the order they are declared, offsets are known at compile time
+template<typename... Args>
+class ScriptParameters;
+
+template<>
+class ScriptParameters<>
+{
+public:
+
+  static const INT32 count = 0;
+  static const INT32 size = 0;
+
+  static void Write(char *memory) { }
+  static void GetTypes(INT *types) { }
+
+};
+
+template<typename First, typename... Rest>
+class ScriptParameters<First, Rest...>
+{
+public:
+
+  static const INT32 count = 1 + ScriptParameters<Rest...>::count;
+  static const INT32 size = ScriptType<First>::size + ScriptParameters<Rest...>::size;
+
+  static void Write(char *memory, First first, Rest... rest)
+  {
+    ScriptType<First>::Write(memory, first);
+    ScriptParameters<Rest...>::Write(memory + ScriptType<First>::size, rest...);
+  }
+
+  static void GetTypes(INT *types)
+  {
+    types[0] = ScriptType<First>::typeId;
+    ScriptParameters<Rest...>::GetTypes(types + 1);
+  }
+
+};
+
+template<typename Signature>
+class ScriptFunction;
+
+// A global function of the bytecode bound with VM::GetFunction, called like a C++ function.
+// the function is found and its signature checked once. calls run on the calling thread's frame stack,
+// parameters and the return value are on the machine stack, nothing is allocated on the heap.
+// valid until the VM generates its bytecode again
+template<typename R, typename... Args>
+class ScriptFunction<R(Args...)>
+{
+private:
+
+  Bytecode *bytecode;
+  INT id;
+  ExecutionContext::ExecutionStatus status;
+
+public:
+
+  typedef ScriptParameters<Args...> Parameters;
+
+  static const INT returnTypeId = ScriptType<R>::typeId;
+
+  // functions returning more than this can't be bound
+  static const INT32 maxReturnSize = 2 * sizeof(INT);
+
+  ScriptFunction(Bytecode *_bytecode = nullptr, INT _id = -1) : bytecode(_bytecode), id(_id), status(ExecutionContext::NotPrepared) { }
+
+  inline bool IsValid() const { return bytecode != nullptr && id >= 0; }
+
+  inline INT GetId() const { return id; }
+
+  // status of the last call, its return value is zero unless it Returned
+  inline ExecutionContext::ExecutionStatus GetStatus() const { return status; }
+
+  R operator()(Args... args)
+  {
+    INT params[Parameters::size / sizeof(INT) + 1];
+    Parameters::Write((char*)params, args...);
+    INT returnMemory[maxReturnSize / sizeof(INT)] = {};
+
+    // the function's bytecode changes when it is optimized while running, its id doesn't
+    ExecutionContext context(bytecode, bytecode->GetCalledFunctionBytecode(id));
+    context.SetParameter((char*)params);
+    context.SetReturnMemory((char*)returnMemory);
+    context.Execute();
+    status = context.GetStatus();
+
+    return ScriptType<R>::Read((char*)returnMemory);
+  }
+
+};
@@ -0,0 +1,263 @@
+#include "TickScheduler.h"
+#include "Bytecode.h"
+#include "FrameStack.h"
+
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+
+static INT64 Now()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+TickScheduler::TickScheduler(Bytecode *_bytecode, INT _budget)
+  : bytecode(_bytecode),
+  budget(_budget),
+  tick(0),
+  slicesRun(0),
+  instanceCount(0)
+{
+  memset(&stats, 0, sizeof(stats));
+}
+
+TickScheduler::~TickScheduler()
+{
+  // a suspended context pops its frames from its frame stack
+  for(auto instance : instances)
+  {
+    delete instance->context;
+    delete instance->frameStack;
+    delete instance;
+  }
+}
+
+INT TickScheduler::Spawn(INT functionId, const char *params, INT32 parameterSize, INT priority, Callback callback)
+{
+  if(functionId < 0 || functionId >= (INT)bytecode->functionBytecodes.size() || !bytecode->functionBytecodes[functionId])
+    return -1;
+
+  FunctionBytecode *function = bytecode->functionBytecodes[functionId];
+  if(function->parameterSize != parameterSize || function->optimizedInstructions[0].param3 > maxReturnSize)
+    return -1;
+  if(priority < 0 || priority >= priorityLevels)
+    return -1;
+
+  function = bytecode->GetCalledFunctionBytecode(functionId);
+
+  // the most recently stopped instance has its frames in cache
+  INT id;
+  Instance *instance;
+  if(freeIds.empty())
+  {
+    id = (INT)instances.size();
+    instance = new Instance();
+    instance->sequence = 0;
+    instance->frameStack = new FrameStack(frameStackSize);
+    instance->context = new ExecutionContext(bytecode, function, instance->frameStack, true);
+    instance->context->SetBudget(budget);
+    instances.push_back(instance);
+  }
+  else
+  {
+    id = freeIds.back();
+    freeIds.pop_back();
+    instance = instances[id];
+    instance->context->Reset(function);
+  }
+
+  instance->priority = priority;
+  instance->params.assign(params, params + parameterSize);
+  memset(instance->returnMemory, 0, sizeof(instance->returnMemory));
+  instance->callback = callback;
+  instance->context->SetParameter(instance->params.data());
+  instance->context->SetReturnMemory((char*)instance->returnMemory);
+
+  ++instanceCount;
+  Queue(id, IS_Ready);
+  return id;
+}
+
+bool TickScheduler::Sleep(INT id, INT64 ticks)
+{
+  if(id < 0 || id >= (INT)instances.size() || instances[id]->state == IS_Free)
+    return false;
+
+  instances[id]->wakeTick = tick + ticks;
+  Queue(id, IS_Sleeping);
+  return true;
+}
+
+bool TickScheduler::Stop(INT id)
+{
+  if(id < 0 || id >= (INT)instances.size() || instances[id]->state == IS_Free)
+    return false;
+
+  // frames of a suspended instance are popped when its context is used again
+  instances[id]->state = IS_Free;
+  instances[id]->callback = nullptr;
+  ++instances[id]->sequence;
+  freeIds.push_back(id);
+  --instanceCount;
+  return true;
+}
+
+void TickScheduler::Queue(INT id, InstanceState state)
+{
+  Instance *instance = instances[id];
+  instance->state = state;
+  QueueEntry entry(id, ++instance->sequence);
+
+  if(state == IS_Ready)
+  {
+    instance->readySlice = slicesRun;
+    readyQueues[instance->priority].push_back(entry);
+  }
+  else if(state == IS_Suspended)
+    suspended.push_back(entry);
+  else
+    sleeping.push(SleepEntry(instance->wakeTick, entry));
+}
+
+bool TickScheduler::IsQueued(const QueueEntry &entry, InstanceState state)
+{
+  Instance *instance = instances[entry.first];
+  return instance->sequence == entry.second && instance->state == state;
+}
+
+INT TickScheduler::TakeReady()
+{
+  // the first instance of a queue waited longest in it, only those are compared
+  INT taken = -1;
+  INT64 takenPriority = 0;
+  INT64 takenAge = 0;
+  for(INT priority = priorityLevels - 1; priority >= 0; --priority)
+  {
+    std::deque<QueueEntry> &queue = readyQueues[priority];
+    while(!queue.empty() && !IsQueued(queue.front(), IS_Ready))
+      queue.pop_front();
+    if(queue.empty())
+      continue;
+
+    INT64 age = slicesRun - instances[queue.front().first]->readySlice;
+    INT64 agedPriority = priority + age / agingSlices;
+    if(taken == -1 || agedPriority > takenPriority || (agedPriority == takenPriority && age > takenAge))
+    {
+      taken = priority;
+      takenPriority = agedPriority;
+      takenAge = age;
+    }
+  }
+
+  if(taken == -1)
+    return -1;
+
+  INT id = readyQueues[taken].front().first;
+  readyQueues[taken].pop_front();
+  return id;
+}
+
+bool TickScheduler::Run(INT id, INT64 deadline)
+{
+  ExecutionContext *context = instances[id]->context;
+  bool late = false;
+
+  for(INT slice = 0; ; ++slice)
+  {
+    if(context->GetStatus() == ExecutionContext::NotPrepared)
+      context->Execute();
+    else
+      context->Resume();
+    ++stats.slices;
+    ++slicesRun;
+
+    late = Now() >= deadline;
+    if(context->GetStatus() != ExecutionContext::Preempted || late || slice + 1 == hotSlices)
+      break;
+  }
+
+  if(context->GetStatus() == ExecutionContext::Preempted)
+    Queue(id, IS_Ready);
+  else if(context->GetStatus() == ExecutionContext::Suspended)
+    Queue(id, IS_Suspended);
+  else
+    Finish(id);
+  return late;
+}
+
+void TickScheduler::Finish(INT id)
+{
+  Instance *instance = instances[id];
+  ExecutionContext::ExecutionStatus status = instance->context->GetStatus();
+  INT returnMemory[maxReturnSize / sizeof(INT)] = {};
+  if(status == ExecutionContext::Returned)
+    memcpy(returnMemory, instance->returnMemory, sizeof(returnMemory));
+  Callback callback = instance->callback;
+
+  // the callback can spawn an instance with the same id
+  Stop(id);
+  ++stats.finished;
+
+  if(callback)
+    callback(id, status, (char*)returnMemory);
+}
+
+const TickScheduler::TickStats &TickScheduler::Tick(INT64 microseconds)
+{
+  INT64 start = Now();
+  ++tick;
+  memset(&stats, 0, sizeof(stats));
+  stats.tick = tick;
+
+  // instances left ready by the last tick are already queued, the ones waiting for this tick go behind them
+  while(!sleeping.empty() && sleeping.top().first <= tick)
+  {
+    QueueEntry entry = sleeping.top().second;
+    sleeping.pop();
+    if(IsQueued(entry, IS_Sleeping))
+      Queue(entry.first, IS_Ready);
+  }
+
+  std::vector<QueueEntry> waking;
+  waking.swap(suspended);
+  for(auto &entry : waking)
+    if(IsQueued(entry, IS_Suspended))
+      Queue(entry.first, IS_Ready);
+
+  // instances yielding in this tick are suspended until the next one
+  bool late = false;
+  for(INT id = TakeReady(); id != -1; id = TakeReady())
+  {
+    late = Run(id, start + microseconds);
+    if(late)
+      break;
+  }
+
+  if(late)
+  {
+    for(auto &queue : readyQueues)
+      for(auto &entry : queue)
+        stats.waiting += IsQueued(entry, IS_Ready) ? 1 : 0;
+  }
+
+  stats.microseconds = Now() - start;
+  if((INT)tickDurations.size() < statsTicks)
+    tickDurations.push_back(stats.microseconds);
+  else
+    tickDurations[(size_t)((tick - 1) % statsTicks)] = stats.microseconds;
+  return stats;
+}
+
+INT64 TickScheduler::GetTickPercentile(double percentile)
+{
+  if(tickDurations.empty())
+    return 0;
+
+  // the smallest duration at least percentile percent of ticks are not longer than
+  std::vector<INT64> durations(tickDurations);
+  INT count = (INT)durations.size();
+  INT rank = std::min(std::max((INT)ceil(percentile * count / 100.0), (INT)1), count);
+  std::nth_element(durations.begin(), durations.begin() + rank - 1, durations.end());
+  return durations[rank - 1];
+}
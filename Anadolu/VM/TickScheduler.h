@@ -0,0 +1,168 @@
+#pragma once
+
+#include "Parser/PrimitiveTypes.h"
+#include "ExecutionContext.h"
+
+#include <vector>
+#include <deque>
+#include <queue>
+#include <functional>
+
+class Bytecode;
+class FrameStack;
+
+// Runs many resident script instances a little on each tick of the host, on the thread calling Tick.
+// each instance is a coroutine with a frame stack of its own. it runs in slices of budget back-edges and calls,
+// a tick runs slices of ready instances until none is left or the deadline passes. instances left ready run
+// first on the next tick, before the ones that yielded or woke up, nothing waits more than its turn.
+// higher priorities run first, instances of a priority run in turn. an instance waiting while others run
+// ages into higher priorities, so under a steady load of higher ones lower ones still get slices.
+// an instance that yields is suspended until the next tick, a sleeping one until the tick it sleeps to.
+// must be destroyed before the bytecode is generated again
+class TickScheduler
+{
+public:
+
+  // called when an instance stops. return memory of the call is zero unless it Returned
+  typedef std::function<void(INT id, ExecutionContext::ExecutionStatus status, const char *returnValue)> Callback;
+
+  // priorities an instance can have, from 0. higher ones run first
+  static const INT priorityLevels = 4;
+
+  // functions returning more than this can't be spawned
+  static const INT32 maxReturnSize = 2 * sizeof(INT);
+
+  // back-edges and calls of a slice
+  static const INT defaultBudget = 1000;
+
+  // slices a preempted instance runs in a row while its frames are in cache, then it goes behind the others
+  static const INT hotSlices = 4;
+
+  // slices of other instances a ready instance waits for each priority it gains
+  static const INT agingSlices = 16;
+
+  // frame stacks of instances grow from this size
+  static const size_t frameStackSize = 1024;
+
+  // ticks kept for percentiles
+  static const INT statsTicks = 1024;
+
+  class TickStats
+  {
+  public:
+
+    INT64 tick;
+    INT slices;
+    INT finished;
+
+    // instances still ready when the deadline passed, the tick ran out of time if it is not 0
+    INT waiting;
+
+    INT64 microseconds;
+
+  };
+
+private:
+
+  enum InstanceState
+  {
+    IS_Free,
+    IS_Ready,
+    IS_Suspended,
+    IS_Sleeping
+  };
+
+  class Instance
+  {
+  public:
+
+    InstanceState state;
+    INT priority;
+    INT64 wakeTick;
+
+    // slices run by the scheduler when the instance became ready, its age is counted from here
+    INT64 readySlice;
+
+    // changes each time the instance is queued, entries of queues it left are skipped
+    INT sequence;
+
+    // the context and its frame stack are kept for the next instance when it stops
+    ExecutionContext *context;
+    FrameStack *frameStack;
+
+    std::vector<char> params;
+    INT returnMemory[maxReturnSize / sizeof(INT)];
+    Callback callback;
+
+  };
+
+  // an instance and its sequence when it was queued
+  typedef std::pair<INT, INT> QueueEntry;
+
+  Bytecode *bytecode;
+  INT budget;
+  INT64 tick;
+
+  // slices run since the scheduler was made
+  INT64 slicesRun;
+
+  // instances by id, ids of stopped ones are reused most recent first
+  std::vector<Instance*> instances;
+  std::vector<INT> freeIds;
+  INT instanceCount;
+
+  std::deque<QueueEntry> readyQueues[priorityLevels];
+  std::vector<QueueEntry> suspended;
+
+  // earliest wake tick on top
+  typedef std::pair<INT64, QueueEntry> SleepEntry;
+  std::priority_queue<SleepEntry, std::vector<SleepEntry>, std::greater<SleepEntry>> sleeping;
+
+  TickStats stats;
+
+  // durations of the last statsTicks ticks in microseconds, used as a ring
+  std::vector<INT64> tickDurations;
+
+  void Queue(INT id, InstanceState state);
+  bool IsQueued(const QueueEntry &entry, InstanceState state);
+
+  // ready instance of the highest priority after aging, the one waiting longest if there are more.
+  // -1 if there is none
+  INT TakeReady();
+
+  // runs slices of the instance until it stops, yields, runs hotSlices of them or the deadline passes.
+  // true if the deadline passed
+  bool Run(INT id, INT64 deadline);
+
+  void Finish(INT id);
+
+public:
+
+  // instances run budget back-edges and calls at a time
+  TickScheduler(Bytecode *_bytecode, INT _budget = defaultBudget);
+
+  // instances still running are dropped without their callbacks
+  ~TickScheduler();
+
+  // makes an instance running the function with a copy of parameterSize bytes of params, it is ready from the next tick.
+  // returns its id, or -1 if there is no such function, the parameter size is not its size,
+  // it returns more than maxReturnSize or the priority is out of range
+  INT Spawn(INT functionId, const char *params, INT32 parameterSize, INT priority, Callback callback);
+
+  // the instance doesn't run until the tick that is ticks after the current one. false if there is no such instance
+  bool Sleep(INT id, INT64 ticks);
+
+  // drops the instance without calling its callback. false if there is no such instance
+  bool Stop(INT id);
+
+  // runs instances until none is ready or microseconds pass. a slice that started always finishes,
+  // a tick can be longer by the time of one slice
+  const TickStats &Tick(INT64 microseconds);
+
+  inline INT64 GetTick() { return tick; }
+  inline INT GetInstanceCount() { return instanceCount; }
+
+  // duration of ticks in microseconds that percentile percent of the last statsTicks ticks are not longer than
+  INT64 GetTickPercentile(double percentile);
+
+};
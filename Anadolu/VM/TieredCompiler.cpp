@@ -0,0 +1,155 @@
+#include "TieredCompiler.h"
+#include "Parser/Package.h"
+#include "Bytecode.h"
+#include "JITCompiler.h"
+#include "InstructionInfo.h"
+
+#include <vector>
+#include <set>
+
+TieredCompiler::TieredCompiler(Bytecode *_bytecode, const BytecodeGenerator &baselineGenerator, OptimizationLevel optimizationLevel, bool _jitEnabled)
+  : callThreshold(defaultCallThreshold),
+  backEdgeThreshold(defaultBackEdgeThreshold),
+  bytecode(_bytecode),
+  jitEnabled(_jitEnabled),
+  inliner(bodies)
+{
+  generator.packages = baselineGenerator.packages;
+  generator.outputFunction = baselineGenerator.outputFunction;
+  generator.registerLimit = baselineGenerator.registerLimit;
+  generator.bytecode = bytecode;
+  generator.optimizationLevel = optimizationLevel;
+}
+
+TieredCompiler::~TieredCompiler()
+{
+  for(auto &loopEntry : loopEntries)
+    delete loopEntry.second;
+}
+
+void TieredCompiler::AddFunction(Function *function, const std::list<Instruction> &instructions)
+{
+  functions[function->id] = function;
+  bodies[function->id] = instructions;
+}
+
+FunctionBytecode *TieredCompiler::TierUp(FunctionBytecode *functionBytecode)
+{
+  FunctionBytecode *current = bytecode->functionBytecodes[functionBytecode->id];
+  if(current->tier != FT_Baseline)
+    return current;
+
+  Function *function = functions[functionBytecode->id];
+
+  FunctionBytecode *optimized = new FunctionBytecode();
+  optimized->id = function->id;
+  optimized->parameterSize = function->parameterSize;
+  optimized->instructions = bodies[function->id];
+  optimized->generatedInstructionCount = optimized->instructions.size();
+  optimized->tier = FT_Optimized;
+  generator.OptimizeFunction(function, optimized, inliner);
+  bytecode->ReplaceFunctionBytecode(function->id, optimized);
+
+  if(jitEnabled)
+  {
+    JITCompiler compiler;
+    compiler.Compile(bytecode, optimized);
+  }
+
+  if(tierUpFunction)
+    tierUpFunction(function->name, FT_Optimized);
+
+  return optimized;
+}
+
+FunctionBytecode *TieredCompiler::CreateLoopEntry(Function *function, INT32 loop)
+{
+  std::list<Instruction> instructions = bodies[function->id];
+  std::vector<Instruction> code(instructions.begin(), instructions.end());
+
+  // loop starts where its jump back goes. nothing is kept in registers between statements
+  INT32 header = -1;
+  for(INT32 i = 0; i < (INT32)code.size() && header == -1; ++i)
+    if(code[i].opCode == OP_Jump && code[i].param1 < 0 && loop-- == 0)
+      header = i + code[i].param1 + 1;
+
+  if(header < 1)
+    return nullptr;
+
+  // locals are only read and written directly, copying every offset and width used copies all of them
+  std::set<std::pair<INT32, INT32>> locals;
+  for(auto &instruction : code)
+  {
+    const InstructionInfo &info = GetInstructionInfo(instruction.opCode);
+    for(INT32 p = 0; p < 3; ++p)
+    {
+      if(info.operands[p].type != OT_Local)
+        continue;
+      if(info.operands[p].width == OW_Pointer)
+        return nullptr;
+      locals.insert(std::make_pair(GetInstructionParam(instruction, p), (INT32)info.operands[p].width));
+    }
+  }
+
+  // locals come after the parameters of the call
+  INT32 paramsSize = (function->parameterSize + 7) & ~7;
+  auto position = ++instructions.begin();
+  for(auto &local : locals)
+    instructions.insert(position, Instruction(local.second == OW_Byte ? OP_CopybLP : OP_CopyiLP, local.first, paramsSize + local.first));
+
+  // AllocL and the copies are before every instruction, jump offsets between the others stay the same
+  instructions.insert(position, Instruction(OP_Jump, header - 1));
+
+  FunctionBytecode *loopEntry = new FunctionBytecode();
+  loopEntry->id = function->id;
+  loopEntry->parameterSize = paramsSize + function->stackSize;
+  loopEntry->instructions.swap(instructions);
+  loopEntry->generatedInstructionCount = loopEntry->instructions.size();
+  loopEntry->tier = FT_Optimized;
+  generator.OptimizeFunction(function, loopEntry, inliner, true);
+
+  if(jitEnabled)
+  {
+    JITCompiler compiler;
+    compiler.Compile(bytecode, loopEntry);
+  }
+
+  return loopEntry;
+}
+
+FunctionBytecode *TieredCompiler::EnterLoop(FunctionBytecode *functionBytecode, INT32 jumpIndex)
+{
+  if(functionBytecode->tier != FT_Baseline)
+    return nullptr;
+
+  TierUp(functionBytecode);
+
+  auto key = std::make_pair(functionBytecode->id, GetLoop(functionBytecode, jumpIndex));
+  auto loopEntry = loopEntries.find(key);
+  if(loopEntry == loopEntries.end())
+    loopEntry = loopEntries.insert(std::make_pair(key, CreateLoopEntry(functions[functionBytecode->id], key.second))).first;
+
+  return loopEntry->second;
+}
+
+INT32 TieredCompiler::GetLoop(FunctionBytecode *functionBytecode, INT32 jumpIndex)
+{
+  // loops are numbered by their jumps back, baseline bytecode has the same jumps as the generated instructions
+  INT32 loop = 0;
+  for(INT32 i = 0; i < jumpIndex; ++i)
+  {
+    Instruction &instruction = functionBytecode->optimizedInstructions[i];
+    if(instruction.opCode == OP_Jump && instruction.param1 < 0)
+      ++loop;
+  }
+  return loop;
+}
+
+bool TieredCompiler::IsCompiled(FunctionBytecode *functionBytecode, INT32 jumpIndex)
+{
+  if(bytecode->functionBytecodes[functionBytecode->id]->tier == FT_Baseline)
+    return false;
+
+  return jumpIndex == -1 || functionBytecode->tier != FT_Baseline ||
+    loopEntries.count(std::make_pair(functionBytecode->id, GetLoop(functionBytecode, jumpIndex))) != 0;
+}
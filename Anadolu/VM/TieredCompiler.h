@@ -0,0 +1,87 @@
+#pragma once
+
+#include "BytecodeGenerator.h"
+#include "Inliner.h"
+
+#include <list>
+#include <map>
+#include <unordered_map>
+#include <string>
+#include <functional>
+
+class Bytecode;
+class FunctionBytecode;
+class Function;
+
+// Functions start at a cheap optimization level and are optimized again once they are used a lot.
+// The interpreter counts calls and loops going back in each function. A function crossing a threshold
+// is optimized at the level of the VM from the instructions it was generated with, and compiled to native code
+// if the JIT is enabled. Calls made after that go to the new bytecode.
+// A running call that loops long enough moves into a loop entry, optimized bytecode that starts in that loop
+class TieredCompiler
+{
+public:
+
+  enum Tier
+  {
+    FT_Baseline, // instructions optimized at baselineLevel
+    FT_Optimized // optimized at the level of the VM, native code if it could be compiled
+  };
+
+  static const OptimizationLevel baselineLevel = OL_None;
+
+  static const INT32 defaultCallThreshold = 1000;
+  static const INT32 defaultBackEdgeThreshold = 10000;
+
+  // called with the function name and its new tier each time a function goes to a higher tier
+  std::function<void(const std::string &functionName, INT32 tier)> tierUpFunction;
+
+  INT32 callThreshold;
+  INT32 backEdgeThreshold;
+
+private:
+
+  Bytecode *bytecode;
+
+  // optimizes functions going to FT_Optimized
+  BytecodeGenerator generator;
+
+  bool jitEnabled;
+
+  // instructions of each function as the generator gave them and the function they are for, by function id
+  std::unordered_map<INT32, std::list<Instruction>> bodies;
+  std::unordered_map<INT32, Function*> functions;
+
+  Inliner inliner;
+
+  // by function id and loop number, null if the loop can't be entered
+  std::map<std::pair<INT32, INT32>, FunctionBytecode*> loopEntries;
+
+  // optimized bytecode that takes parameters and locals of a running call as its parameters,
+  // copies the locals and jumps to the start of the loop
+  FunctionBytecode *CreateLoopEntry(Function *function, INT32 loop);
+
+  // number of the loop closed by the jump at jumpIndex of baseline bytecode
+  INT32 GetLoop(FunctionBytecode *functionBytecode, INT32 jumpIndex);
+
+public:
+
+  TieredCompiler(Bytecode *_bytecode, const BytecodeGenerator &baselineGenerator, OptimizationLevel optimizationLevel, bool _jitEnabled);
+
+  ~TieredCompiler();
+
+  // keeps the instructions of a function before they are optimized
+  void AddFunction(Function *function, const std::list<Instruction> &instructions);
+
+  // optimizes the function unless it is optimized already, returns the bytecode its calls should use
+  FunctionBytecode *TierUp(FunctionBytecode *functionBytecode);
+
+  // optimizes the function and returns the entry for the loop closed by the jump at jumpIndex of its baseline bytecode.
+  // its parameters are the parameters of the call (parameterSize rounded up to 8 bytes), then its locals.
+  // returns null if the running call should stay where it is
+  FunctionBytecode *EnterLoop(FunctionBytecode *functionBytecode, INT32 jumpIndex);
+
+  // true if TierUp, or EnterLoop when jumpIndex isn't -1, would return without compiling anything
+  bool IsCompiled(FunctionBytecode *functionBytecode, INT32 jumpIndex);
+
+};
@@ -3,11 +3,56 @@
 #include "Parser/Package.h"
 #include "BytecodeGenerator.h"
 #include "Bytecode.h"
+#include "JITCompiler.h"
+#include "TieredCompiler.h"
+#include "AOTCompiler.h"
+#include "ExecutionContext.h"
+#include "Scheduler.h"
+
+#include <algorithm>
+
+VM::VM()
+  : bytecode(nullptr),
+  optimizationLevel(OL_Full),
+  jitEnabled(false),
+  tieringEnabled(false),
+  callThreshold(TieredCompiler::defaultCallThreshold),
+  backEdgeThreshold(TieredCompiler::defaultBackEdgeThreshold),
+  tieredCompiler(nullptr),
+  scheduler(nullptr)
+{
+}
 
 VM::~VM()
 {
+  StopScheduler();
+
   if(bytecode)
     delete bytecode;
+
+  if(tieredCompiler)
+    delete tieredCompiler;
+}
+
+Scheduler *VM::StartScheduler(INT workerCount)
+{
+  StopScheduler();
+  if(bytecode)
+    scheduler = new Scheduler(bytecode, workerCount);
+  return scheduler;
+}
+
+void VM::StopScheduler()
+{
+  delete scheduler;
+  scheduler = nullptr;
+}
+
+void VM::SetTiering(bool enabled, INT32 _callThreshold, INT32 _backEdgeThreshold)
+{
+  tieringEnabled = enabled;
+  callThreshold = _callThreshold;
+  backEdgeThreshold = _backEdgeThreshold;
 }
 
 void VM::AddPackage(Package *package)
@@ -25,19 +70,93 @@ void VM::RemovePackage(Package *package)
   //TODO: report error
 }
 
+void VM::AddCompiledFunctions(const CompiledFunction *functions, INT count)
+{
+  for(INT i = 0; i < count; ++i)
+    compiledFunctions.push_back(functions + i);
+}
+
+bool VM::UseCompiledFunctions()
+{
+  if(compiledFunctions.empty() || compiledFunctions.size() != bytecode->functionBytecodes.size())
+    return false;
+
+  // compiled functions call each other directly, one changed function makes every compiled function unusable
+  for(auto compiled : compiledFunctions)
+  {
+    auto id = bytecode->globalFunctionNames.find(compiled->name);
+    if(id == bytecode->globalFunctionNames.end() || id->second != compiled->id)
+      return false;
+
+    FunctionBytecode *functionBytecode = bytecode->functionBytecodes[compiled->id];
+    std::vector<Instruction> &instructions = functionBytecode->optimizedInstructions;
+    if(functionBytecode->parameterSize != compiled->parameterSize || (INT32)instructions.size() != compiled->instructionCount)
+      return false;
+
+    for(INT32 i = 0; i < compiled->instructionCount; ++i)
+    {
+      const Instruction &a = instructions[i], &b = compiled->instructions[i];
+      if(a.opCode != b.opCode || a.param1 != b.param1 || a.param2 != b.param2 || a.param3 != b.param3)
+        return false;
+    }
+  }
+
+  for(auto compiled : compiledFunctions)
+    bytecode->functionBytecodes[compiled->id]->nativeCode = compiled->nativeCode;
+
+  return true;
+}
+
 void VM::GetBytecodeAsString(std::string &str, bool linenumbers)
 {
   if(bytecode)
     bytecode->GetByteCode(str, linenumbers);
 }
 
+void VM::GetOptimizationReportAsString(std::string &str)
+{
+  if(bytecode)
+    bytecode->GetOptimizationReport(str);
+}
+
 void VM::GenerateByteCode()
 {
+  // workers run the old bytecode
+  StopScheduler();
+
   if(bytecode) 
     delete bytecode;
 
+  if(tieredCompiler)
+  {
+    delete tieredCompiler;
+    tieredCompiler = nullptr;
+  }
+
   bytecode = new Bytecode();
 
+  // nothing to generate, compiled functions have their bytecode with them
+  if(packages.empty() && !compiledFunctions.empty())
+  {
+    for(auto compiled : compiledFunctions)
+    {
+      FunctionBytecode *functionBytecode = new FunctionBytecode();
+      functionBytecode->id = compiled->id;
+      functionBytecode->parameterSize = compiled->parameterSize;
+      functionBytecode->optimizedInstructions.assign(compiled->instructions, compiled->instructions + compiled->instructionCount);
+      functionBytecode->generatedInstructionCount = compiled->instructionCount;
+      functionBytecode->nativeCode = compiled->nativeCode;
+
+      bytecode->AddFunctionBytecode(functionBytecode);
+      bytecode->globalFunctionNames[compiled->name] = compiled->id;
+    }
+
+    bytecode->Finalise();
+    ExecutionContext::PrepareBytecode(bytecode);
+    status = VM_Available;
+    return;
+  }
+
   BytecodeGenerator generator;
   for(auto &package : packages)
   {
@@ -45,6 +164,7 @@ void VM::GenerateByteCode()
   }
 
   generator.outputFunction = outputFunction;
+  generator.optimizationLevel = tieringEnabled ? TieredCompiler::baselineLevel : optimizationLevel;
 
   for(auto &package : packages)
   {
@@ -54,6 +174,18 @@ void VM::GenerateByteCode()
     }
   }
 
+  if(tieringEnabled && !generator.hasErrors)
+  {
+    // instructions are kept before they are optimized at the baseline level
+    tieredCompiler = new TieredCompiler(bytecode, generator, optimizationLevel, jitEnabled);
+    tieredCompiler->callThreshold = callThreshold;
+    tieredCompiler->backEdgeThreshold = backEdgeThreshold;
+    tieredCompiler->tierUpFunction = tierUpFunction;
+    for(auto &generated : generator.generatedFunctions)
+      tieredCompiler->AddFunction(generated.first, generated.second->instructions);
+  }
+
+  generator.OptimizeFunctions();
   bytecode->Finalise();
 
   if(generator.hasErrors)
@@ -61,12 +193,88 @@ void VM::GenerateByteCode()
     status = VM_Empty;
     delete bytecode;
     bytecode = nullptr;
+
+    if(tieredCompiler)
+    {
+      delete tieredCompiler;
+      tieredCompiler = nullptr;
+    }
   }
   else
+  {
+    bytecode->tieredCompiler = tieredCompiler;
+
+    // packages compiled ahead of time don't need the JIT
+    if(!tieredCompiler && !UseCompiledFunctions() && jitEnabled)
+    {
+      JITCompiler compiler;
+      compiler.Compile(bytecode);
+    }
+
+    ExecutionContext::PrepareBytecode(bytecode);
     status = VM_Available;
+  }
 }
 
 FunctionBytecode *VM::GetGlobalFunctionBytecode(const std::string &name)
 {
-  return bytecode->GetFunctionBytecode(name);
+  return bytecode ? bytecode->GetFunctionBytecode(name) : nullptr;
+}
+
+INT VM::GetGlobalFunctionId(const std::string &name)
+{
+  if(!bytecode)
+    return -1;
+
+  auto it = bytecode->globalFunctionNames.find(name);
+  return it != bytecode->globalFunctionNames.end() ? it->second : -1;
+}
+
+INT VM::BindFunction(const std::string &name, INT returnTypeId, const INT *parameterTypes, INT32 parameterCount,
+  INT32 parameterSize, INT32 maxReturnSize)
+{
+  if(!bytecode)
+    return -1;
+
+  INT id = GetGlobalFunctionId(name);
+  FunctionBytecode *functionBytecode = GetFunctionBytecode(id);
+  if(!functionBytecode || functionBytecode->parameterSize != parameterSize || functionBytecode->optimizedInstructions.empty() ||
+    functionBytecode->optimizedInstructions[0].param3 > maxReturnSize)
+    return -1;
+
+  if(packages.empty())
+    return id;
+
+  for(auto &package : packages)
+  {
+    auto it = package.second->globalFunctionNames.find(name);
+    if(it == package.second->globalFunctionNames.end() || it->second != id)
+      continue;
+
+    Function *function = package.second->globalFunctions[id];
+    if(function->returnTypeId != returnTypeId)
+      return -1;
+
+    // parameters in the order they are in memory
+    std::vector<Parameter*> parameters;
+    if(function->parameterList)
+      for(auto &parameter : function->parameterList->parameters)
+        parameters.push_back(parameter.second);
+    if((INT32)parameters.size() != parameterCount)
+      return -1;
+    std::sort(parameters.begin(), parameters.end(), [](Parameter *a, Parameter *b) { return a->memoryIndex < b->memoryIndex; });
+
+    for(INT32 i = 0; i < parameterCount; ++i)
+      if(parameters[i]->variableType != parameterTypes[i])
+        return -1;
+
+    return id;
+  }
+
+  return -1;
+}
+
+FunctionBytecode *VM::GetFunctionBytecode(INT id)
+{
+  return bytecode && id >= 0 && id < (INT)bytecode->functionBytecodes.size() ? bytecode->functionBytecodes[id] : nullptr;
 }
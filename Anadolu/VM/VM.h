@@ -1,14 +1,21 @@
 #pragma once
 
 #include "Parser/PrimitiveTypes.h"
+#include "BytecodeGenerator.h"
+#include "ScriptFunction.h"
 #include <unordered_map>
 #include <string>
 #include <functional>
+#include <vector>
 
 class Function;
 class Package;
 class Bytecode;
 class FunctionBytecode;
+class TieredCompiler;
+class CompiledFunction;
+class ExecutionContext;
+class Scheduler;
 
 class VM
 {
@@ -17,6 +24,27 @@ private:
   std::unordered_map<std::string, Package*> packages;
   std::function<void(const std::string &msg, INT row, INT column, INT messageLevel)> outputFunction;
   Bytecode *bytecode;
+  OptimizationLevel optimizationLevel;
+  bool jitEnabled;
+
+  bool tieringEnabled;
+  INT32 callThreshold;
+  INT32 backEdgeThreshold;
+  std::function<void(const std::string &functionName, INT32 tier)> tierUpFunction;
+  TieredCompiler *tieredCompiler;
+
+  std::vector<const CompiledFunction*> compiledFunctions;
+
+  // runs calls on worker threads, null unless it is started
+  Scheduler *scheduler;
+
+  // gives functions the native code of their compiled functions if every function is the same as its compiled one
+  bool UseCompiledFunctions();
+
+  // id of the global function if its parameters and return type are the given ones, -1 if not.
+  // without packages only the sizes of parameters and the return value are checked
+  INT BindFunction(const std::string &name, INT returnTypeId, const INT *parameterTypes, INT32 parameterCount,
+    INT32 parameterSize, INT32 maxReturnSize);
 
 public:
 
@@ -26,10 +54,11 @@ public:
     VM_Available
   }status;
 
-  VM() : bytecode(nullptr) { }
+  VM();
 
   ~VM();
 
+  // bytecode can be run by contexts on many threads, the VM itself is used by one thread at a time
   Bytecode* GetBytecode() { return bytecode; } 
 
   void AddPackage(Package *package);
@@ -37,10 +66,61 @@ public:
   // removes the package from available packages. Does not delete the package
   void RemovePackage(Package *package);
 
+  // used by the next GenerateByteCode call
+  void SetOptimizationLevel(OptimizationLevel level) { optimizationLevel = level; }
+
+  // used by the next GenerateByteCode call. functions are compiled to native code where the machine allows it
+  void SetJITEnabled(bool enabled) { jitEnabled = enabled; }
+
+  // used by the next GenerateByteCode call. functions are generated at TieredCompiler::baselineLevel and optimized
+  // at the optimization level once they are called callThreshold times or loop backEdgeThreshold times.
+  // with the JIT enabled only optimized functions are compiled to native code
+  void SetTiering(bool enabled, INT32 callThreshold, INT32 backEdgeThreshold);
+
+  // called with the function name and its new TieredCompiler::Tier each time a function goes to a higher tier
+  void SetTierUpFunction(std::function<void(const std::string &functionName, INT32 tier)> function) { tierUpFunction = function; }
+
+  // used by GenerateByteCode, functions is a table written by AOTCompiler.
+  // if the bytecode of the packages is what the functions were compiled from, it runs the compiled code.
+  // without packages the bytecode is made of the compiled functions, nothing is parsed or generated
+  void AddCompiledFunctions(const CompiledFunction *functions, INT count);
+
   void GenerateByteCode();
 
   void GetBytecodeAsString(std::string &str, bool linenumbers = false);
 
+  void GetOptimizationReportAsString(std::string &str);
+
   FunctionBytecode *GetGlobalFunctionBytecode(const std::string &name);
 
+  // id of a global function for GetFunctionBytecode, -1 if there is no such function or no bytecode yet.
+  // names are hashed only here
+  INT GetGlobalFunctionId(const std::string &name);
+
+  // current bytecode of the function, a function optimized while running gets new bytecode
+  FunctionBytecode *GetFunctionBytecode(INT id);
+
+  // starts workerCount worker threads, one for each core if it is 0, running calls submitted to the returned scheduler.
+  // a scheduler started before is stopped first. null if there is no bytecode.
+  // the scheduler is stopped when the bytecode is generated again or the VM is destroyed
+  Scheduler *StartScheduler(INT workerCount = 0);
+
+  // runs every call submitted to the scheduler and stops its workers
+  void StopScheduler();
+
+  Scheduler *GetScheduler() { return scheduler; }
+
+  // binds a global function to call it from C++, like vm.GetFunction<int(int, bool)>("main").
+  // the handle is not valid if there is no such function or it doesn't have the signature
+  template<typename Signature>
+  ScriptFunction<Signature> GetFunction(const std::string &name)
+  {
+    typedef ScriptFunction<Signature> Handle;
+    INT parameterTypes[Handle::Parameters::count + 1];
+    Handle::Parameters::GetTypes(parameterTypes);
+
+    INT id = BindFunction(name, Handle::returnTypeId, parameterTypes, Handle::Parameters::count, Handle::Parameters::size, Handle::maxReturnSize);
+    return id >= 0 ? Handle(bytecode, id) : Handle();
+  }
+
 };
\ No newline at end of file
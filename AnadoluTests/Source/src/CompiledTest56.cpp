@@ -0,0 +1,184 @@
+// Test56 compiled by AOTCompiler. compile the package again instead of changing this file
+#include "VM/AOTCompiler.h"
+
+#include <string.h>
+
+static_assert(OP_NumOfOpCodes == 152, "instructions changed, compile the package again");
+
+static INT32 Test56_Add(ExecutionContext *context, char *params, char *returnValue);
+static INT32 Test56_Sum(ExecutionContext *context, char *params, char *returnValue);
+static INT32 Test56_Divide(ExecutionContext *context, char *params, char *returnValue);
+static INT32 Test56_main(ExecutionContext *context, char *params, char *returnValue);
+
+static const Instruction Test56_Add_instructions[] =
+{
+  Instruction((OpCode)2, 0, 0, 4),
+  Instruction((OpCode)71, 0, 0, 4),
+  Instruction((OpCode)109, 0, 0, 0),
+  Instruction((OpCode)3, 0, 0, 0),
+  Instruction((OpCode)135, 0, 0, 0),
+};
+
+static INT32 Test56_Add(ExecutionContext *context, char *params, char *returnValue)
+{
+  INT frame[(0 + 0) / sizeof(INT) + 1];
+  char *locals = (char*)frame;
+  INT *registers = (INT*)(locals + 0);
+  memset(frame, 0, 0 + 1 * sizeof(INT));
+
+  *(INT32*)(registers + 0) = (INT32)((uint32_t)*(INT32*)(params + 0) + (uint32_t)*(INT32*)(params + 4));
+  *(INT32*)returnValue = *(INT32*)(registers + 0);
+  return ExecutionContext::Returned;
+}
+
+static const Instruction Test56_Sum_instructions[] =
+{
+  Instruction((OpCode)2, 0, 3, 4),
+  Instruction((OpCode)18, 0, 0, 4),
+  Instruction((OpCode)105, 0, 0, 0),
+  Instruction((OpCode)109, 0, 0, 0),
+  Instruction((OpCode)3, 0, 0, 0),
+  Instruction((OpCode)135, 0, 0, 0),
+  Instruction((OpCode)90, 0, 0, 1),
+  Instruction((OpCode)19, 0, 0, 2),
+  Instruction((OpCode)105, 1, 0, 0),
+  Instruction((OpCode)7, 6, 0, 0),
+  Instruction((OpCode)28, 2, 4, 0),
+  Instruction((OpCode)100, 3, 0, 1),
+  Instruction((OpCode)32, 2, 0, 3),
+  Instruction((OpCode)29, 1, 3, 2),
+  Instruction((OpCode)30, 2, 0, 0),
+  Instruction((OpCode)73, 1, 0, 3),
+  Instruction((OpCode)69, 0, 0, 1),
+  Instruction((OpCode)109, 0, 0, 0),
+  Instruction((OpCode)3, 0, 0, 0),
+  Instruction((OpCode)135, 0, 0, 0),
+};
+
+static INT32 Test56_Sum(ExecutionContext *context, char *params, char *returnValue)
+{
+  INT frame[(0 + 8) / sizeof(INT) + 4];
+  char *locals = (char*)frame;
+  INT *registers = (INT*)(locals + 0);
+  char *calls = (char*)(registers + 4);
+  INT32 status;
+  memset(frame, 0, 0 + 4 * sizeof(INT));
+
+  if(*(INT32*)(params + 0) != 0)
+    goto L6;
+  *(INT32*)(registers + 0) = (INT32)(0);
+  *(INT32*)returnValue = *(INT32*)(registers + 0);
+  return ExecutionContext::Returned;
+L6:
+  *(INT32*)(registers + 0) = (INT32)((uint32_t)*(INT32*)(params + 0) - (uint32_t)1);
+  if(*(INT32*)(registers + 0) != 0)
+    goto L10;
+  *(INT32*)(registers + 1) = (INT32)(0);
+  goto L16;
+L10:
+  registers[2] = (INT)(calls + 0);
+  *(INT32*)(registers + 3) = (INT32)((uint32_t)*(INT32*)(registers + 0) - (uint32_t)1);
+  memcpy((char*)registers[2] + 0, registers + 3, 4);
+  status = AOTCompiler::Call(context, Test56_Sum, 1, (char*)registers[2], (char*)(registers + 3));
+  if(status != ExecutionContext::Returned)
+    return status;
+  *(INT32*)(registers + 1) = (INT32)((uint32_t)*(INT32*)(registers + 0) + (uint32_t)*(INT32*)(registers + 3));
+L16:
+  *(INT32*)(registers + 0) = (INT32)((uint32_t)*(INT32*)(params + 0) + (uint32_t)*(INT32*)(registers + 1));
+  *(INT32*)returnValue = *(INT32*)(registers + 0);
+  return ExecutionContext::Returned;
+}
+
+static const Instruction Test56_Divide_instructions[] =
+{
+  Instruction((OpCode)2, 0, 0, 4),
+  Instruction((OpCode)18, 4, 0, 4),
+  Instruction((OpCode)144, 0, 0, 4),
+  Instruction((OpCode)109, 0, 0, 0),
+  Instruction((OpCode)3, 0, 0, 0),
+  Instruction((OpCode)135, 0, 0, 0),
+  Instruction((OpCode)144, 0, 0, 4),
+  Instruction((OpCode)77, 0, 0, 1),
+  Instruction((OpCode)109, 0, 0, 0),
+  Instruction((OpCode)3, 0, 0, 0),
+  Instruction((OpCode)135, 0, 0, 0),
+};
+
+static INT32 Test56_Divide(ExecutionContext *context, char *params, char *returnValue)
+{
+  INT frame[(0 + 0) / sizeof(INT) + 1];
+  char *locals = (char*)frame;
+  INT *registers = (INT*)(locals + 0);
+  memset(frame, 0, 0 + 1 * sizeof(INT));
+
+  if(*(INT32*)(params + 4) != 0)
+    goto L6;
+  *(INT32*)(registers + 0) = (INT32)(*(INT32*)(params + 4) == 0 ? 0 : *(INT32*)(params + 0) / *(INT32*)(params + 4));
+  *(INT32*)returnValue = *(INT32*)(registers + 0);
+  return ExecutionContext::Returned;
+L6:
+  *(INT32*)(registers + 0) = (INT32)(*(INT32*)(params + 4) == 0 ? 0 : *(INT32*)(params + 0) / *(INT32*)(params + 4));
+  *(INT32*)(registers + 0) = (INT32)((uint32_t)*(INT32*)(registers + 0) + (uint32_t)1);
+  *(INT32*)returnValue = *(INT32*)(registers + 0);
+  return ExecutionContext::Returned;
+}
+
+static const Instruction Test56_main_instructions[] =
+{
+  Instruction((OpCode)2, 12, 1, 4),
+  Instruction((OpCode)28, 0, 4, 0),
+  Instruction((OpCode)105, 1, 998, 0),
+  Instruction((OpCode)32, 0, 0, 1),
+  Instruction((OpCode)29, 1, 1, 0),
+  Instruction((OpCode)30, 0, 0, 0),
+  Instruction((OpCode)77, 0, 1, 999),
+  Instruction((OpCode)77, 0, 0, 1000),
+  Instruction((OpCode)105, 1, 0, 0),
+  Instruction((OpCode)10, 1, 100, 1),
+  Instruction((OpCode)27, 1, 100, -1),
+  Instruction((OpCode)77, 0, 0, 15),
+  Instruction((OpCode)73, 0, 0, 1),
+  Instruction((OpCode)109, 0, 0, 0),
+  Instruction((OpCode)3, 0, 0, 0),
+  Instruction((OpCode)135, 0, 0, 0),
+};
+
+static INT32 Test56_main(ExecutionContext *context, char *params, char *returnValue)
+{
+  INT frame[(16 + 8) / sizeof(INT) + 2];
+  char *locals = (char*)frame;
+  INT *registers = (INT*)(locals + 16);
+  char *calls = (char*)(registers + 2);
+  INT32 status;
+  memset(frame, 0, 16 + 2 * sizeof(INT));
+
+  registers[0] = (INT)(calls + 0);
+  *(INT32*)(registers + 1) = (INT32)(998);
+  memcpy((char*)registers[0] + 0, registers + 1, 4);
+  status = AOTCompiler::Call(context, Test56_Sum, 1, (char*)registers[0], (char*)(registers + 1));
+  if(status != ExecutionContext::Returned)
+    return status;
+  *(INT32*)(registers + 0) = (INT32)((uint32_t)*(INT32*)(registers + 1) + (uint32_t)999);
+  *(INT32*)(registers + 0) = (INT32)((uint32_t)*(INT32*)(registers + 0) + (uint32_t)1000);
+  *(INT32*)(registers + 1) = (INT32)(0);
+  if(*(INT32*)(registers + 1) == 100)
+    goto L11;
+L10:
+  if(++*(INT32*)(registers + 1) != 100)
+    goto L10;
+L11:
+  *(INT32*)(registers + 0) = (INT32)((uint32_t)*(INT32*)(registers + 0) + (uint32_t)15);
+  *(INT32*)(registers + 0) = (INT32)((uint32_t)*(INT32*)(registers + 0) + (uint32_t)*(INT32*)(registers + 1));
+  *(INT32*)returnValue = *(INT32*)(registers + 0);
+  return ExecutionContext::Returned;
+}
+
+extern const CompiledFunction Test56_functions[] =
+{
+  { "Add", 0, 8, Test56_Add_instructions, 5, Test56_Add },
+  { "Sum", 1, 4, Test56_Sum_instructions, 20, Test56_Sum },
+  { "Divide", 2, 8, Test56_Divide_instructions, 11, Test56_Divide },
+  { "main", 3, 0, Test56_main_instructions, 16, Test56_main },
+};
+
+extern const INT Test56_functionCount = 4;
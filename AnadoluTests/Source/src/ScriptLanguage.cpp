@@ -4,15 +4,42 @@
 #include "VM/VM.h"
 #include "VM/Bytecode.h"
 #include "VM/BytecodeGenerator.h"
+#include "VM/InstructionInfo.h"
 #include "VM/ExecutionContext.h"
+#include "VM/FrameStack.h"
+#include "VM/Scheduler.h"
+#include "VM/TickScheduler.h"
+#include "VM/AOTCompiler.h"
 
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <chrono>
+#include <thread>
+#include <algorithm>
+#include <atomic>
+#include <memory>
 
 using namespace std;
 
+// tests run after this is set compile their functions to native code
+bool compileToNative = false;
+
+// tests run after this is set generate their bytecode at this level
+OptimizationLevel optimizationLevel = OL_Full;
+
+// tests run after this is set optimize their functions once they are called or loop often enough
+bool tiered = false;
+INT tierUpCount = 0;
+
+// functions of Test56 compiled ahead of time, written by CompileTestFile
+extern const CompiledFunction Test56_functions[];
+extern const INT Test56_functionCount;
+
+// tests run while this is set use these compiled functions if they match
+const CompiledFunction *compiledFunctions = nullptr;
+INT compiledFunctionCount = 0;
+
 void MessageOut(const std::string &msg, INT row, INT column, INT messageLevel)
 {
   if(messageLevel = MESSAGE_ERROR)
@@ -36,10 +63,20 @@ void LoadFile(const std::string &fileName, std::string &content )
 
 }
 
-// runs test file, returns result as integer
-INT RunTestFile(const std::string &file,  INT numOfBytesParameters, bool printInstructions = false)
+// a test script with its bytecode generated, the package is deleted after the VM
+class TestVM
+{
+public:
+
+  std::unique_ptr<Package> package;
+  VM vm;
+
+};
+
+// parses the test and generates its bytecode with the settings of the tests running now.
+// null if the script has errors or no bytecode is generated
+std::unique_ptr<TestVM> LoadTestVM(const std::string &file)
 {
-  INT returnValue = -1;
   string input;
   LoadFile(file, input);
   PackageInfo packageInfo;
@@ -48,67 +85,658 @@ INT RunTestFile(const std::string &file,  INT numOfBytesParameters, bool printIn
 
   PackageParser parser(packageInfo);
   parser.outputFunction = MessageOut;
-  Package *package = parser.Parse();
 
-  if(package)
+  std::unique_ptr<TestVM> test(new TestVM());
+  test->package.reset(parser.Parse());
+  if(!test->package)
   {
-    VM vm;
-    vm.AddPackage(package);
-    vm.GenerateByteCode();
+    std::cout << "Errors in " << file << "!\n";
+    return nullptr;
+  }
 
-    if(vm.status == VM::VM_Available)
-    {
+  /*
+  std::string out;
+  Node::ConvertToString(parser.GetMainNode(), packageInfo, out);
+  std::cout << out;
+  */
+
+  VM &vm = test->vm;
+  vm.AddPackage(test->package.get());
+  vm.SetOptimizationLevel(optimizationLevel);
+  vm.SetJITEnabled(compileToNative);
+  vm.SetTiering(tiered, 10, 100);
+  vm.SetTierUpFunction([](const std::string &functionName, INT32 tier) { ++tierUpCount; });
+  if(compiledFunctions)
+    vm.AddCompiledFunctions(compiledFunctions, compiledFunctionCount);
+  vm.GenerateByteCode();
+
+  if(vm.status != VM::VM_Available)
+    return nullptr;
+  return test;
+}
+
+// ends the line a test printed its name on
+void PrintResult(bool success)
+{
+  std::cout << (success ? " [ Success! ]\n" : " [ Failed! ]\n");
+  std::cout << "---\n";
+}
+
+// grows a frame stack to three chunks and empties it, then pushes a frame larger than the two empty chunks.
+// the frame and one pushed after it are filled, neither may change the other
+void RunFrameStackTest()
+{
+  FrameStack frameStack(1024);
+  char *base = frameStack.Push(1000);
+  frameStack.Push(2000);
+  frameStack.Push(4000);
+  frameStack.Pop(base);
+
+  frameStack.Push(1000);
+  char *frame = frameStack.Push(5000);
+  memset(frame, 1, 5000);
+  char *next = frameStack.Push(8000);
+  memset(next, 2, 8000);
+
+  bool result = true;
+  for(INT i = 0; i < 5000; ++i)
+    result = result && frame[i] == 1;
+  for(INT i = 0; i < 8000; ++i)
+    result = result && next[i] == 2;
+
+  std::cout << "frame larger than the empty chunks";
+  PrintResult(result);
+}
+
+// runs test file, returns result as integer
+INT RunTestFile(const std::string &file,  INT numOfBytesParameters, bool printInstructions = false)
+{
+  INT returnValue = -1;
+  std::unique_ptr<TestVM> test = LoadTestVM(file);
+  if(!test)
+    return returnValue;
+
+  VM &vm = test->vm;
+  if(printInstructions)
+  {
+    std::string out;
+    vm.GetBytecodeAsString(out, true);
+    std::cout << "\n " << file << "\nInstructions:\n" << out;
+
+    vm.GetOptimizationReportAsString(out);
+    std::cout << "\nPeephole:\n" << out;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  ExecutionContext context(vm.GetBytecode(), vm.GetGlobalFunctionBytecode("main"));
+  context.CreateReturnMemory();
+  char *params = nullptr;
+  if(numOfBytesParameters)
+  {
+    params = new char[numOfBytesParameters];
+    memset(params, 0, numOfBytesParameters);
+    context.SetParameter(params);
+  }
+
+  context.Execute();
+  auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+  std::cout << "Runtime: " << elapsed.count() << "mcs" << std::endl;
+
+  if(context.GetStatus() == ExecutionContext::Returned)
+    returnValue =  *((INT32*)context.GetReturnValue());
+  else if(context.GetStatus() == ExecutionContext::CallDepthExceeded)
+    std::cout << "Execution stopped: call depth exceeded\n";
+  context.DestroyReturnMemory();
+  delete[] params;
+
+  return returnValue;
+}
+
+// runs main of compiled functions without parsing anything
+void RunCompiledTest(const std::string &name, const CompiledFunction *functions, INT count, INT expectedValue)
+{
+  VM vm;
+  vm.AddCompiledFunctions(functions, count);
+  vm.GenerateByteCode();
+
+  INT ret = -1;
+  ExecutionContext context(vm.GetBytecode(), vm.GetFunctionBytecode(vm.GetGlobalFunctionId("main")));
+  context.CreateReturnMemory();
+  context.Execute();
+  if(context.GetStatus() == ExecutionContext::Returned)
+    ret = *((INT32*)context.GetReturnValue());
+  context.DestroyReturnMemory();
+
+  std::cout << name << " compiled";
+  PrintResult(ret == expectedValue);
+}
+
+// writes C++ source of the test's functions, name prefixes what the source defines
+void CompileTestFile(const std::string &file, const std::string &name, const std::string &outputFile)
+{
+  std::unique_ptr<TestVM> test = LoadTestVM(file);
+  if(!test)
+    return;
 
-      if(printInstructions)
+  std::string source;
+  AOTCompiler::Compile(test->vm.GetBytecode(), name, source);
+  std::ofstream output(outputFile, std::ios::binary);
+  output << source;
+}
+
+// calls main(int, bool) of the test through a typed handle for each n below calls, negating odd ones. returns the sum
+// of the results, or -1 if main can't be bound, a signature main doesn't have can be or main can be found
+// in a VM without packages
+INT RunFunctionTestFile(const std::string &file, INT calls)
+{
+  INT returnValue = -1;
+  std::unique_ptr<TestVM> test = LoadTestVM(file);
+  if(test)
+  {
+    VM &vm = test->vm;
+    auto function = vm.GetFunction<int(int, bool)>("main");
+    bool wrongBound = vm.GetFunction<int(int)>("main").IsValid() || vm.GetFunction<bool(int, bool)>("main").IsValid() ||
+      vm.GetFunction<int(bool, int)>("main").IsValid() || vm.GetFunction<int(int, bool)>("Main").IsValid();
+
+    VM empty;
+    wrongBound = wrongBound || empty.GetFunction<int(int, bool)>("main").IsValid() || empty.GetGlobalFunctionId("main") != -1 ||
+      empty.GetGlobalFunctionBytecode("main") || empty.GetFunctionBytecode(0);
+
+    if(function.IsValid() && !wrongBound)
+    {
+      auto start = std::chrono::steady_clock::now();
+      returnValue = 0;
+      for(INT n = 0; n < calls; ++n)
       {
-        std::string out;
-        vm.GetBytecodeAsString(out, true);
-        std::cout << "\n " << file << "\nInstructions:\n" << out;
+        returnValue += function((int)n, (n & 1) != 0);
+        if(function.GetStatus() != ExecutionContext::Returned)
+          returnValue = -1;
       }
+      auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+      std::cout << "Runtime: " << elapsed.count() << "mcs" << std::endl;
+    }
+  }
+
+  return returnValue;
+}
+
+void RunFunctionTest(const std::string &fileName, INT expectedValue, INT calls)
+{
+  INT ret = RunFunctionTestFile(fileName, calls);
+  std::cout << fileName << " called " << calls << " times";
+  PrintResult(ret == expectedValue);
+}
+
+// calls main(int, bool) of the test like RunFunctionTestFile does, on 1 thread and then on each core at once.
+// every thread runs the same bytecode with a handle of its own. prints calls per millisecond for each,
+// threads add up their sums on their own and write them once. returns false if any thread gets another sum than expected
+bool RunThreadedTestFile(const std::string &file, INT expectedValue, INT calls)
+{
+  bool result = false;
+  std::unique_ptr<TestVM> test = LoadTestVM(file);
+  if(test)
+  {
+    VM &vm = test->vm;
+    auto function = vm.GetFunction<int(int, bool)>("main");
+    result = function.IsValid();
+
+    // at least a few threads even on one core, they still run the bytecode at the same time
+    INT threadCounts[] = { 1, std::max((INT)std::thread::hardware_concurrency(), (INT)4) };
+    for(INT threadCount : threadCounts)
+    {
+      std::vector<INT> sums(threadCount, 0);
+      std::vector<std::thread> threads;
 
       auto start = std::chrono::steady_clock::now();
-      ExecutionContext context(vm.GetBytecode(), vm.GetGlobalFunctionBytecode("main"));
-      context.CreateReturnMemory();
-      char *params = nullptr;
-      if(numOfBytesParameters)
+      for(INT t = 0; t < threadCount; ++t)
       {
-        params = new char[numOfBytesParameters];
-        memset(params, 0, numOfBytesParameters);
-        context.SetParameter(params);
+        threads.emplace_back([function, calls, &sums, t]() mutable
+        {
+          INT sum = 0;
+          for(INT n = 0; n < calls; ++n)
+            sum += function((int)n, (n & 1) != 0);
+          sums[t] = sum;
+        });
       }
-
-      context.Execute();
+      for(auto &thread : threads)
+        thread.join();
       auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
-      std::cout << "Runtime: " << elapsed.count() << "mcs" << std::endl;
 
-      returnValue =  *((INT32*)context.GetReturnValue());
-      context.DestroyReturnMemory();
+      std::cout << threadCount << " threads: " << calls * threadCount * 1000 / std::max((INT)elapsed.count(), (INT)1) << " calls/ms" << std::endl;
+      for(INT sum : sums)
+        result = result && sum == expectedValue;
+    }
+  }
+
+  return result;
+}
+
+void RunThreadedTest(const std::string &fileName, INT expectedValue, INT calls)
+{
+  bool ret = RunThreadedTestFile(fileName, expectedValue, calls);
+  std::cout << fileName << " on many threads";
+  PrintResult(ret);
+}
+
+// submits calls of main(int, bool) of the test like RunFunctionTestFile makes them to the VM's scheduler,
+// with a callback adding up their results. prints calls per millisecond and how much longer a call takes than
+// the same call made directly on this thread, workers take them in batches. a few calls are then submitted through
+// a typed handle, waiting for their futures. returns false if either sum is not the expected one
+bool RunSchedulerTestFile(const std::string &file, INT expectedValue, INT calls)
+{
+  bool result = false;
+  std::unique_ptr<TestVM> test = LoadTestVM(file);
+  if(test)
+  {
+    VM &vm = test->vm;
+    // at least a few workers even on one core, they still steal from each other
+    Scheduler *scheduler = vm.StartScheduler(std::max((INT)std::thread::hardware_concurrency(), (INT)4));
+    INT id = vm.GetGlobalFunctionId("main");
+    std::atomic<INT> sum(0);
+    char params[5];
+
+    auto start = std::chrono::steady_clock::now();
+    result = true;
+    for(INT n = 0; n < calls; ++n)
+    {
+      *(INT32*)params = (INT32)n;
+      params[4] = (n & 1) != 0;
+      result = result && scheduler->Submit(id, params, 5, [&sum](ExecutionContext::ExecutionStatus status, const char *returnValue)
+      {
+        sum += *(INT32*)returnValue;
+      });
+    }
+    scheduler->Wait();
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+
+    auto function = vm.GetFunction<int(int, bool)>("main");
+    INT directSum = 0;
+    start = std::chrono::steady_clock::now();
+    for(INT n = 0; n < calls; ++n)
+      directSum += function((int)n, (n & 1) != 0);
+    auto direct = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+
+    // the same calls in one batch
+    std::vector<char> batchParams((size_t)calls * 5);
+    for(INT n = 0; n < calls; ++n)
+    {
+      *(INT32*)&batchParams[(size_t)n * 5] = (INT32)n;
+      batchParams[(size_t)n * 5 + 4] = (n & 1) != 0;
     }
+    std::atomic<INT> batchSum(0);
+    start = std::chrono::steady_clock::now();
+    result = result && scheduler->SubmitBatch(id, batchParams.data(), 5, calls, [&batchSum](INT index, ExecutionContext::ExecutionStatus status, const char *returnValue)
+    {
+      batchSum += *(INT32*)returnValue;
+    });
+    scheduler->Wait();
+    auto batched = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+
+    INT64 callNanoseconds = (INT64)elapsed.count() / calls;
+    INT64 batchedNanoseconds = (INT64)batched.count() / calls;
+    INT64 directNanoseconds = (INT64)direct.count() / calls;
+    std::cout << scheduler->GetWorkerCount() << " workers: " << calls * 1000000LL / std::max((INT64)elapsed.count(), (INT64)1) << " calls/ms, "
+      << callNanoseconds << "ns a call, " << callNanoseconds - directNanoseconds << "ns more than a direct call in batches of up to "
+      << Scheduler::batchSize << ", " << batchedNanoseconds - directNanoseconds << "ns more in one submitted batch" << std::endl;
+
+    result = result && sum == expectedValue && directSum == expectedValue && batchSum == expectedValue;
+    result = result && !scheduler->Submit(id, params, 4, nullptr) && !scheduler->SubmitBatch(id, batchParams.data(), 5, 0, nullptr);
 
-    delete package;
-    package = nullptr;
+    // the same sum of the first 1000 calls through futures
+    std::vector<std::future<int>> futures;
+    for(INT n = 0; n < 1000; ++n)
+      futures.push_back(scheduler->Submit(function, (int)n, (n & 1) != 0));
+
+    INT futureSum = 0;
+    for(auto &future : futures)
+      futureSum += future.get();
+    result = result && futureSum == -1500;
   }
-  else
-    std::cout << "Errors in " << file << "!\n";
 
-  /*
-  std::string out;
-  Node::ConvertToString(parser.GetMainNode(), packageInfo, out);
-  std::cout << out;
-  */
+  return result;
+}
+
+void RunSchedulerTest(const std::string &fileName, INT expectedValue, INT calls)
+{
+  bool ret = RunSchedulerTestFile(fileName, expectedValue, calls);
+  std::cout << fileName << " on the scheduler";
+  PrintResult(ret);
+}
+
+// runs main of the test as many coroutines at once, each with a frame stack of its own, resuming them in turn
+// until all of them return. the first one is started over once. returns the sum of their results,
+// or -1 if any of them doesn't suspend exactly yields times.
+// the same coroutines are then submitted to the VM's scheduler, their sum must be the same
+INT RunCoroutineTestFile(const std::string &file, INT yields, INT coroutines)
+{
+  INT returnValue = -1;
+  std::unique_ptr<TestVM> test = LoadTestVM(file);
+  if(test)
+  {
+    VM &vm = test->vm;
+    std::vector<FrameStack*> frameStacks;
+    std::vector<ExecutionContext*> contexts;
+    std::vector<INT32> results(coroutines, 0);
+    std::vector<INT> suspensions(coroutines, 0);
+    for(INT i = 0; i < coroutines; ++i)
+    {
+      frameStacks.push_back(new FrameStack(1024));
+      contexts.push_back(new ExecutionContext(vm.GetBytecode(), vm.GetGlobalFunctionBytecode("main"), frameStacks[i], true));
+      contexts[i]->SetReturnMemory((char*)&results[i]);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    contexts[0]->Execute();
+    for(auto context : contexts)
+      context->Execute();
+
+    INT running = coroutines;
+    while(running)
+    {
+      running = 0;
+      for(INT i = 0; i < coroutines; ++i)
+      {
+        if(contexts[i]->GetStatus() != ExecutionContext::Suspended)
+          continue;
+        ++suspensions[i];
+        contexts[i]->Resume();
+        ++running;
+      }
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    std::cout << "Runtime: " << elapsed.count() << "mcs" << std::endl;
+
+    returnValue = 0;
+    for(INT i = 0; i < coroutines; ++i)
+    {
+      if(contexts[i]->GetStatus() != ExecutionContext::Returned || suspensions[i] != yields)
+      {
+        returnValue = -1;
+        break;
+      }
+      returnValue += results[i];
+    }
+
+    for(INT i = 0; i < coroutines; ++i)
+    {
+      delete contexts[i];
+      delete frameStacks[i];
+    }
+
+    start = std::chrono::steady_clock::now();
+    std::atomic<INT> scheduledValue(0);
+    Scheduler *scheduler = vm.StartScheduler(std::max((INT)std::thread::hardware_concurrency(), (INT)4));
+    for(INT i = 0; i < coroutines; ++i)
+    {
+      scheduler->Submit(vm.GetGlobalFunctionId("main"), nullptr, 0, [&scheduledValue](ExecutionContext::ExecutionStatus status, const char *returnValue)
+      {
+        scheduledValue += *(INT32*)returnValue;
+      }, true);
+    }
+    scheduler->Wait();
+    elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    std::cout << "Runtime on " << scheduler->GetWorkerCount() << " workers: " << elapsed.count() << "mcs" << std::endl;
+
+    if(scheduledValue != returnValue)
+      returnValue = -1;
+  }
 
   return returnValue;
 }
 
+void RunCoroutineTest(const std::string &fileName, INT expectedValue, INT yields, INT coroutines)
+{
+  INT ret = RunCoroutineTestFile(fileName, yields, coroutines);
+  std::cout << fileName << " as " << coroutines << " coroutines";
+  PrintResult(ret == expectedValue);
+}
+
+// runs main of the test as a coroutine preempted after each budget back-edges and calls, resuming it until it returns.
+// returns its result, or -1 if it is preempted fewer than preemptions times or a context that isn't a coroutine
+// doesn't run it to the end with the same budget. with tiering, also -1 if a function is compiled in a slice
+// or a slice takes as long as a compilation
+INT RunPreemptedTestFile(const std::string &file, INT budget, INT preemptions)
+{
+  INT returnValue = -1;
+  std::unique_ptr<TestVM> test = LoadTestVM(file);
+  if(test)
+  {
+    VM &vm = test->vm;
+    INT32 result = 0;
+    FrameStack frameStack(1024);
+    ExecutionContext context(vm.GetBytecode(), vm.GetGlobalFunctionBytecode("main"), &frameStack, true);
+    context.SetReturnMemory((char*)&result);
+    context.SetBudget(budget);
+
+    // functions tiered up while running are compiled between the slices, not in them
+    INT preempted = 0;
+    INT compiledInSlices = 0;
+    INT compiledBetweenSlices = 0;
+    auto longestSlice = std::chrono::microseconds(0);
+    auto longestCompile = std::chrono::microseconds(0);
+    INT tierUps = tierUpCount;
+    auto start = std::chrono::steady_clock::now();
+    context.Execute();
+    for(;;)
+    {
+      auto now = std::chrono::steady_clock::now();
+      longestSlice = std::max(longestSlice, std::chrono::duration_cast<std::chrono::microseconds>(now - start));
+      compiledInSlices += tierUpCount - tierUps;
+
+      if(context.GetStatus() != ExecutionContext::Preempted)
+        break;
+      ++preempted;
+
+      tierUps = tierUpCount;
+      context.CompileDeferred();
+      start = std::chrono::steady_clock::now();
+      longestCompile = std::max(longestCompile, std::chrono::duration_cast<std::chrono::microseconds>(start - now));
+      compiledBetweenSlices += tierUpCount - tierUps;
+      tierUps = tierUpCount;
+      context.Resume();
+    }
+    std::cout << "Preempted " << preempted << " times, longest slice: " << longestSlice.count() << "mcs, longest compilation between slices: "
+      << longestCompile.count() << "mcs" << std::endl;
+
+    INT32 unlimitedResult = 0;
+    ExecutionContext unlimited(vm.GetBytecode(), vm.GetGlobalFunctionBytecode("main"));
+    unlimited.SetReturnMemory((char*)&unlimitedResult);
+    unlimited.SetBudget(budget);
+    unlimited.Execute();
+
+    bool slicesShort = compiledInSlices == 0 && (compiledBetweenSlices == 0 || longestSlice < longestCompile);
+    if(context.GetStatus() == ExecutionContext::Returned && preempted >= preemptions && slicesShort &&
+      unlimited.GetStatus() == ExecutionContext::Returned && unlimitedResult == result)
+      returnValue = result;
+  }
+
+  return returnValue;
+}
+
+void RunPreemptedTest(const std::string &fileName, INT expectedValue, INT budget, INT preemptions)
+{
+  INT ret = RunPreemptedTestFile(fileName, budget, preemptions);
+  std::cout << fileName << " with a budget of " << budget;
+  PrintResult(ret == expectedValue);
+}
+
+// spawns instances of main of the test on a tick scheduler, instance i with parameter 1 + i % 10 and priority
+// i % priorityLevels, every 7th sleeping for 5 ticks first. ticks run until every instance returns.
+// returns the sum of their results, or -1 if they don't finish in exactly ticks ticks, or if ticks is 0 and no tick
+// runs out of its microseconds
+INT RunTickTestFile(const std::string &file, INT instances, INT64 microseconds, INT64 ticks)
+{
+  INT returnValue = -1;
+  std::unique_ptr<TestVM> test = LoadTestVM(file);
+  if(test)
+  {
+    VM &vm = test->vm;
+    INT sum = 0;
+    INT failed = 0;
+    TickScheduler scheduler(vm.GetBytecode());
+    auto callback = [&sum, &failed](INT id, ExecutionContext::ExecutionStatus status, const char *returnValue)
+    {
+      if(status == ExecutionContext::Returned)
+        sum += *(INT32*)returnValue;
+      else
+        ++failed;
+    };
+
+    for(INT i = 0; i < instances; ++i)
+    {
+      INT32 n = 1 + (INT32)(i % 10);
+      INT id = scheduler.Spawn(vm.GetGlobalFunctionId("main"), (char*)&n, sizeof(n), i % TickScheduler::priorityLevels, callback);
+      if(id == -1)
+        ++failed;
+      else if(i % 7 == 0)
+        scheduler.Sleep(id, 5);
+    }
+
+    INT overruns = 0;
+    while(scheduler.GetInstanceCount() && scheduler.GetTick() < 1000000)
+      overruns += scheduler.Tick(microseconds).waiting ? 1 : 0;
+
+    std::cout << scheduler.GetTick() << " ticks, " << overruns << " out of time, p50: " << scheduler.GetTickPercentile(50);
+    std::cout << "mcs p99: " << scheduler.GetTickPercentile(99) << "mcs max: " << scheduler.GetTickPercentile(100) << "mcs" << std::endl;
+
+    if(!failed && !scheduler.GetInstanceCount() && (ticks ? scheduler.GetTick() == ticks : overruns > 0))
+      returnValue = sum;
+  }
+
+  return returnValue;
+}
+
+void RunTickTest(const std::string &fileName, INT expectedValue, INT instances, INT64 microseconds, INT64 ticks)
+{
+  INT ret = RunTickTestFile(fileName, instances, microseconds, ticks);
+  std::cout << fileName << " as " << instances << " instances in ticks of " << microseconds << "mcs";
+  PrintResult(ret == expectedValue);
+}
+
+// spawns highInstances instances of Count of the test counting to highCount with the highest priority, then one counting
+// to lowCount with the lowest. ticks run until every instance returns. returns how many of the high priority instances
+// returned before the low priority one, or -1 if any of them fails
+INT RunAgingTestFile(const std::string &file, INT highInstances, INT32 highCount, INT32 lowCount)
+{
+  INT returnValue = -1;
+  std::unique_ptr<TestVM> test = LoadTestVM(file);
+  if(test)
+  {
+    VM &vm = test->vm;
+    INT lowId = -1;
+    INT highFinished = 0;
+    INT highBeforeLow = -1;
+    INT failed = 0;
+    TickScheduler scheduler(vm.GetBytecode());
+    auto callback = [&](INT id, ExecutionContext::ExecutionStatus status, const char *returnValue)
+    {
+      if(status != ExecutionContext::Returned || *(INT32*)returnValue != (id == lowId ? lowCount : highCount))
+        ++failed;
+      else if(id == lowId)
+        highBeforeLow = highFinished;
+      else
+        ++highFinished;
+    };
+
+    INT count = vm.GetGlobalFunctionId("Count");
+    for(INT i = 0; i < highInstances; ++i)
+      failed += scheduler.Spawn(count, (char*)&highCount, sizeof(highCount), TickScheduler::priorityLevels - 1, callback) == -1 ? 1 : 0;
+    lowId = scheduler.Spawn(count, (char*)&lowCount, sizeof(lowCount), 0, callback);
+    failed += lowId == -1 ? 1 : 0;
+
+    while(scheduler.GetInstanceCount() && scheduler.GetTick() < 1000000)
+      scheduler.Tick(1000);
+    std::cout << scheduler.GetTick() << " ticks, " << highBeforeLow << " high priority instances returned first" << std::endl;
+
+    if(!failed && !scheduler.GetInstanceCount())
+      returnValue = highBeforeLow;
+  }
+
+  return returnValue;
+}
+
+void RunAgingTest(const std::string &fileName, INT expectedValue, INT highInstances, INT32 highCount, INT32 lowCount)
+{
+  INT ret = RunAgingTestFile(fileName, highInstances, highCount, lowCount);
+  std::cout << fileName << " low priority instance beside " << highInstances << " high priority ones";
+  PrintResult(ret == expectedValue);
+}
+
+// runs main of the test, which must stop with expectedStatus
+void RunStatusTest(const std::string &fileName, ExecutionContext::ExecutionStatus expectedStatus)
+{
+  ExecutionContext::ExecutionStatus status = ExecutionContext::NotPrepared;
+  std::unique_ptr<TestVM> test = LoadTestVM(fileName);
+  if(test)
+  {
+    ExecutionContext context(test->vm.GetBytecode(), test->vm.GetGlobalFunctionBytecode("main"));
+    context.CreateReturnMemory();
+    context.Execute();
+    status = context.GetStatus();
+    context.DestroyReturnMemory();
+  }
+
+  std::cout << fileName << " stops with status " << status;
+  PrintResult(status == expectedStatus);
+}
+
+// runs main of the test, every call it makes must have been inlined
+void RunInlineTest(const std::string &fileName, INT expectedValue)
+{
+  INT ret = -1;
+  INT calls = -1;
+  std::unique_ptr<TestVM> test = LoadTestVM(fileName);
+  if(test)
+  {
+    FunctionBytecode *main = test->vm.GetGlobalFunctionBytecode("main");
+    calls = 0;
+    for(auto &instruction : main->optimizedInstructions)
+    {
+      OpCode opCode = GetInstructionInfo(instruction.opCode).genericOpCode;
+      if(opCode == OP_Call || opCode == OP_TailCall)
+        ++calls;
+    }
+
+    ExecutionContext context(test->vm.GetBytecode(), main);
+    context.CreateReturnMemory();
+    context.Execute();
+    if(context.GetStatus() == ExecutionContext::Returned)
+      ret = *((INT32*)context.GetReturnValue());
+    context.DestroyReturnMemory();
+  }
+
+  std::cout << fileName << " inlined, " << calls << " calls left";
+  PrintResult(ret == expectedValue && calls == 0);
+}
+
+// runs main of the test, the function must have been compiled to native code
+void RunNativeTest(const std::string &fileName, INT expectedValue, const std::string &functionName)
+{
+  INT ret = -1;
+  bool native = false;
+  std::unique_ptr<TestVM> test = LoadTestVM(fileName);
+  if(test)
+  {
+    FunctionBytecode *function = test->vm.GetGlobalFunctionBytecode(functionName);
+    native = function && function->nativeCode;
+
+    ExecutionContext context(test->vm.GetBytecode(), test->vm.GetGlobalFunctionBytecode("main"));
+    context.CreateReturnMemory();
+    context.Execute();
+    if(context.GetStatus() == ExecutionContext::Returned)
+      ret = *((INT32*)context.GetReturnValue());
+    context.DestroyReturnMemory();
+  }
+
+  std::cout << fileName << " with " << functionName << (native ? " in native code" : " interpreted");
+  PrintResult(ret == expectedValue && native);
+}
+
 void RunTest(const std::string &fileName, INT expectedValue, INT numOfBytesParameters = 0, bool printInstructions = false)
 {
   INT ret = RunTestFile(fileName,  numOfBytesParameters, printInstructions);
-  std::cout << fileName << " ";
-  if(ret == expectedValue)
-    std::cout << "[ Success! ]\n";
-  else
-    std::cout << "[ Failed! ]\n";
-  std::cout << "---\n";
+  std::cout << fileName;
+  PrintResult(ret == expectedValue);
 }
 
 void main()
@@ -119,6 +747,7 @@ void main()
 #endif
 
   {
+    RunFrameStackTest();
     RunTest("../scripts/Test0.script", 1, 0);    
     RunTest("../scripts/Test1.script", 1);
     RunTest("../scripts/Test2.script", 1);
@@ -167,6 +796,101 @@ void main()
     RunTest("../scripts/Test45.script", 75025, 12);  
     RunTest("../scripts/Test46.script", 1000, 0);
     RunTest("../scripts/Test47.script", 7, 0);
+    RunStatusTest("../scripts/Test48.script", ExecutionContext::CallDepthExceeded);
+    RunTest("../scripts/Test49.script", 101, 0);
+    RunTest("../scripts/Test50.script", 1, 0);
+    RunTest("../scripts/Test51.script", -545, 0);
+    RunTest("../scripts/Test52.script", 19, 0);
+    RunTest("../scripts/Test53.script", 61, 0);
+    RunTest("../scripts/Test54.script", 7010, 0);
+    RunTest("../scripts/Test55.script", 600011, 0);
+    // tail calls don't need any optimization
+    optimizationLevel = OL_None;
+    RunTest("../scripts/Test55.script", 600011, 0);
+    optimizationLevel = OL_Full;
+    RunTest("../scripts/Test56.script", 500615, 0);
+    RunTest("../scripts/Test57.script", 202005, 0);
+    RunTest("../scripts/Test58.script", 330005, 0);
+    RunTest("../scripts/Test59.script", 1002000, 0);
+    RunFunctionTest("../scripts/Test60.script", -1500000, 1000000);
+    RunThreadedTest("../scripts/Test60.script", -1500000, 1000000);
+    RunSchedulerTest("../scripts/Test60.script", -1500000, 1000000);
+    RunTest("../scripts/Test61.script", 58, 0);
+    RunCoroutineTest("../scripts/Test61.script", 58000, 25, 1000);
+    RunTest("../scripts/Test62.script", 100100000, 0);
+    RunPreemptedTest("../scripts/Test62.script", 100100000, 100, 1000);
+    RunTickTest("../scripts/Test63.script", 10045000, 10000, 1000000, 15);
+    RunTickTest("../scripts/Test63.script", 1004500, 1000, 50, 0);
+    RunAgingTest("../scripts/Test62.script", 0, 8, 1000000, 100000);
+    RunTest("../scripts/Test64.script", 150, 0);
+    RunInlineTest("../scripts/Test64.script", 150);
+    optimizationLevel = OL_None;
+    RunTest("../scripts/Test64.script", 150, 0);
+    optimizationLevel = OL_Full;
+
+    // compiled to native code
+    compileToNative = true;
+    RunTest("../scripts/Test29.script", 1000000, 0);
+    RunTest("../scripts/Test36.script", 3, 12);
+    RunTest("../scripts/Test45.script", 75025, 12);
+    RunTest("../scripts/Test53.script", 61, 0);
+    RunTest("../scripts/Test54.script", 7010, 0);
+    RunTest("../scripts/Test55.script", 600011, 0);
+    // without optimizations Count calls itself in tail position deeper than the call depth limit, Start calls it
+    optimizationLevel = OL_None;
+    RunNativeTest("../scripts/Test55.script", 600011, "Count");
+    RunNativeTest("../scripts/Test55.script", 600011, "Start");
+    optimizationLevel = OL_Full;
+    RunTest("../scripts/Test56.script", 500615, 0);
+    RunTest("../scripts/Test57.script", 202005, 0);
+    RunTest("../scripts/Test58.script", 330005, 0);
+    RunTest("../scripts/Test59.script", 1002000, 0);
+    RunFunctionTest("../scripts/Test60.script", -1500000, 1000000);
+    RunThreadedTest("../scripts/Test60.script", -1500000, 1000000);
+    RunSchedulerTest("../scripts/Test60.script", -1500000, 1000000);
+    RunTest("../scripts/Test61.script", 58, 0);
+    RunCoroutineTest("../scripts/Test61.script", 58000, 25, 1000);
+    RunTest("../scripts/Test62.script", 100100000, 0);
+    RunPreemptedTest("../scripts/Test62.script", 100100000, 100, 1000);
+    RunTickTest("../scripts/Test63.script", 10045000, 10000, 1000000, 15);
+    RunTickTest("../scripts/Test63.script", 1004500, 1000, 50, 0);
+    RunAgingTest("../scripts/Test62.script", 0, 8, 1000000, 100000);
+
+    // optimized while running, interpreted and then compiled to native code
+    tiered = true;
+    for(INT i = 0; i < 2; ++i)
+    {
+      compileToNative = i == 1;
+      RunTest("../scripts/Test29.script", 1000000, 0);
+      RunTest("../scripts/Test45.script", 75025, 12);
+      RunTest("../scripts/Test53.script", 61, 0);
+      RunTest("../scripts/Test54.script", 7010, 0);
+      RunTest("../scripts/Test55.script", 600011, 0);
+      RunTest("../scripts/Test56.script", 500615, 0);
+      RunTest("../scripts/Test57.script", 202005, 0);
+      RunTest("../scripts/Test58.script", 330005, 0);
+      RunTest("../scripts/Test59.script", 1002000, 0);
+      RunFunctionTest("../scripts/Test60.script", -1500000, 1000000);
+      RunSchedulerTest("../scripts/Test60.script", -1500000, 1000000);
+      RunTest("../scripts/Test61.script", 58, 0);
+      RunCoroutineTest("../scripts/Test61.script", 58000, 25, 1000);
+      RunTest("../scripts/Test62.script", 100100000, 0);
+      RunPreemptedTest("../scripts/Test62.script", 100100000, 100, 1000);
+      RunTickTest("../scripts/Test63.script", 10045000, 10000, 1000000, 15);
+      RunTickTest("../scripts/Test63.script", 1004500, 1000, 50, 0);
+      RunAgingTest("../scripts/Test62.script", 0, 8, 1000000, 100000);
+    }
+    std::cout << "functions optimized while running: " << tierUpCount << std::endl;
+
+    // compiled ahead of time, with the package and without it
+    tiered = false;
+    compileToNative = false;
+    //CompileTestFile("../scripts/Test56.script", "Test56", "../Source/src/CompiledTest56.cpp");
+    compiledFunctions = Test56_functions;
+    compiledFunctionCount = Test56_functionCount;
+    RunTest("../scripts/Test56.script", 500615, 0);
+    compiledFunctions = nullptr;
+    RunCompiledTest("Test56", Test56_functions, Test56_functionCount, 500615);
     /**/
   }
 